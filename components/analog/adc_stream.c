@@ -0,0 +1,205 @@
+#include <string.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_adc/adc_continuous.h"
+#include "adc_stream.h"
+
+#define FRAME_SAMPLES       (ADC_STREAM_FRAME_BYTES / SOC_ADC_DIGI_RESULT_BYTES)
+#define READ_TIMEOUT_MS     20      // A frame takes 6.4 ms at 20 kHz
+
+typedef struct {
+    int channel;
+    adc_stream_sink_t sink;
+    void *arg;
+} stream_channel_t;
+
+static const char *TAG = "adc_stream";
+static adc_continuous_handle_t handle = NULL;
+static stream_channel_t channels[ADC_STREAM_MAX_CHANNELS];
+static int channel_count = 0;
+static int8_t slot_of[ADC_STREAM_MAX_CHANNELS];     // Index into channels by ADC channel
+static uint32_t period_ms;
+static uint32_t burst_ms;
+static TaskHandle_t task = NULL;
+static StaticTask_t task_buffer;
+static StackType_t task_stack[ADC_STREAM_TASK_STACK];
+static portMUX_TYPE hold_lock = portMUX_INITIALIZER_UNLOCKED;
+static volatile int holds = 0;
+
+// Sampling task only
+static uint8_t frame[ADC_STREAM_FRAME_BYTES];
+static uint16_t split[ADC_STREAM_MAX_CHANNELS][FRAME_SAMPLES];
+
+esp_err_t adc_stream_add_channel(int channel, adc_stream_sink_t sink, void *arg)
+{
+    if (channel < 0 || channel >= ADC_STREAM_MAX_CHANNELS || sink == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (handle != NULL || channel_count == ADC_STREAM_MAX_CHANNELS) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    channels[channel_count++] = (stream_channel_t) { channel, sink, arg };
+    return ESP_OK;
+}
+
+// Sort the interleaved samples of a frame by channel and hand them out
+static void dispatch(uint32_t len)
+{
+    int counts[ADC_STREAM_MAX_CHANNELS] = { 0 };
+
+    for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= len; i += SOC_ADC_DIGI_RESULT_BYTES) {
+        const adc_digi_output_data_t *d = (const adc_digi_output_data_t *)&frame[i];
+        if (d->type1.channel >= ADC_STREAM_MAX_CHANNELS || slot_of[d->type1.channel] < 0) {
+            continue;
+        }
+        int slot = slot_of[d->type1.channel];
+        split[slot][counts[slot]++] = d->type1.data;
+    }
+    for (int s = 0; s < channel_count; s++) {
+        if (counts[s] > 0) {
+            channels[s].sink(split[s], counts[s], channels[s].arg);
+        }
+    }
+}
+
+static void end_burst(void)
+{
+    for (int s = 0; s < channel_count; s++) {
+        channels[s].sink(NULL, 0, channels[s].arg);
+    }
+}
+
+// The converter runs during each burst window and for as long as anyone
+// holds the stream; in between the task sleeps until the next window or a
+// new hold
+static void stream_task(void *arg)
+{
+    int64_t burst_at = esp_timer_get_time();
+    bool in_burst = false;
+    bool running = false;
+    bool boosted = false;
+    uint32_t stale = 0;
+
+    while (true) {
+        int64_t now = esp_timer_get_time();
+        if (burst_ms > 0 && !in_burst && now >= burst_at) {
+            in_burst = true;
+        } else if (in_burst && now >= burst_at + (int64_t)burst_ms * 1000) {
+            in_burst = false;
+            while (burst_at <= now) {
+                burst_at += (int64_t)period_ms * 1000;
+            }
+            end_burst();
+        }
+
+        bool held = holds > 0;
+        if (held != boosted) {
+            vTaskPrioritySet(NULL, held ? ADC_STREAM_HOLD_PRIORITY : ADC_STREAM_TASK_PRIORITY);
+            boosted = held;
+        }
+        if ((in_burst || held) != running) {
+            running = !running;
+            esp_err_t err = running ? adc_continuous_start(handle) : adc_continuous_stop(handle);
+            if (err != ESP_OK) {
+                ESP_LOGW(TAG, "%s failed: %s", running ? "Start" : "Stop", esp_err_to_name(err));
+                running = false;
+            }
+            // What is left in the pool is from the previous run
+            stale = ADC_STREAM_POOL_BYTES;
+        }
+
+        if (!running) {
+            TickType_t wait = portMAX_DELAY;
+            if (in_burst || held) {
+                wait = pdMS_TO_TICKS(READ_TIMEOUT_MS);      // Start failed, try again
+            } else if (burst_ms > 0) {
+                wait = pdMS_TO_TICKS((burst_at - now) / 1000) + 1;
+            }
+            ulTaskNotifyTake(pdTRUE, wait);
+            continue;
+        }
+
+        uint32_t len = 0;
+        esp_err_t err = adc_continuous_read(handle, frame, sizeof(frame), &len, READ_TIMEOUT_MS);
+        if (err == ESP_ERR_TIMEOUT) {
+            continue;
+        } else if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Read failed: %s", esp_err_to_name(err));
+            vTaskDelay(pdMS_TO_TICKS(READ_TIMEOUT_MS));
+            continue;
+        }
+        if (stale > 0) {
+            stale -= MIN(stale, len);
+            continue;
+        }
+        dispatch(len);
+    }
+}
+
+void adc_stream_hold(bool hold)
+{
+    portENTER_CRITICAL(&hold_lock);
+    if (hold) {
+        holds++;
+    } else if (holds > 0) {
+        holds--;
+    }
+    portEXIT_CRITICAL(&hold_lock);
+
+    if (hold && task != NULL) {
+        xTaskNotifyGive(task);
+    }
+}
+
+esp_err_t adc_stream_start(uint32_t sample_rate_hz, uint32_t period, uint32_t burst, int core_id)
+{
+    if (channel_count == 0 || (burst > 0 && burst >= period)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (handle != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    period_ms = period;
+    burst_ms = burst;
+
+    adc_continuous_handle_cfg_t handle_cfg = {
+        .max_store_buf_size = ADC_STREAM_POOL_BYTES,
+        .conv_frame_size    = ADC_STREAM_FRAME_BYTES,
+    };
+    esp_err_t err = adc_continuous_new_handle(&handle_cfg, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    adc_digi_pattern_config_t pattern[ADC_STREAM_MAX_CHANNELS];
+    memset(slot_of, -1, sizeof(slot_of));
+    for (int s = 0; s < channel_count; s++) {
+        pattern[s] = (adc_digi_pattern_config_t) {
+            .atten     = ADC_ATTEN_DB_11,
+            .channel   = channels[s].channel,
+            .unit      = ADC_UNIT_1,
+            .bit_width = SOC_ADC_DIGI_MAX_BITWIDTH,
+        };
+        slot_of[channels[s].channel] = s;
+    }
+    adc_continuous_config_t config = {
+        .pattern_num    = channel_count,
+        .adc_pattern    = pattern,
+        .sample_freq_hz = sample_rate_hz,
+        .conv_mode      = ADC_CONV_SINGLE_UNIT_1,
+        .format         = ADC_DIGI_OUTPUT_FORMAT_TYPE1,
+    };
+    err = adc_continuous_config(handle, &config);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    task = xTaskCreateStaticPinnedToCore(stream_task, "adc_stream", ADC_STREAM_TASK_STACK, NULL,
+                                         ADC_STREAM_TASK_PRIORITY, task_stack, &task_buffer, core_id);
+    ESP_LOGI(TAG, "%d channels at %lu Hz, %lu ms every %lu ms", channel_count, (unsigned long)sample_rate_hz,
+             (unsigned long)burst_ms, (unsigned long)period_ms);
+    return ESP_OK;
+}
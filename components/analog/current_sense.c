@@ -0,0 +1,145 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "adc_stream.h"
+#include "current_sense.h"
+
+typedef struct {
+    current_sensor_config_t cfg;
+    bool active;
+    bool stalled;
+    int64_t blank_until;        // No stall before this, microseconds
+    int64_t over_since;         // Start of the current run above stall_ma, 0 if below
+    uint64_t sum_ma;            // Sum of the frame means
+    uint32_t frames;
+    uint16_t peak_ma;
+} sensor_t;
+
+static const char *TAG = "current_sense";
+static sensor_t sensors[CURRENT_SENSE_MAX_SENSORS];
+static int sensor_count = 0;
+static current_stall_cb_t stall_cb = NULL;
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint16_t to_ma(const current_sensor_config_t *cfg, uint32_t raw)
+{
+    if (raw <= cfg->zero_raw) {
+        return 0;
+    }
+    uint32_t ma = (raw - cfg->zero_raw) * cfg->ua_per_count / 1000;
+    return ma > UINT16_MAX ? UINT16_MAX : ma;
+}
+
+// Sampling task: one frame's share of a sensor, a few milliseconds worth
+static void sink(const uint16_t *samples, int count, void *arg)
+{
+    int id = (intptr_t)arg;
+    sensor_t *s = &sensors[id];
+
+    if (count == 0 || !s->active) {
+        return;
+    }
+    uint32_t sum = 0;
+    for (int i = 0; i < count; i++) {
+        sum += samples[i];
+    }
+    uint16_t ma = to_ma(&s->cfg, sum / count);
+    int64_t now = esp_timer_get_time();
+    bool stall = false;
+
+    portENTER_CRITICAL(&lock);
+    if (s->active) {
+        s->sum_ma += ma;
+        s->frames++;
+        if (ma > s->peak_ma) {
+            s->peak_ma = ma;
+        }
+        if (ma < s->cfg.stall_ma || now < s->blank_until) {
+            s->over_since = 0;
+        } else if (s->over_since == 0) {
+            s->over_since = now;
+        } else if (!s->stalled && now - s->over_since >= (int64_t)s->cfg.stall_ms * 1000) {
+            s->stalled = true;
+            stall = true;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+
+    if (stall) {
+        stall_cb(id, ma);
+    }
+}
+
+void current_sense_begin(int sensor)
+{
+    if (sensor < 0 || sensor >= sensor_count) {
+        return;
+    }
+    sensor_t *s = &sensors[sensor];
+
+    portENTER_CRITICAL(&lock);
+    bool was_active = s->active;
+    s->active = true;
+    s->stalled = false;
+    s->blank_until = esp_timer_get_time() + CURRENT_SENSE_BLANK_MS * 1000;
+    s->over_since = 0;
+    s->sum_ma = 0;
+    s->frames = 0;
+    s->peak_ma = 0;
+    portEXIT_CRITICAL(&lock);
+
+    if (!was_active) {
+        adc_stream_hold(true);
+    }
+}
+
+bool current_sense_end(int sensor, current_result_t *result)
+{
+    if (sensor < 0 || sensor >= sensor_count) {
+        return false;
+    }
+    sensor_t *s = &sensors[sensor];
+
+    portENTER_CRITICAL(&lock);
+    bool was_active = s->active;
+    uint32_t frames = s->frames;
+    *result = (current_result_t) {
+        .peak_ma = s->peak_ma,
+        .avg_ma  = frames > 0 ? s->sum_ma / frames : 0,
+        .stalled = s->stalled,
+    };
+    s->active = false;
+    portEXIT_CRITICAL(&lock);
+
+    if (!was_active) {
+        return false;
+    }
+    adc_stream_hold(false);
+    ESP_LOGD(TAG, "Sensor %d: peak %u mA, average %u mA over %lu frames%s", sensor, result->peak_ma,
+             result->avg_ma, (unsigned long)frames, result->stalled ? ", stalled" : "");
+    return frames > 0;
+}
+
+esp_err_t current_sense_init(const current_sensor_config_t *configs, int count, current_stall_cb_t cb)
+{
+    if (count > CURRENT_SENSE_MAX_SENSORS || cb == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    stall_cb = cb;
+
+    for (int i = 0; i < count; i++) {
+        if (configs[i].ua_per_count == 0) {
+            ESP_LOGE(TAG, "Sensor %d: no scale", i);
+            return ESP_ERR_INVALID_ARG;
+        }
+        sensors[i] = (sensor_t) { .cfg = configs[i] };
+        esp_err_t err = adc_stream_add_channel(configs[i].channel, sink, (void *)(intptr_t)i);
+        if (err != ESP_OK) {
+            return err;
+        }
+        sensor_count = i + 1;
+    }
+    return ESP_OK;
+}
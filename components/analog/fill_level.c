@@ -0,0 +1,120 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include "esp_log.h"
+#include "adc_stream.h"
+#include "fill_level.h"
+
+#define FIXED_SHIFT     4       // Fractional bits of the moving average
+
+typedef struct {
+    fill_sensor_config_t cfg;
+    uint32_t sum;               // Burst in progress
+    uint32_t count;
+    uint16_t medians[FILL_LEVEL_MEDIAN_LEN];
+    int pos;
+    int bursts;                 // Saturates at FILL_LEVEL_MEDIAN_LEN
+    int32_t average;            // Raw counts << FIXED_SHIFT
+    volatile int level;         // Last reported percent
+} sensor_t;
+
+static const char *TAG = "fill_level";
+static sensor_t sensors[FILL_LEVEL_MAX_SENSORS];
+static int sensor_count = 0;
+static uint8_t step = 5;
+static fill_level_cb_t level_cb = NULL;
+
+static uint16_t median3(const uint16_t *v)
+{
+    uint16_t a = v[0], b = v[1], c = v[2];
+    if (a > b) {
+        uint16_t t = a;
+        a = b;
+        b = t;
+    }
+    return c <= a ? a : c >= b ? b : c;
+}
+
+_Static_assert(FILL_LEVEL_MEDIAN_LEN == 3, "median3 expects three bursts");
+
+static int to_percent(const fill_sensor_config_t *cfg, int32_t raw)
+{
+    int32_t span = (int32_t)cfg->full_raw - cfg->empty_raw;
+    int32_t pct = (raw - cfg->empty_raw) * 100 / span;
+    return pct < 0 ? 0 : pct > 100 ? 100 : pct;
+}
+
+static void burst_done(int id, sensor_t *s)
+{
+    if (s->count == 0) {
+        return;
+    }
+    uint16_t mean = s->sum / s->count;
+    s->sum = 0;
+    s->count = 0;
+
+    s->medians[s->pos] = mean;
+    s->pos = (s->pos + 1) % FILL_LEVEL_MEDIAN_LEN;
+    int32_t median = (int32_t)median3(s->medians) << FIXED_SHIFT;
+    if (s->bursts < FILL_LEVEL_MEDIAN_LEN) {
+        // Fill the window before trusting it, then start the average there
+        if (++s->bursts < FILL_LEVEL_MEDIAN_LEN) {
+            return;
+        }
+        s->average = median;
+    } else {
+        s->average += (median - s->average) >> FILL_LEVEL_SMOOTHING;
+    }
+
+    int pct = to_percent(&s->cfg, s->average >> FIXED_SHIFT);
+    // The ends are always reported, so empty is never one step late
+    bool at_end = pct != s->level && (pct == 0 || pct == 100);
+    if (s->level == FILL_LEVEL_UNKNOWN || abs(pct - s->level) >= step || at_end) {
+        s->level = pct;
+        ESP_LOGD(TAG, "Sensor %d at %d%% (raw %ld)", id, pct, (long)(s->average >> FIXED_SHIFT));
+        level_cb(id, pct);
+    }
+}
+
+// Sampling task
+static void sink(const uint16_t *samples, int count, void *arg)
+{
+    int id = (intptr_t)arg;
+    sensor_t *s = &sensors[id];
+
+    if (count == 0) {
+        burst_done(id, s);
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        s->sum += samples[i];
+    }
+    s->count += count;
+}
+
+esp_err_t fill_level_init(const fill_sensor_config_t *configs, int count, uint8_t step_pct, fill_level_cb_t cb)
+{
+    if (count > FILL_LEVEL_MAX_SENSORS || cb == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    step = step_pct > 0 ? step_pct : 1;
+    level_cb = cb;
+
+    for (int i = 0; i < count; i++) {
+        if (configs[i].full_raw == configs[i].empty_raw) {
+            ESP_LOGE(TAG, "Sensor %d: full and empty readings are the same", i);
+            return ESP_ERR_INVALID_ARG;
+        }
+        sensors[i] = (sensor_t) { .cfg = configs[i], .level = FILL_LEVEL_UNKNOWN };
+        esp_err_t err = adc_stream_add_channel(configs[i].channel, sink, (void *)(intptr_t)i);
+        if (err != ESP_OK) {
+            return err;
+        }
+        sensor_count = i + 1;
+    }
+    return ESP_OK;
+}
+
+int fill_level_get(int sensor)
+{
+    return sensor >= 0 && sensor < sensor_count ? sensors[sensor].level : FILL_LEVEL_UNKNOWN;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define ADC_STREAM_MAX_CHANNELS     8       // ADC1 has eight; ADC2 cannot use DMA next to WiFi
+#define ADC_STREAM_FRAME_BYTES      256     // One DMA frame, 128 samples on the ESP32
+#define ADC_STREAM_POOL_BYTES       1024    // Driver buffer, discarded after every start
+#define ADC_STREAM_TASK_STACK       3072
+#define ADC_STREAM_TASK_PRIORITY    2       // Below everything a user waits for
+#define ADC_STREAM_HOLD_PRIORITY    5       // While held; just below the servo and the scale
+
+// Samples of one channel from one DMA frame, raw 12-bit counts. Called on
+// the sampling task with count 0 when a burst window has ended.
+typedef void (*adc_stream_sink_t)(const uint16_t *samples, int count, void *arg);
+
+// Sample ADC1 channel 0-7 into sink at 11 dB attenuation. Call before
+// adc_stream_start(); every channel is converted in turn.
+esp_err_t adc_stream_add_channel(int channel, adc_stream_sink_t sink, void *arg);
+
+// Start the sampling task, pinned to core_id. Every period_ms the converter
+// runs for burst_ms at sample_rate_hz (shared by all channels, at least
+// 20 kHz on the ESP32) and feeds DMA frames to the sinks. It is stopped in
+// between, so it holds no power management lock and light sleep still works.
+// A burst_ms of 0 runs it only while held.
+esp_err_t adc_stream_start(uint32_t sample_rate_hz, uint32_t period_ms, uint32_t burst_ms, int core_id);
+
+// Keep the converter running between bursts, e.g. to watch a servo through
+// a feed; frames arrive every few milliseconds. Holds are counted, each
+// true needs a false. The task runs at ADC_STREAM_HOLD_PRIORITY meanwhile.
+void adc_stream_hold(bool hold);
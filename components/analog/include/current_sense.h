@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define CURRENT_SENSE_MAX_SENSORS   4
+#define CURRENT_SENSE_BLANK_MS      100     // Inrush of a servo starting to move is not a stall
+
+// A shunt and amplifier in the supply of one servo
+typedef struct {
+    int channel;                // ADC1 channel
+    uint16_t zero_raw;          // Reading with the servo idle
+    uint16_t ua_per_count;      // Microamps per count above zero_raw
+    uint16_t stall_ma;          // Current of a servo pushing against a jam
+    uint16_t stall_ms;          // How long it has to last
+} current_sensor_config_t;
+
+// One measurement, from current_sense_begin() to current_sense_end()
+typedef struct {
+    uint16_t peak_ma;           // Highest mean of one DMA frame
+    uint16_t avg_ma;
+    bool stalled;
+} current_result_t;
+
+// The current stayed at or above stall_ma for stall_ms. Called once per
+// measurement on the sampling task; must not block.
+typedef void (*current_stall_cb_t)(int sensor, uint16_t ma);
+
+// Add the sensors to the ADC stream; call before adc_stream_start()
+esp_err_t current_sense_init(const current_sensor_config_t *sensors, int count, current_stall_cb_t cb);
+
+// Start measuring a sensor, holding the ADC stream so every frame is seen
+void current_sense_begin(int sensor);
+
+// Stop measuring and release the stream. Returns false if the sensor does
+// not exist, was not being measured or saw no samples.
+bool current_sense_end(int sensor, current_result_t *result);
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#define FILL_LEVEL_MAX_SENSORS  8
+#define FILL_LEVEL_MEDIAN_LEN   3       // Bursts; drops a paw or a head in front of the sensor
+#define FILL_LEVEL_SMOOTHING    2       // Each new median moves the level by 1/2^N of the way
+#define FILL_LEVEL_UNKNOWN      -1
+
+// One analog distance sensor (IR or ultrasonic) at the top of a hopper
+typedef struct {
+    int channel;                // ADC1 channel
+    uint16_t empty_raw;         // Reading with the hopper empty
+    uint16_t full_raw;          // Reading with it full; may be below empty_raw
+} fill_sensor_config_t;
+
+// A level moved by at least the step since it was last reported, or reached
+// 0 or 100 percent. Called on the sampling task; must not block.
+typedef void (*fill_level_cb_t)(int sensor, int percent);
+
+// Add the sensors to the ADC stream; call before adc_stream_start(). Each
+// burst is averaged per sensor, then a median over the last bursts and an
+// integer moving average give the level.
+esp_err_t fill_level_init(const fill_sensor_config_t *sensors, int count, uint8_t step_pct, fill_level_cb_t cb);
+
+// Last reported level of a sensor in percent, FILL_LEVEL_UNKNOWN before the
+// first one or for a sensor that does not exist
+int fill_level_get(int sensor);
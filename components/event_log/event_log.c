@@ -0,0 +1,245 @@
+#include <stddef.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "event_log.h"
+
+#define RECORD_SIZE         sizeof(event_record_t)
+#define SECTOR_RECORDS      (SPI_FLASH_SEC_SIZE / RECORD_SIZE)
+#define READ_BATCH          8       // Records per flash read while iterating
+
+_Static_assert(sizeof(event_record_t) == 32, "event_record_t must stay 32 bytes");
+
+static const char *TAG = "event_log";
+static const esp_partition_t *partition = NULL;
+static SemaphoreHandle_t lock = NULL;       // Flash access
+static StaticSemaphore_t lock_buffer;
+static QueueHandle_t queue = NULL;
+static StaticQueue_t queue_buffer;
+static uint8_t queue_storage[EVENT_LOG_QUEUE_LEN * RECORD_SIZE];
+static StaticTask_t task_buffer;
+static StackType_t task_stack[EVENT_LOG_TASK_STACK];
+static uint32_t slots = 0;
+static uint32_t head = 0;                   // Next slot to write
+static uint32_t next_seq = 1;
+
+static uint32_t record_crc(const event_record_t *r)
+{
+    return esp_rom_crc32_le(0, (const uint8_t *)r, offsetof(event_record_t, crc));
+}
+
+static bool record_erased(const event_record_t *r)
+{
+    const uint8_t *p = (const uint8_t *)r;
+    for (size_t i = 0; i < RECORD_SIZE; i++) {
+        if (p[i] != 0xff) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool read_slot(uint32_t slot, event_record_t *r)
+{
+    return esp_partition_read(partition, slot * RECORD_SIZE, r, RECORD_SIZE) == ESP_OK;
+}
+
+static bool slot_valid(uint32_t slot, event_record_t *r)
+{
+    return read_slot(slot, r) && !record_erased(r) && r->crc == record_crc(r);
+}
+
+// The newest sector is the one whose first record has the highest seq;
+// inside it, writing resumes at the first erased slot. A record torn by a
+// power cut fails its CRC and is stepped over.
+static void find_head(void)
+{
+    uint32_t sectors = slots / SECTOR_RECORDS;
+    uint32_t newest = 0;
+    uint32_t newest_seq = 0;
+    event_record_t r;
+
+    for (uint32_t s = 0; s < sectors; s++) {
+        if (slot_valid(s * SECTOR_RECORDS, &r) && r.seq >= newest_seq) {
+            newest = s;
+            newest_seq = r.seq;
+        }
+    }
+    if (newest_seq == 0) {
+        head = 0;
+        next_seq = 1;
+        return;
+    }
+
+    head = (newest + 1) * SECTOR_RECORDS;
+    next_seq = newest_seq + 1;
+    for (uint32_t i = 0; i < SECTOR_RECORDS; i++) {
+        uint32_t slot = newest * SECTOR_RECORDS + i;
+        if (!read_slot(slot, &r)) {
+            break;
+        }
+        if (record_erased(&r)) {
+            head = slot;
+            break;
+        }
+        if (r.crc == record_crc(&r) && r.seq >= next_seq) {
+            next_seq = r.seq + 1;
+        }
+    }
+    head %= slots;
+}
+
+static esp_err_t write_slot(const event_record_t *r)
+{
+    esp_err_t err = ESP_OK;
+
+    if (head % SECTOR_RECORDS == 0) {
+        // Entering a sector: drop the oldest records it holds
+        err = esp_partition_erase_range(partition, head * RECORD_SIZE, SPI_FLASH_SEC_SIZE);
+    }
+    if (err == ESP_OK) {
+        err = esp_partition_write(partition, head * RECORD_SIZE, r, RECORD_SIZE);
+    }
+    return err;
+}
+
+static esp_err_t write_record(event_record_t *r)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    r->seq = next_seq;
+    r->crc = record_crc(r);
+    esp_err_t err = write_slot(r);
+    if (err != ESP_OK) {
+        // Once more; programming the same bits again is harmless
+        err = write_slot(r);
+    }
+    if (err != ESP_OK && head % SECTOR_RECORDS == 0) {
+        // Records behind a bad first slot would be invisible to find_head()
+        // and the iterator; leave the sector empty until the next lap
+        head = (head + SECTOR_RECORDS) % slots;
+        err = write_slot(r);
+    }
+    if (err == ESP_OK) {
+        next_seq++;
+        head = (head + 1) % slots;
+    } else if (head % SECTOR_RECORDS != 0) {
+        // A failed slot is skipped rather than retried forever
+        head = (head + 1) % slots;
+    }
+    // A first slot that failed once more is where the next record starts
+    xSemaphoreGive(lock);
+    return err;
+}
+
+static void event_log_task(void *arg)
+{
+    event_record_t r;
+
+    while (true) {
+        xQueueReceive(queue, &r, portMAX_DELAY);
+        esp_err_t err = write_record(&r);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to write record: %s", esp_err_to_name(err));
+        }
+    }
+}
+
+esp_err_t event_log_append(const event_record_t *record)
+{
+    if (queue == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return xQueueSend(queue, record, 0) == pdTRUE ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+uint32_t event_log_total(void)
+{
+    return next_seq - 1;
+}
+
+uint32_t event_log_capacity(void)
+{
+    // The sector about to be erased is as good as empty
+    return slots > SECTOR_RECORDS ? slots - SECTOR_RECORDS : 0;
+}
+
+void event_log_iter_begin(event_log_iter_t *it)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    // Oldest data starts at the sector after the one being written
+    it->slot = ((head / SECTOR_RECORDS + 1) * SECTOR_RECORDS) % slots;
+    it->remaining = slots;
+    it->last_seq = 0;
+    xSemaphoreGive(lock);
+}
+
+int event_log_iter_next(event_log_iter_t *it, event_record_t *out, int max)
+{
+    event_record_t batch[READ_BATCH];
+    int count = 0;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    while (count < max && it->remaining > 0) {
+        // Whole batches within one sector, never past the end of the partition
+        uint32_t n = SECTOR_RECORDS - it->slot % SECTOR_RECORDS;
+        if (n > READ_BATCH) {
+            n = READ_BATCH;
+        }
+        if (n > it->remaining) {
+            n = it->remaining;
+        }
+        if (esp_partition_read(partition, it->slot * RECORD_SIZE, batch, n * RECORD_SIZE) != ESP_OK) {
+            it->remaining = 0;
+            break;
+        }
+
+        // Sectors are filled from the start, so an erased first slot means
+        // the rest of the sector is empty too
+        if (it->slot % SECTOR_RECORDS == 0 && record_erased(&batch[0])) {
+            n = SECTOR_RECORDS < it->remaining ? SECTOR_RECORDS : it->remaining;
+        } else {
+            uint32_t used = 0;
+            while (used < n && count < max) {
+                const event_record_t *r = &batch[used++];
+                if (!record_erased(r) && r->crc == record_crc(r) && r->seq > it->last_seq) {
+                    it->last_seq = r->seq;
+                    out[count++] = *r;
+                }
+            }
+            n = used;
+        }
+        it->slot = (it->slot + n) % slots;
+        it->remaining -= n;
+    }
+    xSemaphoreGive(lock);
+    return count;
+}
+
+esp_err_t event_log_init(void)
+{
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, EVENT_LOG_PARTITION_SUBTYPE,
+                                         EVENT_LOG_PARTITION_LABEL);
+    if (partition == NULL) {
+        ESP_LOGE(TAG, "No \"%s\" partition, check the partition table", EVENT_LOG_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+    slots = partition->size / SPI_FLASH_SEC_SIZE * SECTOR_RECORDS;
+    if (slots < 2 * SECTOR_RECORDS) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    lock = xSemaphoreCreateMutexStatic(&lock_buffer);
+    find_head();
+    ESP_LOGI(TAG, "%lu records logged, room for %lu", (unsigned long)event_log_total(),
+             (unsigned long)event_log_capacity());
+
+    queue = xQueueCreateStatic(EVENT_LOG_QUEUE_LEN, RECORD_SIZE, queue_storage, &queue_buffer);
+    xTaskCreateStatic(event_log_task, "event_log", EVENT_LOG_TASK_STACK, NULL, EVENT_LOG_TASK_PRIORITY,
+                      task_stack, &task_buffer);
+    return ESP_OK;
+}
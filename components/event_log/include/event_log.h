@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define EVENT_LOG_PARTITION_LABEL   "eventlog"
+#define EVENT_LOG_PARTITION_SUBTYPE 0x40    // Custom data subtype, see partitions.csv
+#define EVENT_LOG_QUEUE_LEN         8
+#define EVENT_LOG_TASK_STACK        3072
+#define EVENT_LOG_TASK_PRIORITY     1       // Flash writes stall the caches; keep them out of the way
+
+#define EVENT_LOG_FLAG_TIME_VALID   0x01    // time is Unix time, else seconds since boot
+#define EVENT_LOG_FLAG_WEIGHED      0x02    // portion_mg was measured
+#define EVENT_LOG_FLAG_CURRENT      0x04    // peak_ma and avg_ma were measured
+#define EVENT_LOG_FLAG_JAMMED       0x08    // The servo stalled and backed off
+
+// One record as stored in flash; 32 bytes so a 4 KB sector holds exactly 128
+typedef struct {
+    uint32_t seq;               // Assigned by the log, increases by one per record
+    uint32_t time;
+    uint32_t duration_ms;
+    int32_t portion_mg;
+    uint16_t duty;
+    uint8_t source;             // Meaning is up to the application
+    uint8_t hopper;
+    uint8_t flags;
+    uint8_t reserved0;
+    uint16_t peak_ma;           // Servo supply current
+    uint16_t avg_ma;
+    uint8_t reserved[2];
+    uint32_t crc;               // CRC-32 of the bytes before it, assigned by the log
+} event_record_t;
+
+// Reading position, from the oldest record to the newest
+typedef struct {
+    uint32_t slot;
+    uint32_t remaining;
+    uint32_t last_seq;
+} event_log_iter_t;
+
+// Find the partition and the write position, and start the writer task. The
+// log is a ring of sectors: the sector ahead of the write position is erased
+// just before it is reused, so every sector wears equally and the oldest
+// records are the ones dropped.
+esp_err_t event_log_init(void);
+
+// Queue a record for writing; seq and crc are filled in. Never blocks:
+// ESP_ERR_TIMEOUT when the queue is full, ESP_ERR_INVALID_STATE before init.
+esp_err_t event_log_append(const event_record_t *record);
+
+// Records written since the partition was first used, and how many it holds
+uint32_t event_log_total(void);
+uint32_t event_log_capacity(void);
+
+// Walk the stored records straight from flash, oldest first. Returns how
+// many were copied to out, 0 at the end. Records overwritten while walking
+// are skipped.
+void event_log_iter_begin(event_log_iter_t *it);
+int event_log_iter_next(event_log_iter_t *it, event_record_t *out, int max);
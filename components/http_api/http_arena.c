@@ -0,0 +1,110 @@
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "http_arena.h"
+
+#define ALIGN(n)    (((n) + 3) & ~(size_t)3)
+
+// Original handler of a wrapped URI
+typedef struct {
+    esp_err_t (*handler)(httpd_req_t *req);
+    void *user_ctx;
+} arena_uri_t;
+
+// Handed to the first task that runs a handler and kept by it; only that
+// task touches used
+typedef struct {
+    TaskHandle_t owner;
+    bool active;                // A wrapped handler is running
+    size_t used;
+    uint32_t block[HTTP_ARENA_SIZE / sizeof(uint32_t)];
+} arena_t;
+
+static const char *TAG = "http_arena";
+static arena_uri_t uris[HTTP_ARENA_MAX_URIS];
+static int uri_count = 0;
+static arena_t arenas[HTTP_ARENA_TASKS];
+static portMUX_TYPE claim_lock = portMUX_INITIALIZER_UNLOCKED;
+static volatile uint32_t peak = 0;
+
+static arena_t *own_arena(bool claim)
+{
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+
+    for (int i = 0; i < HTTP_ARENA_TASKS; i++) {
+        if (arenas[i].owner == self) {
+            return &arenas[i];
+        }
+    }
+    if (!claim) {
+        return NULL;
+    }
+
+    arena_t *a = NULL;
+    portENTER_CRITICAL(&claim_lock);
+    for (int i = 0; i < HTTP_ARENA_TASKS && a == NULL; i++) {
+        if (arenas[i].owner == NULL) {
+            a = &arenas[i];
+            a->owner = self;
+        }
+    }
+    portEXIT_CRITICAL(&claim_lock);
+
+    if (a == NULL) {
+        ESP_LOGW(TAG, "No arena left for %s", pcTaskGetName(NULL));
+    }
+    return a;
+}
+
+void *http_arena_alloc(size_t size)
+{
+    arena_t *a = own_arena(false);
+
+    if (a == NULL || !a->active || ALIGN(size) > sizeof(a->block) - a->used) {
+        return NULL;
+    }
+    void *p = (uint8_t *)a->block + a->used;
+    a->used += ALIGN(size);
+    return p;
+}
+
+// Runs in place of every wrapped handler
+static esp_err_t arena_handler(httpd_req_t *req)
+{
+    const arena_uri_t *uri = req->user_ctx;
+    arena_t *a = own_arena(true);
+
+    if (a != NULL) {
+        a->active = true;
+    }
+    req->user_ctx = uri->user_ctx;
+    esp_err_t err = uri->handler(req);
+    if (a != NULL) {
+        if (a->used > peak) {
+            peak = a->used;
+        }
+        a->used = 0;
+        a->active = false;
+    }
+    return err;
+}
+
+void http_arena_wrap_uri(httpd_uri_t *uri)
+{
+    if (uri_count >= HTTP_ARENA_MAX_URIS) {
+        ESP_LOGW(TAG, "No slot left for %s, registered without an arena", uri->uri);
+        return;
+    }
+
+    arena_uri_t *a = &uris[uri_count++];
+    a->handler = uri->handler;
+    a->user_ctx = uri->user_ctx;
+    uri->handler = arena_handler;
+    uri->user_ctx = a;
+}
+
+uint32_t http_arena_get_peak(void)
+{
+    return peak;
+}
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "http_async.h"
+
+#define HTTP_ASYNC_PRIORITY     (tskIDLE_PRIORITY + 5)  // Same as the httpd task
+
+// Original handler of a wrapped URI
+typedef struct {
+    esp_err_t (*handler)(httpd_req_t *req);
+    void *user_ctx;
+} async_uri_t;
+
+// Detached copy of a request waiting for a worker
+typedef struct {
+    httpd_req_t *req;
+    const async_uri_t *uri;
+} async_job_t;
+
+static const char *TAG = "http_async";
+static async_uri_t uris[HTTP_ASYNC_MAX_URIS];
+static int uri_count = 0;
+static QueueHandle_t jobs = NULL;
+static StaticQueue_t jobs_buffer;
+static uint8_t jobs_storage[HTTP_ASYNC_QUEUE_LEN * sizeof(async_job_t)];
+
+static void worker_task(void *arg)
+{
+    async_job_t job;
+
+    while (true) {
+        xQueueReceive(jobs, &job, portMAX_DELAY);
+        job.req->user_ctx = job.uri->user_ctx;
+        esp_err_t err = job.uri->handler(job.req);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "%s failed: %s", job.req->uri, esp_err_to_name(err));
+        }
+        httpd_req_async_handler_complete(job.req);
+    }
+}
+
+// Runs on the httpd task: detach the request and queue it
+static esp_err_t queue_handler(httpd_req_t *req)
+{
+    const async_uri_t *uri = req->user_ctx;
+
+    if (jobs == NULL) {
+        req->user_ctx = uri->user_ctx;
+        return uri->handler(req);
+    }
+
+    httpd_req_t *copy = NULL;
+    esp_err_t err = httpd_req_async_handler_begin(req, &copy);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Cannot detach %s: %s", req->uri, esp_err_to_name(err));
+        return err;
+    }
+
+    async_job_t job = {
+        .req = copy,
+        .uri = uri,
+    };
+    if (xQueueSend(jobs, &job, 0) != pdTRUE) {
+        httpd_req_async_handler_complete(copy);
+        ESP_LOGW(TAG, "All workers busy, rejecting %s", req->uri);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        return httpd_resp_sendstr(req, "Busy, try again");
+    }
+    return ESP_OK;
+}
+
+void http_async_wrap_uri(httpd_uri_t *uri)
+{
+    if (uri_count >= HTTP_ASYNC_MAX_URIS) {
+        ESP_LOGW(TAG, "No slot left for %s, handled on the httpd task", uri->uri);
+        return;
+    }
+
+    async_uri_t *a = &uris[uri_count++];
+    a->handler = uri->handler;
+    a->user_ctx = uri->user_ctx;
+    uri->handler = queue_handler;
+    uri->user_ctx = a;
+}
+
+esp_err_t http_async_start(int workers, uint32_t stack_size, int core_id)
+{
+    jobs = xQueueCreateStatic(HTTP_ASYNC_QUEUE_LEN, sizeof(async_job_t), jobs_storage, &jobs_buffer);
+
+    for (int i = 0; i < workers; i++) {
+        char name[configMAX_TASK_NAME_LEN];
+        snprintf(name, sizeof(name), "http_async%d", i);
+        if (xTaskCreatePinnedToCore(worker_task, name, stack_size, NULL,
+                                    HTTP_ASYNC_PRIORITY, NULL, core_id) != pdPASS) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    ESP_LOGI(TAG, "%d workers for slow handlers", workers);
+    return ESP_OK;
+}
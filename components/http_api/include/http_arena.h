@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_http_server.h"
+
+#define HTTP_ARENA_SIZE         2048    // Per task that runs handlers
+#define HTTP_ARENA_TASKS        5       // The httpd task and up to four async workers
+#define HTTP_ARENA_MAX_URIS     24
+
+// Scratch memory for building one response, carved from a static block
+// owned by the task running the handler, so requests never touch the heap.
+// 4-byte aligned. NULL when the block is full or outside a wrapped handler.
+void *http_arena_alloc(size_t size);
+
+// Give the block back once the handler has returned, i.e. after its
+// response has been sent. Rewrites handler and user_ctx in place. Must be
+// the innermost wrapper, so it runs on the task that runs the handler.
+void http_arena_wrap_uri(httpd_uri_t *uri);
+
+// Most arena bytes one request has used since boot, for sizing
+// HTTP_ARENA_SIZE
+uint32_t http_arena_get_peak(void);
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#define HTTP_ASYNC_MAX_URIS     8
+#define HTTP_ASYNC_QUEUE_LEN    8       // Requests waiting for a worker before 503
+
+// Start the worker tasks that run slow handlers off the httpd task
+esp_err_t http_async_start(int workers, uint32_t stack_size, int core_id);
+
+// Hand every request of a URI to a worker, so a slow client streaming a
+// large response does not hold up the other connections. Rewrites handler
+// and user_ctx in place. Must be the outermost wrapper of the URI.
+void http_async_wrap_uri(httpd_uri_t *uri);
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#define JSON_READER_MAX_DEPTH   8
+#define JSON_READER_KEY_LEN     24      // Longest member name, including the terminator
+#define JSON_READER_TOKEN_LEN   64      // Longest string or number value
+#define JSON_READER_CHUNK       128     // Stack buffer used to receive a request body
+
+typedef enum {
+    JSON_EVENT_OBJECT_START,
+    JSON_EVENT_OBJECT_END,
+    JSON_EVENT_ARRAY_START,
+    JSON_EVENT_ARRAY_END,
+    JSON_EVENT_STRING,
+    JSON_EVENT_NUMBER,
+    JSON_EVENT_BOOL,
+    JSON_EVENT_NULL,
+} json_event_type_t;
+
+// One value, or the start or end of a container. Strings are only valid
+// during the callback.
+typedef struct {
+    json_event_type_t type;
+    uint8_t depth;              // Containers around the value, 0 = top level
+    const char *key;            // Member name, NULL inside arrays and at the top
+    const char *parent;         // Member name of the enclosing container, if any
+    const char *str;            // JSON_EVENT_STRING
+    double number;              // JSON_EVENT_NUMBER
+    bool boolean;               // JSON_EVENT_BOOL
+} json_event_t;
+
+// Return anything but ESP_OK to stop parsing with that error
+typedef esp_err_t (*json_reader_cb_t)(const json_event_t *event, void *ctx);
+
+// Incremental tokenizer: bytes go in as they arrive, events come out as soon
+// as a value is complete. No tree is built and nothing is allocated.
+typedef struct {
+    json_reader_cb_t cb;
+    void *ctx;
+    uint8_t state;
+    uint8_t depth;
+    uint8_t escape;             // Position inside an escape sequence
+    bool token_is_key;
+    uint16_t objects;           // Bit n set: container n is an object
+    uint16_t unicode;
+    size_t token_len;
+    esp_err_t err;
+    char keys[JSON_READER_MAX_DEPTH][JSON_READER_KEY_LEN];
+    char token[JSON_READER_TOKEN_LEN];
+} json_reader_t;
+
+void json_reader_init(json_reader_t *r, json_reader_cb_t cb, void *ctx);
+
+// Parse the next piece of the document. ESP_ERR_INVALID_ARG on a syntax
+// error, ESP_ERR_INVALID_SIZE when a limit above is exceeded.
+esp_err_t json_reader_feed(json_reader_t *r, const char *data, size_t len);
+
+// End of input. Fails with ESP_ERR_INVALID_STATE if the document is incomplete.
+esp_err_t json_reader_finish(json_reader_t *r);
+
+// Receive a request body in JSON_READER_CHUNK pieces and parse it.
+// ESP_ERR_TIMEOUT if the client stops sending.
+esp_err_t json_reader_parse_request(json_reader_t *r, httpd_req_t *req);
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+// Nesting limit of objects and arrays
+#define JSON_WRITER_MAX_DEPTH   16
+
+// Streaming JSON encoder writing into a caller-provided buffer. Without a
+// request the buffer must hold the whole document; with one, a full buffer
+// is sent as an HTTP chunk and reused, so nothing is allocated either way.
+typedef struct {
+    httpd_req_t *req;
+    char *buf;
+    size_t size;
+    size_t len;                 // Bytes waiting in buf
+    size_t total;               // Bytes written overall
+    uint32_t first;             // Bit n set: next item at depth n is the first one
+    uint8_t depth;
+    bool chunked;               // Part of the response has already been sent
+    esp_err_t err;              // First error, later writes are ignored
+    uint32_t heap_start;        // Free heap when the response was started
+} json_writer_t;
+
+// Start a document. req may be NULL to only fill buf (e.g. for a push message).
+void json_writer_init(json_writer_t *w, httpd_req_t *req, char *buf, size_t size);
+
+// key is NULL inside arrays and for the top-level value
+void json_begin_object(json_writer_t *w, const char *key);
+void json_end_object(json_writer_t *w);
+void json_begin_array(json_writer_t *w, const char *key);
+void json_end_array(json_writer_t *w);
+
+void json_add_string(json_writer_t *w, const char *key, const char *value);
+void json_add_int(json_writer_t *w, const char *key, int64_t value);
+void json_add_bool(json_writer_t *w, const char *key, bool value);
+
+// Send what is left of the response, or NUL-terminate buf without a request.
+// Returns the first error, ESP_ERR_NO_MEM if buf was too small.
+esp_err_t json_writer_finish(json_writer_t *w);
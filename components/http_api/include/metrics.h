@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#define METRICS_MAX_ENDPOINTS   24
+#define METRICS_MAX_TASKS       8
+#define METRICS_MAX_GAUGES      16
+#define METRICS_BUCKETS         10      // Latency buckets, see metrics.c
+
+// Register a URI handler through the instrumentation layer. Latency,
+// request count, bytes sent and heap change are recorded for every call.
+esp_err_t metrics_register_uri(httpd_handle_t server, const httpd_uri_t *uri);
+
+// Same instrumentation for a URI registered by the caller; rewrites handler
+// and user_ctx in place
+void metrics_wrap_uri(httpd_uri_t *uri);
+
+// Application value sampled at scrape time
+typedef uint32_t (*metrics_gauge_fn_t)(void);
+
+// Report the stack high-water mark of a task, looked up by name at scrape time
+void metrics_watch_task(const char *name);
+
+// Export a gauge; name must follow Prometheus naming, e.g. "feeder_queue_depth"
+void metrics_add_gauge(const char *name, const char *help, metrics_gauge_fn_t read);
+
+// Add GET /metrics in Prometheus text format
+esp_err_t metrics_register(httpd_handle_t server);
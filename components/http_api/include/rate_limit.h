@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#define RATE_LIMIT_MAX_CLIENTS  8       // Addresses tracked at once
+
+// Token bucket, kept as the time it is full again (GCRA): up to burst
+// requests back to back, then one more per interval_ms. Start with tat_us 0.
+typedef struct {
+    uint32_t burst;
+    uint32_t interval_ms;
+    int64_t tat_us;
+} rate_bucket_t;
+
+typedef struct {
+    uint32_t addr;              // Folded peer address
+    int64_t seen_us;            // 0 for a free slot
+    int64_t tat_us;
+} rate_limit_client_t;
+
+// One bucket per client address, all with the same burst and interval. A
+// new client takes the slot of the one seen least recently. Not locked; use
+// it from one task, e.g. the httpd task.
+typedef struct {
+    uint32_t burst;
+    uint32_t interval_ms;
+    rate_limit_client_t clients[RATE_LIMIT_MAX_CLIENTS];
+} rate_limit_t;
+
+// Spend a token. Returns 0 if there was one, else the milliseconds until
+// the next one; nothing is spent then.
+uint32_t rate_bucket_take(rate_bucket_t *bucket);
+
+// Spend a token from the bucket of the client that sent req
+uint32_t rate_limit_take(rate_limit_t *limit, httpd_req_t *req);
+
+// What the take functions would return, without spending anything; to
+// check several buckets before taking from any of them
+uint32_t rate_bucket_wait(const rate_bucket_t *bucket);
+uint32_t rate_limit_wait(const rate_limit_t *limit, httpd_req_t *req);
+
+// 429 Too Many Requests with Retry-After in whole seconds
+esp_err_t rate_limit_send_429(httpd_req_t *req, uint32_t retry_ms, const char *message);
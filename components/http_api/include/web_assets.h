@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+// Static asset that was gzip-compressed at build time (see web/gen_asset.py)
+typedef struct {
+    const uint8_t *data;        // gzip stream
+    size_t len;                 // exact length of data
+    const char *etag;           // quoted strong ETag for the compressed bytes
+    const char *content_type;
+} web_asset_t;
+
+// Send an asset with Content-Encoding/ETag/Cache-Control headers, or an
+// empty 304 if the client's If-None-Match already matches
+esp_err_t web_asset_send(httpd_req_t *req, const web_asset_t *asset);
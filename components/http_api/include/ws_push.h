@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+// Largest text frame accepted from a client
+#define WS_PUSH_MAX_CMD_LEN     128
+
+// Broadcasts waiting for the httpd task, and the longest one
+#define WS_PUSH_POOL_LEN        6
+#define WS_PUSH_MAX_MSG_LEN     255
+
+// Called on the httpd task for every text frame received on /ws
+typedef void (*ws_push_cmd_cb_t)(httpd_req_t *req, const char *payload, size_t len);
+
+// Push to the clients of a running server, and describe its /ws endpoint
+// in uri. The caller registers it, so it can wrap the handler like any
+// other endpoint's.
+void ws_push_init(httpd_handle_t server, ws_push_cmd_cb_t on_cmd, httpd_uri_t *uri);
+
+// Send a text frame back to the client that issued the current command
+esp_err_t ws_push_reply(httpd_req_t *req, const char *msg);
+
+// Queue a text frame for every connected WebSocket client. Safe to call from
+// any task (timer callbacks included); the send happens on the httpd task.
+// The message is copied into a fixed pool and dropped when it is full.
+void ws_push_broadcast(const char *msg);
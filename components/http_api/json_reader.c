@@ -0,0 +1,333 @@
+#include <stdlib.h>
+#include <string.h>
+#include "json_reader.h"
+
+#define RECV_RETRIES    3
+
+enum {
+    ST_VALUE,                   // Any value
+    ST_VALUE_OR_END,            // First element or ']'
+    ST_KEY_OR_END,              // First member or '}'
+    ST_KEY,                     // Member name after ','
+    ST_COLON,
+    ST_COMMA_OR_END,
+    ST_STRING,
+    ST_NUMBER,
+    ST_LITERAL,
+    ST_DONE,
+};
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool in_object(const json_reader_t *r, int level)
+{
+    return level >= 0 && (r->objects & (1U << level));
+}
+
+static esp_err_t emit(json_reader_t *r, json_event_t *ev)
+{
+    int d = r->depth;
+
+    ev->depth = d;
+    ev->key = in_object(r, d - 1) ? r->keys[d - 1] : NULL;
+    ev->parent = in_object(r, d - 2) ? r->keys[d - 2] : NULL;
+    return r->cb(ev, r->ctx);
+}
+
+static esp_err_t emit_simple(json_reader_t *r, json_event_type_t type)
+{
+    json_event_t ev = { .type = type };
+    return emit(r, &ev);
+}
+
+static void after_value(json_reader_t *r)
+{
+    r->state = r->depth == 0 ? ST_DONE : ST_COMMA_OR_END;
+}
+
+static esp_err_t open_container(json_reader_t *r, bool object)
+{
+    esp_err_t err = emit_simple(r, object ? JSON_EVENT_OBJECT_START : JSON_EVENT_ARRAY_START);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (r->depth >= JSON_READER_MAX_DEPTH) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if (object) {
+        r->objects |= 1U << r->depth;
+        r->keys[r->depth][0] = '\0';
+    } else {
+        r->objects &= ~(1U << r->depth);
+    }
+    r->depth++;
+    r->state = object ? ST_KEY_OR_END : ST_VALUE_OR_END;
+    return ESP_OK;
+}
+
+static esp_err_t close_container(json_reader_t *r, char c)
+{
+    if (r->depth == 0 || in_object(r, r->depth - 1) != (c == '}')) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    r->depth--;
+    after_value(r);
+    return emit_simple(r, c == '}' ? JSON_EVENT_OBJECT_END : JSON_EVENT_ARRAY_END);
+}
+
+static esp_err_t add_token_char(json_reader_t *r, char c)
+{
+    size_t limit = r->token_is_key ? JSON_READER_KEY_LEN : JSON_READER_TOKEN_LEN;
+
+    if (r->token_len + 1 >= limit) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    r->token[r->token_len++] = c;
+    return ESP_OK;
+}
+
+static void start_token(json_reader_t *r, uint8_t state, bool is_key)
+{
+    r->state = state;
+    r->token_len = 0;
+    r->token_is_key = is_key;
+    r->escape = 0;
+}
+
+static esp_err_t value_start(json_reader_t *r, char c)
+{
+    if (c == '{' || c == '[') {
+        return open_container(r, c == '{');
+    } else if (c == '"') {
+        start_token(r, ST_STRING, false);
+        return ESP_OK;
+    } else if (c == '-' || (c >= '0' && c <= '9')) {
+        start_token(r, ST_NUMBER, false);
+        return add_token_char(r, c);
+    } else if (c == 't' || c == 'f' || c == 'n') {
+        start_token(r, ST_LITERAL, false);
+        return add_token_char(r, c);
+    }
+    return ESP_ERR_INVALID_ARG;
+}
+
+static esp_err_t end_string(json_reader_t *r)
+{
+    r->token[r->token_len] = '\0';
+
+    if (r->token_is_key) {
+        memcpy(r->keys[r->depth - 1], r->token, r->token_len + 1);
+        r->state = ST_COLON;
+        return ESP_OK;
+    }
+
+    json_event_t ev = { .type = JSON_EVENT_STRING, .str = r->token };
+    after_value(r);
+    return emit(r, &ev);
+}
+
+// Backslash sequences. Only the ASCII range of \u escapes is kept.
+static esp_err_t string_escape(json_reader_t *r, char c)
+{
+    if (r->escape == 1) {
+        static const char from[] = "\"\\/bfnrt";
+        static const char to[] = "\"\\/\b\f\n\r\t";
+        const char *p = strchr(from, c);
+
+        if (c == 'u') {
+            r->escape = 2;
+            r->unicode = 0;
+            return ESP_OK;
+        }
+        r->escape = 0;
+        return p != NULL && c != '\0' ? add_token_char(r, to[p - from]) : ESP_ERR_INVALID_ARG;
+    }
+
+    int digit;
+    if (c >= '0' && c <= '9') {
+        digit = c - '0';
+    } else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+        digit = (c | 0x20) - 'a' + 10;
+    } else {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    r->unicode = (r->unicode << 4) | digit;
+    if (++r->escape < 6) {
+        return ESP_OK;
+    }
+    r->escape = 0;
+    return add_token_char(r, r->unicode < 0x80 ? (char)r->unicode : '?');
+}
+
+static esp_err_t end_number(json_reader_t *r)
+{
+    char *end;
+
+    r->token[r->token_len] = '\0';
+    json_event_t ev = { .type = JSON_EVENT_NUMBER, .number = strtod(r->token, &end) };
+    if (*end != '\0') {
+        return ESP_ERR_INVALID_ARG;
+    }
+    after_value(r);
+    return emit(r, &ev);
+}
+
+static esp_err_t end_literal(json_reader_t *r)
+{
+    json_event_t ev = { 0 };
+
+    r->token[r->token_len] = '\0';
+    if (strcmp(r->token, "true") == 0 || strcmp(r->token, "false") == 0) {
+        ev.type = JSON_EVENT_BOOL;
+        ev.boolean = r->token[0] == 't';
+    } else if (strcmp(r->token, "null") == 0) {
+        ev.type = JSON_EVENT_NULL;
+    } else {
+        return ESP_ERR_INVALID_ARG;
+    }
+    after_value(r);
+    return emit(r, &ev);
+}
+
+static esp_err_t step(json_reader_t *r, char c)
+{
+    switch (r->state) {
+    case ST_STRING:
+        if (r->escape != 0) {
+            return string_escape(r, c);
+        } else if (c == '\\') {
+            r->escape = 1;
+            return ESP_OK;
+        } else if (c == '"') {
+            return end_string(r);
+        } else if ((unsigned char)c < 0x20) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        return add_token_char(r, c);
+
+    case ST_NUMBER:
+        if ((c >= '0' && c <= '9') || c == '.' || c == '-' || c == '+' || c == 'e' || c == 'E') {
+            return add_token_char(r, c);
+        }
+        break;
+
+    case ST_LITERAL:
+        if (c >= 'a' && c <= 'z') {
+            return add_token_char(r, c);
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    // A number or literal ends at the first character that is not part of it
+    if (r->state == ST_NUMBER || r->state == ST_LITERAL) {
+        esp_err_t err = r->state == ST_NUMBER ? end_number(r) : end_literal(r);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    if (is_space(c)) {
+        return ESP_OK;
+    }
+
+    switch (r->state) {
+    case ST_VALUE:
+        return value_start(r, c);
+    case ST_VALUE_OR_END:
+        return c == ']' ? close_container(r, c) : value_start(r, c);
+    case ST_KEY_OR_END:
+        if (c == '}') {
+            return close_container(r, c);
+        }
+        /* fall through */
+    case ST_KEY:
+        if (c != '"') {
+            return ESP_ERR_INVALID_ARG;
+        }
+        start_token(r, ST_STRING, true);
+        return ESP_OK;
+    case ST_COLON:
+        if (c != ':') {
+            return ESP_ERR_INVALID_ARG;
+        }
+        r->state = ST_VALUE;
+        return ESP_OK;
+    case ST_COMMA_OR_END:
+        if (c == ',') {
+            r->state = in_object(r, r->depth - 1) ? ST_KEY : ST_VALUE;
+            return ESP_OK;
+        }
+        return close_container(r, c);
+    default:
+        return ESP_ERR_INVALID_ARG;     // Trailing data after the document
+    }
+}
+
+void json_reader_init(json_reader_t *r, json_reader_cb_t cb, void *ctx)
+{
+    memset(r, 0, sizeof(*r));
+    r->cb = cb;
+    r->ctx = ctx;
+    r->state = ST_VALUE;
+}
+
+esp_err_t json_reader_feed(json_reader_t *r, const char *data, size_t len)
+{
+    for (size_t i = 0; i < len && r->err == ESP_OK; i++) {
+        r->err = step(r, data[i]);
+    }
+    return r->err;
+}
+
+esp_err_t json_reader_finish(json_reader_t *r)
+{
+    if (r->err != ESP_OK) {
+        return r->err;
+    }
+
+    // A bare top-level number or literal has no terminating character
+    if (r->state == ST_NUMBER) {
+        r->err = end_number(r);
+    } else if (r->state == ST_LITERAL) {
+        r->err = end_literal(r);
+    }
+    if (r->err == ESP_OK && r->state != ST_DONE) {
+        r->err = ESP_ERR_INVALID_STATE;
+    }
+    return r->err;
+}
+
+esp_err_t json_reader_parse_request(json_reader_t *r, httpd_req_t *req)
+{
+    char chunk[JSON_READER_CHUNK];
+    size_t remaining = req->content_len;
+    int retries = 0;
+
+    while (remaining > 0) {
+        int ret = httpd_req_recv(req, chunk, remaining < sizeof(chunk) ? remaining : sizeof(chunk));
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT && ++retries <= RECV_RETRIES) {
+            continue;
+        } else if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+            return ESP_ERR_TIMEOUT;
+        } else if (ret <= 0) {
+            return ESP_FAIL;
+        }
+
+        retries = 0;
+        remaining -= ret;
+        esp_err_t err = json_reader_feed(r, chunk, ret);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return json_reader_finish(r);
+}
@@ -0,0 +1,205 @@
+#include <string.h>
+#include "esp_log.h"
+#include "esp_system.h"
+#include "json_writer.h"
+
+static const char *TAG = "json_writer";
+
+// Hand a full buffer to the HTTP server and start over
+static void flush(json_writer_t *w)
+{
+    if (w->len == 0 || w->err != ESP_OK) {
+        return;
+    }
+
+    w->err = httpd_resp_send_chunk(w->req, w->buf, w->len);
+    w->chunked = true;
+    w->len = 0;
+}
+
+static void put(json_writer_t *w, const char *s, size_t n)
+{
+    while (n > 0 && w->err == ESP_OK) {
+        size_t space = w->size - 1 - w->len;    // Keep room for the terminator
+
+        if (space == 0) {
+            if (w->req == NULL) {
+                w->err = ESP_ERR_NO_MEM;
+                return;
+            }
+            flush(w);
+            continue;
+        }
+
+        size_t part = n < space ? n : space;
+        memcpy(w->buf + w->len, s, part);
+        w->len += part;
+        w->total += part;
+        s += part;
+        n -= part;
+    }
+}
+
+static void put_char(json_writer_t *w, char c)
+{
+    put(w, &c, 1);
+}
+
+static void put_quoted(json_writer_t *w, const char *s)
+{
+    static const char hex[] = "0123456789abcdef";
+    const char *run = s;
+
+    put_char(w, '"');
+    for (; *s != '\0'; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+
+        // Copy the plain run before the character that needs escaping
+        put(w, run, s - run);
+        run = s + 1;
+        if (c == '"' || c == '\\') {
+            char esc[2] = { '\\', c };
+            put(w, esc, sizeof(esc));
+        } else {
+            char esc[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF] };
+            put(w, esc, sizeof(esc));
+        }
+    }
+    put(w, run, s - run);
+    put_char(w, '"');
+}
+
+// Separator and key in front of every value
+static void begin_value(json_writer_t *w, const char *key)
+{
+    uint32_t bit = 1UL << w->depth;
+
+    if (w->first & bit) {
+        w->first &= ~bit;
+    } else {
+        put_char(w, ',');
+    }
+
+    if (key != NULL) {
+        put_quoted(w, key);
+        put_char(w, ':');
+    }
+}
+
+static void open_container(json_writer_t *w, const char *key, char c)
+{
+    begin_value(w, key);
+    put_char(w, c);
+
+    if (w->depth + 1 >= JSON_WRITER_MAX_DEPTH) {
+        w->err = ESP_ERR_INVALID_STATE;
+        return;
+    }
+    w->depth++;
+    w->first |= 1UL << w->depth;
+}
+
+static void close_container(json_writer_t *w, char c)
+{
+    if (w->depth == 0) {
+        w->err = ESP_ERR_INVALID_STATE;
+        return;
+    }
+    w->depth--;
+    put_char(w, c);
+}
+
+void json_writer_init(json_writer_t *w, httpd_req_t *req, char *buf, size_t size)
+{
+    memset(w, 0, sizeof(*w));
+    w->req = req;
+    w->buf = buf;
+    w->size = size;
+    w->first = 1;
+    w->heap_start = esp_get_free_heap_size();
+
+    if (req != NULL) {
+        httpd_resp_set_type(req, "application/json");
+    }
+}
+
+void json_begin_object(json_writer_t *w, const char *key)
+{
+    open_container(w, key, '{');
+}
+
+void json_end_object(json_writer_t *w)
+{
+    close_container(w, '}');
+}
+
+void json_begin_array(json_writer_t *w, const char *key)
+{
+    open_container(w, key, '[');
+}
+
+void json_end_array(json_writer_t *w)
+{
+    close_container(w, ']');
+}
+
+void json_add_string(json_writer_t *w, const char *key, const char *value)
+{
+    begin_value(w, key);
+    put_quoted(w, value != NULL ? value : "");
+}
+
+void json_add_int(json_writer_t *w, const char *key, int64_t value)
+{
+    char digits[21];
+    char *p = digits + sizeof(digits);
+    uint64_t v = value < 0 ? -(uint64_t)value : (uint64_t)value;
+
+    do {
+        *--p = '0' + v % 10;
+        v /= 10;
+    } while (v != 0);
+    if (value < 0) {
+        *--p = '-';
+    }
+
+    begin_value(w, key);
+    put(w, p, digits + sizeof(digits) - p);
+}
+
+void json_add_bool(json_writer_t *w, const char *key, bool value)
+{
+    begin_value(w, key);
+    put(w, value ? "true" : "false", value ? 4 : 5);
+}
+
+esp_err_t json_writer_finish(json_writer_t *w)
+{
+    if (w->err == ESP_OK && w->depth != 0) {
+        w->err = ESP_ERR_INVALID_STATE;
+    }
+    w->buf[w->len] = '\0';
+
+    if (w->req == NULL) {
+        return w->err;
+    }
+
+    // Short documents go out in one send with a Content-Length
+    if (!w->chunked && w->err == ESP_OK) {
+        w->err = httpd_resp_send(w->req, w->buf, w->len);
+    } else if (!w->chunked) {
+        httpd_resp_send_500(w->req);
+    } else {
+        flush(w);
+        httpd_resp_send_chunk(w->req, NULL, 0);
+    }
+
+    // Every JSON response passes here; a line per request is for debugging
+    uint32_t heap_now = esp_get_free_heap_size();
+    ESP_LOGD(TAG, "%s: %u bytes%s, free heap %lu (%+ld)", w->req->uri, (unsigned)w->total,
+             w->chunked ? " chunked" : "", (unsigned long)heap_now, (long)heap_now - (long)w->heap_start);
+    return w->err;
+}
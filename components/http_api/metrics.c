@@ -0,0 +1,325 @@
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "sdkconfig.h"
+#include "metrics.h"
+
+#define METRICS_OUT_BUF     512
+
+// One instrumented URI handler. Handlers run on the httpd task or, for slow
+// URIs, on the async workers, so the counters are updated under a spinlock.
+typedef struct {
+    const char *uri;
+    httpd_method_t method;
+    esp_err_t (*handler)(httpd_req_t *req);
+    void *user_ctx;
+    uint32_t count;
+    uint32_t errors;
+    uint32_t buckets[METRICS_BUCKETS];      // Per bucket, summed up when exported
+    uint64_t total_us;
+    uint32_t max_us;
+    uint64_t bytes_sent;
+    int32_t heap_delta;                     // Free heap lost by the last request
+} endpoint_t;
+
+// Prometheus text output, sent in chunks
+typedef struct {
+    httpd_req_t *req;
+    size_t len;
+    char buf[METRICS_OUT_BUF];
+} out_t;
+
+static const char *TAG = "metrics";
+
+// Upper bounds of the latency buckets
+static const uint32_t bucket_us[METRICS_BUCKETS] = {
+    1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000,
+};
+
+static endpoint_t endpoints[METRICS_MAX_ENDPOINTS];
+static int endpoint_count = 0;
+static const char *tasks[METRICS_MAX_TASKS];
+static int task_count = 0;
+static struct {
+    const char *name;
+    const char *help;
+    metrics_gauge_fn_t read;
+} gauges[METRICS_MAX_GAUGES];
+static int gauge_count = 0;
+static portMUX_TYPE counters_lock = portMUX_INITIALIZER_UNLOCKED;
+static volatile uint32_t alloc_failures = 0;
+// Endpoint whose response is being sent, by socket; a socket serves one
+// request at a time
+static endpoint_t *sending[CONFIG_LWIP_MAX_SOCKETS];
+
+static endpoint_t **sending_slot(int sockfd)
+{
+    int i = sockfd - LWIP_SOCKET_OFFSET;
+    return i >= 0 && i < CONFIG_LWIP_MAX_SOCKETS ? &sending[i] : NULL;
+}
+
+// Session send function that counts the bytes of the current response
+static int counting_send(httpd_handle_t hd, int sockfd, const char *buf, size_t buf_len, int flags)
+{
+    int ret = send(sockfd, buf, buf_len, flags);
+    if (ret < 0) {
+        return errno == EAGAIN || errno == EINTR ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+    }
+
+    endpoint_t **slot = sending_slot(sockfd);
+    if (slot != NULL && *slot != NULL) {
+        portENTER_CRITICAL(&counters_lock);
+        (*slot)->bytes_sent += ret;
+        portEXIT_CRITICAL(&counters_lock);
+    }
+    return ret;
+}
+
+// Runs in place of every registered handler
+static esp_err_t instrumented_handler(httpd_req_t *req)
+{
+    endpoint_t *ep = req->user_ctx;
+    uint32_t heap_before = esp_get_free_heap_size();
+    int64_t start = esp_timer_get_time();
+
+    int sockfd = httpd_req_to_sockfd(req);
+    endpoint_t **slot = sending_slot(sockfd);
+
+    httpd_sess_set_send_override(req->handle, sockfd, counting_send);
+    if (slot != NULL) {
+        *slot = ep;
+    }
+    req->user_ctx = ep->user_ctx;
+    esp_err_t err = ep->handler(req);
+    if (slot != NULL) {
+        *slot = NULL;
+    }
+
+    uint32_t us = esp_timer_get_time() - start;
+    int32_t heap_delta = (int32_t)heap_before - (int32_t)esp_get_free_heap_size();
+    int b = 0;
+    while (b < METRICS_BUCKETS && us > bucket_us[b]) {
+        b++;
+    }
+
+    portENTER_CRITICAL(&counters_lock);
+    if (b < METRICS_BUCKETS) {
+        ep->buckets[b]++;
+    }
+    ep->count++;
+    ep->errors += err != ESP_OK;
+    ep->total_us += us;
+    if (us > ep->max_us) {
+        ep->max_us = us;
+    }
+    ep->heap_delta = heap_delta;
+    portEXIT_CRITICAL(&counters_lock);
+    return err;
+}
+
+void metrics_wrap_uri(httpd_uri_t *uri)
+{
+    if (endpoint_count >= METRICS_MAX_ENDPOINTS) {
+        ESP_LOGW(TAG, "No slot left for %s, registered without metrics", uri->uri);
+        return;
+    }
+
+    endpoint_t *ep = &endpoints[endpoint_count++];
+    ep->uri = uri->uri;
+    ep->method = uri->method;
+    ep->handler = uri->handler;
+    ep->user_ctx = uri->user_ctx;
+    uri->handler = instrumented_handler;
+    uri->user_ctx = ep;
+}
+
+esp_err_t metrics_register_uri(httpd_handle_t server, const httpd_uri_t *uri)
+{
+    httpd_uri_t wrapped = *uri;
+
+    metrics_wrap_uri(&wrapped);
+    return httpd_register_uri_handler(server, &wrapped);
+}
+
+void metrics_watch_task(const char *name)
+{
+    if (task_count < METRICS_MAX_TASKS) {
+        tasks[task_count++] = name;
+    }
+}
+
+void metrics_add_gauge(const char *name, const char *help, metrics_gauge_fn_t read)
+{
+    if (gauge_count < METRICS_MAX_GAUGES) {
+        gauges[gauge_count].name = name;
+        gauges[gauge_count].help = help;
+        gauges[gauge_count].read = read;
+        gauge_count++;
+    }
+}
+
+static void out_flush(out_t *o)
+{
+    if (o->len > 0) {
+        httpd_resp_send_chunk(o->req, o->buf, o->len);
+        o->len = 0;
+    }
+}
+
+static void out_printf(out_t *o, const char *fmt, ...)
+{
+    va_list args;
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        va_start(args, fmt);
+        int n = vsnprintf(o->buf + o->len, sizeof(o->buf) - o->len, fmt, args);
+        va_end(args);
+
+        if (n >= 0 && (size_t)n < sizeof(o->buf) - o->len) {
+            o->len += n;
+            return;
+        }
+        out_flush(o);       // Did not fit, retry in an empty buffer
+    }
+}
+
+static void out_header(out_t *o, const char *name, const char *type, const char *help)
+{
+    out_printf(o, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+// Microseconds as seconds without going through floating point
+static void out_seconds(out_t *o, uint64_t us)
+{
+    out_printf(o, "%llu.%06llu\n", us / 1000000, us % 1000000);
+}
+
+static void out_labels(out_t *o, const char *name, const endpoint_t *ep)
+{
+    out_printf(o, "%s{method=\"%s\",uri=\"%s\"} ", name, http_method_str(ep->method), ep->uri);
+}
+
+static void write_endpoints(out_t *o)
+{
+    out_header(o, "feeder_http_requests_total", "counter", "Requests handled per endpoint");
+    for (int i = 0; i < endpoint_count; i++) {
+        out_labels(o, "feeder_http_requests_total", &endpoints[i]);
+        out_printf(o, "%lu\n", (unsigned long)endpoints[i].count);
+    }
+
+    out_header(o, "feeder_http_request_errors_total", "counter", "Requests whose handler failed");
+    for (int i = 0; i < endpoint_count; i++) {
+        out_labels(o, "feeder_http_request_errors_total", &endpoints[i]);
+        out_printf(o, "%lu\n", (unsigned long)endpoints[i].errors);
+    }
+
+    out_header(o, "feeder_http_request_duration_seconds", "histogram", "Handler latency");
+    for (int i = 0; i < endpoint_count; i++) {
+        const endpoint_t *ep = &endpoints[i];
+        const char *method = http_method_str(ep->method);
+        uint32_t cumulative = 0;
+
+        for (int b = 0; b < METRICS_BUCKETS; b++) {
+            cumulative += ep->buckets[b];
+            out_printf(o, "feeder_http_request_duration_seconds_bucket{method=\"%s\",uri=\"%s\",le=\"%lu.%06lu\"} %lu\n",
+                       method, ep->uri, (unsigned long)(bucket_us[b] / 1000000),
+                       (unsigned long)(bucket_us[b] % 1000000), (unsigned long)cumulative);
+        }
+        out_printf(o, "feeder_http_request_duration_seconds_bucket{method=\"%s\",uri=\"%s\",le=\"+Inf\"} %lu\n",
+                   method, ep->uri, (unsigned long)ep->count);
+        out_labels(o, "feeder_http_request_duration_seconds_sum", ep);
+        out_seconds(o, ep->total_us);
+        out_labels(o, "feeder_http_request_duration_seconds_count", ep);
+        out_printf(o, "%lu\n", (unsigned long)ep->count);
+    }
+
+    out_header(o, "feeder_http_request_duration_max_seconds", "gauge", "Slowest request since boot");
+    for (int i = 0; i < endpoint_count; i++) {
+        out_labels(o, "feeder_http_request_duration_max_seconds", &endpoints[i]);
+        out_seconds(o, endpoints[i].max_us);
+    }
+
+    out_header(o, "feeder_http_response_bytes_total", "counter", "Bytes sent, headers included");
+    for (int i = 0; i < endpoint_count; i++) {
+        out_labels(o, "feeder_http_response_bytes_total", &endpoints[i]);
+        out_printf(o, "%llu\n", endpoints[i].bytes_sent);
+    }
+
+    out_header(o, "feeder_http_request_heap_bytes", "gauge", "Free heap consumed by the last request");
+    for (int i = 0; i < endpoint_count; i++) {
+        out_labels(o, "feeder_http_request_heap_bytes", &endpoints[i]);
+        out_printf(o, "%ld\n", (long)endpoints[i].heap_delta);
+    }
+}
+
+// Called by the heap before any allocation returns NULL, on whatever task
+static void alloc_failed(size_t size, uint32_t caps, const char *function_name)
+{
+    alloc_failures++;
+}
+
+static void write_system(out_t *o)
+{
+    out_header(o, "feeder_uptime_seconds", "counter", "Time since boot");
+    out_printf(o, "feeder_uptime_seconds ");
+    out_seconds(o, esp_timer_get_time());
+
+    out_header(o, "feeder_heap_free_bytes", "gauge", "Free heap");
+    out_printf(o, "feeder_heap_free_bytes %lu\n", (unsigned long)esp_get_free_heap_size());
+    out_header(o, "feeder_heap_min_free_bytes", "gauge", "Lowest free heap since boot");
+    out_printf(o, "feeder_heap_min_free_bytes %lu\n", (unsigned long)esp_get_minimum_free_heap_size());
+    out_header(o, "feeder_heap_largest_block_bytes", "gauge", "Largest allocatable block");
+    out_printf(o, "feeder_heap_largest_block_bytes %lu\n",
+               (unsigned long)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+    out_header(o, "feeder_heap_alloc_failures_total", "counter", "Allocations refused since boot");
+    out_printf(o, "feeder_heap_alloc_failures_total %lu\n", (unsigned long)alloc_failures);
+
+    for (int i = 0; i < gauge_count; i++) {
+        out_header(o, gauges[i].name, "gauge", gauges[i].help);
+        out_printf(o, "%s %lu\n", gauges[i].name, (unsigned long)gauges[i].read());
+    }
+
+    // Stack sizes are in bytes on ESP-IDF, and so is the high-water mark
+    out_header(o, "feeder_task_stack_free_bytes", "gauge", "Stack never used by the task");
+    out_printf(o, "feeder_task_stack_free_bytes{task=\"%s\"} %lu\n", pcTaskGetName(NULL),
+               (unsigned long)uxTaskGetStackHighWaterMark(NULL));
+    for (int i = 0; i < task_count; i++) {
+        TaskHandle_t task = xTaskGetHandle(tasks[i]);
+        if (task != NULL) {
+            out_printf(o, "feeder_task_stack_free_bytes{task=\"%s\"} %lu\n", tasks[i],
+                       (unsigned long)uxTaskGetStackHighWaterMark(task));
+        }
+    }
+}
+
+static esp_err_t metrics_handler(httpd_req_t *req)
+{
+    out_t o = { .req = req };
+
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    write_endpoints(&o);
+    write_system(&o);
+    out_flush(&o);
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+esp_err_t metrics_register(httpd_handle_t server)
+{
+    httpd_uri_t metrics = {
+        .uri        = "/metrics",
+        .method     = HTTP_GET,
+        .handler    = metrics_handler,
+        .user_ctx   = NULL
+    };
+
+    heap_caps_register_failed_alloc_callback(alloc_failed);
+    return httpd_register_uri_handler(server, &metrics);
+}
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <string.h>
+#include "lwip/sockets.h"
+#include "esp_timer.h"
+#include "rate_limit.h"
+
+// Milliseconds until a bucket described by its full time has a token, and
+// its full time once one is spent; shared by both kinds
+static uint32_t wait(int64_t tat_us, uint32_t burst, uint32_t interval_ms, int64_t now_us, int64_t *next_tat)
+{
+    int64_t interval_us = (int64_t)interval_ms * 1000;
+    int64_t tat = (tat_us > now_us ? tat_us : now_us) + interval_us;
+    int64_t early_us = tat - now_us - (int64_t)burst * interval_us;
+
+    *next_tat = tat;
+    return early_us > 0 ? (early_us + 999) / 1000 : 0;
+}
+
+static uint32_t take(int64_t *tat_us, uint32_t burst, uint32_t interval_ms, int64_t now_us)
+{
+    int64_t tat;
+    uint32_t retry_ms = wait(*tat_us, burst, interval_ms, now_us, &tat);
+
+    if (retry_ms == 0) {
+        *tat_us = tat;
+    }
+    return retry_ms;
+}
+
+uint32_t rate_bucket_take(rate_bucket_t *bucket)
+{
+    return take(&bucket->tat_us, bucket->burst, bucket->interval_ms, esp_timer_get_time());
+}
+
+uint32_t rate_bucket_wait(const rate_bucket_t *bucket)
+{
+    int64_t tat;
+    return wait(bucket->tat_us, bucket->burst, bucket->interval_ms, esp_timer_get_time(), &tat);
+}
+
+// IPv4 address, or an IPv6 one folded to 32 bits; 0 if the socket is gone
+static uint32_t peer_addr(httpd_req_t *req)
+{
+    struct sockaddr_storage addr;
+    socklen_t len = sizeof(addr);
+    uint32_t words[4];
+
+    if (getpeername(httpd_req_to_sockfd(req), (struct sockaddr *)&addr, &len) != 0) {
+        return 0;
+    }
+    if (addr.ss_family == AF_INET) {
+        return ((struct sockaddr_in *)&addr)->sin_addr.s_addr;
+    }
+    // An IPv4-mapped address keeps its IPv4 part in the last word
+    memcpy(words, &((struct sockaddr_in6 *)&addr)->sin6_addr, sizeof(words));
+    return words[0] == 0 && words[1] == 0 ? words[3] : words[0] ^ words[1] ^ words[2] ^ words[3];
+}
+
+uint32_t rate_limit_take(rate_limit_t *limit, httpd_req_t *req)
+{
+    uint32_t addr = peer_addr(req);
+    int64_t now = esp_timer_get_time();
+    rate_limit_client_t *client = &limit->clients[0];
+
+    for (int i = 0; i < RATE_LIMIT_MAX_CLIENTS; i++) {
+        rate_limit_client_t *c = &limit->clients[i];
+        if (c->seen_us != 0 && c->addr == addr) {
+            client = c;
+            break;
+        }
+        if (c->seen_us < client->seen_us) {
+            client = c;
+        }
+    }
+    if (client->seen_us == 0 || client->addr != addr) {
+        *client = (rate_limit_client_t) { .addr = addr };
+    }
+    client->seen_us = now;
+    return take(&client->tat_us, limit->burst, limit->interval_ms, now);
+}
+
+uint32_t rate_limit_wait(const rate_limit_t *limit, httpd_req_t *req)
+{
+    uint32_t addr = peer_addr(req);
+    int64_t tat;
+
+    for (int i = 0; i < RATE_LIMIT_MAX_CLIENTS; i++) {
+        const rate_limit_client_t *c = &limit->clients[i];
+        if (c->seen_us != 0 && c->addr == addr) {
+            return wait(c->tat_us, limit->burst, limit->interval_ms, esp_timer_get_time(), &tat);
+        }
+    }
+    return 0;                   // Unknown client; it starts with a full bucket
+}
+
+esp_err_t rate_limit_send_429(httpd_req_t *req, uint32_t retry_ms, const char *message)
+{
+    char retry[12];
+    snprintf(retry, sizeof(retry), "%lu", (unsigned long)((retry_ms + 999) / 1000));
+    httpd_resp_set_status(req, "429 Too Many Requests");
+    httpd_resp_set_hdr(req, "Retry-After", retry);
+    httpd_resp_set_type(req, "text/plain");
+    return httpd_resp_sendstr(req, message);
+}
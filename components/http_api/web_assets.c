@@ -0,0 +1,41 @@
+#include <string.h>
+#include "esp_log.h"
+#include "web_assets.h"
+
+// Browsers revalidate on every load, but an unchanged page costs one 304
+#define WEB_ASSET_CACHE_CONTROL "no-cache"
+
+static const char *TAG = "web_assets";
+
+// Check whether the request's If-None-Match header lists this ETag
+static bool etag_matches(httpd_req_t *req, const web_asset_t *asset)
+{
+    char buf[64];
+    size_t len = httpd_req_get_hdr_value_len(req, "If-None-Match");
+
+    if (len == 0 || len >= sizeof(buf)) {
+        return false;
+    }
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", buf, sizeof(buf)) != ESP_OK) {
+        return false;
+    }
+
+    return strcmp(buf, "*") == 0 || strstr(buf, asset->etag) != NULL;
+}
+
+esp_err_t web_asset_send(httpd_req_t *req, const web_asset_t *asset)
+{
+    httpd_resp_set_hdr(req, "ETag", asset->etag);
+    httpd_resp_set_hdr(req, "Cache-Control", WEB_ASSET_CACHE_CONTROL);
+
+    if (etag_matches(req, asset)) {
+        ESP_LOGD(TAG, "%s not modified", req->uri);
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    // Every browser we target accepts gzip, so no identity fallback is kept
+    httpd_resp_set_type(req, asset->content_type);
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    return httpd_resp_send(req, (const char *)asset->data, asset->len);
+}
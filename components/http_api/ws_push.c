@@ -0,0 +1,151 @@
+#include <stdbool.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "ws_push.h"
+
+static const char *TAG = "ws_push";
+static httpd_handle_t ws_server = NULL;
+static ws_push_cmd_cb_t ws_cmd_cb = NULL;
+
+// Pending broadcast, released by the httpd task once it has been sent
+typedef struct {
+    bool used;
+    size_t len;
+    char msg[WS_PUSH_MAX_MSG_LEN + 1];
+} ws_push_msg_t;
+
+static ws_push_msg_t pool[WS_PUSH_POOL_LEN];
+static portMUX_TYPE pool_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static ws_push_msg_t *pool_take(void)
+{
+    ws_push_msg_t *m = NULL;
+
+    portENTER_CRITICAL(&pool_lock);
+    for (int i = 0; i < WS_PUSH_POOL_LEN && m == NULL; i++) {
+        if (!pool[i].used) {
+            m = &pool[i];
+            m->used = true;
+        }
+    }
+    portEXIT_CRITICAL(&pool_lock);
+    return m;
+}
+
+static void pool_release(ws_push_msg_t *m)
+{
+    portENTER_CRITICAL(&pool_lock);
+    m->used = false;
+    portEXIT_CRITICAL(&pool_lock);
+}
+
+// Runs on the httpd task: fan a message out to every WebSocket session
+static void ws_broadcast_work(void *arg)
+{
+    ws_push_msg_t *m = arg;
+    size_t fds = CONFIG_LWIP_MAX_SOCKETS;
+    int client_fds[CONFIG_LWIP_MAX_SOCKETS];
+
+    if (httpd_get_client_list(ws_server, &fds, client_fds) == ESP_OK) {
+        httpd_ws_frame_t frame = {
+            .type    = HTTPD_WS_TYPE_TEXT,
+            .payload = (uint8_t *)m->msg,
+            .len     = m->len,
+        };
+
+        for (size_t i = 0; i < fds; i++) {
+            if (httpd_ws_get_fd_info(ws_server, client_fds[i]) == HTTPD_WS_CLIENT_WEBSOCKET) {
+                httpd_ws_send_frame_async(ws_server, client_fds[i], &frame);
+            }
+        }
+    }
+
+    pool_release(m);
+}
+
+void ws_push_broadcast(const char *msg)
+{
+    if (ws_server == NULL) {
+        return;
+    }
+
+    size_t len = strlen(msg);
+    if (len > WS_PUSH_MAX_MSG_LEN) {
+        ESP_LOGW(TAG, "Dropping push of %u bytes, too long", (unsigned)len);
+        return;
+    }
+    ws_push_msg_t *m = pool_take();
+    if (m == NULL) {
+        ESP_LOGW(TAG, "Dropping push, %d already waiting", WS_PUSH_POOL_LEN);
+        return;
+    }
+    m->len = len;
+    memcpy(m->msg, msg, len + 1);
+
+    if (httpd_queue_work(ws_server, ws_broadcast_work, m) != ESP_OK) {
+        pool_release(m);
+    }
+}
+
+esp_err_t ws_push_reply(httpd_req_t *req, const char *msg)
+{
+    httpd_ws_frame_t frame = {
+        .type    = HTTPD_WS_TYPE_TEXT,
+        .payload = (uint8_t *)msg,
+        .len     = strlen(msg),
+    };
+
+    return httpd_ws_send_frame(req, &frame);
+}
+
+// /ws handler - the GET is the upgrade handshake, later calls carry frames
+static esp_err_t ws_handler(httpd_req_t *req)
+{
+    if (req->method == HTTP_GET) {
+        ESP_LOGI(TAG, "WebSocket client connected (fd %d)", httpd_req_to_sockfd(req));
+        return ESP_OK;
+    }
+
+    char buf[WS_PUSH_MAX_CMD_LEN + 1];
+    httpd_ws_frame_t frame = {
+        .type    = HTTPD_WS_TYPE_TEXT,
+        .payload = (uint8_t *)buf,
+    };
+
+    // Read the header first so oversized frames can be refused
+    esp_err_t ret = httpd_ws_recv_frame(req, &frame, 0);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (frame.len > WS_PUSH_MAX_CMD_LEN) {
+        ESP_LOGW(TAG, "Frame of %u bytes too large", (unsigned)frame.len);
+        return ESP_FAIL;
+    }
+
+    ret = httpd_ws_recv_frame(req, &frame, WS_PUSH_MAX_CMD_LEN);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    buf[frame.len] = '\0';
+
+    if (frame.type == HTTPD_WS_TYPE_TEXT && ws_cmd_cb != NULL) {
+        ws_cmd_cb(req, buf, frame.len);
+    }
+
+    return ESP_OK;
+}
+
+void ws_push_init(httpd_handle_t server, ws_push_cmd_cb_t on_cmd, httpd_uri_t *uri)
+{
+    *uri = (httpd_uri_t) {
+        .uri          = "/ws",
+        .method       = HTTP_GET,
+        .handler      = ws_handler,
+        .user_ctx     = NULL,
+        .is_websocket = true
+    };
+
+    ws_server = server;
+    ws_cmd_cb = on_cmd;
+}
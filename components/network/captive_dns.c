@@ -0,0 +1,128 @@
+#include <errno.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "lwip/sockets.h"
+#include "captive_dns.h"
+
+#define DNS_PORT            53
+#define DNS_MAX_LEN         512
+#define DNS_HEADER_LEN      12
+#define DNS_ANSWER_LEN      16
+#define DNS_TTL_S           60
+#define DNS_TASK_STACK      3072
+#define DNS_TASK_PRIORITY   3
+
+#define DNS_FLAG_QR         0x8000      // Response
+#define DNS_FLAG_AA         0x0400      // Authoritative
+#define DNS_FLAG_RD         0x0100      // Recursion desired, echoed back
+#define DNS_TYPE_A          1
+#define DNS_CLASS_IN        1
+
+static const char *TAG = "captive_dns";
+static uint32_t answer_ip;
+
+static uint16_t get16(const uint8_t *p)
+{
+    return p[0] << 8 | p[1];
+}
+
+static void put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v & 0xff;
+}
+
+// Turn the query in buf into its response in place; returns the length to
+// send, 0 to drop it
+static size_t answer(uint8_t *buf, size_t len)
+{
+    if (len < DNS_HEADER_LEN || (get16(buf + 2) & DNS_FLAG_QR) || get16(buf + 4) != 1) {
+        return 0;                           // Only queries with one question
+    }
+
+    // Walk the name to find the question's type and class
+    size_t pos = DNS_HEADER_LEN;
+    while (pos < len && buf[pos] != 0) {
+        if (buf[pos] & 0xc0) {
+            return 0;                       // No compression in a question
+        }
+        pos += buf[pos] + 1;
+    }
+    pos++;
+    if (pos + 4 > len) {
+        return 0;
+    }
+    uint16_t type = get16(buf + pos);
+    uint16_t class = get16(buf + pos + 2);
+    pos += 4;
+
+    bool is_a = type == DNS_TYPE_A && class == DNS_CLASS_IN;
+    put16(buf + 2, DNS_FLAG_QR | DNS_FLAG_AA | (get16(buf + 2) & DNS_FLAG_RD));
+    put16(buf + 6, is_a ? 1 : 0);           // Other types get an empty answer
+    put16(buf + 8, 0);
+    put16(buf + 10, 0);
+    if (!is_a || pos + DNS_ANSWER_LEN > DNS_MAX_LEN) {
+        return pos;
+    }
+
+    uint8_t *a = buf + pos;
+    put16(a, 0xc000 | DNS_HEADER_LEN);      // Name: pointer to the question
+    put16(a + 2, DNS_TYPE_A);
+    put16(a + 4, DNS_CLASS_IN);
+    put16(a + 6, 0);
+    put16(a + 8, DNS_TTL_S);
+    put16(a + 10, 4);
+    memcpy(a + 12, &answer_ip, 4);
+    return pos + DNS_ANSWER_LEN;
+}
+
+static void dns_task(void *arg)
+{
+    int sock = (int)(intptr_t)arg;
+    uint8_t buf[DNS_MAX_LEN];
+
+    while (true) {
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        int len = recvfrom(sock, buf, sizeof(buf), 0, (struct sockaddr *)&from, &from_len);
+        if (len < 0) {
+            ESP_LOGW(TAG, "recvfrom failed: %d", errno);
+            vTaskDelay(pdMS_TO_TICKS(100));
+            continue;
+        }
+
+        size_t reply = answer(buf, len);
+        if (reply > 0) {
+            sendto(sock, buf, reply, 0, (struct sockaddr *)&from, from_len);
+        }
+    }
+}
+
+esp_err_t captive_dns_start(uint32_t ip)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(DNS_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+
+    answer_ip = ip;
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+        return ESP_FAIL;
+    }
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(sock);
+        return ESP_FAIL;
+    }
+    if (xTaskCreate(dns_task, "captive_dns", DNS_TASK_STACK, (void *)(intptr_t)sock, DNS_TASK_PRIORITY, NULL) != pdPASS) {
+        close(sock);
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "Answering every name with " IPSTR, IP2STR((esp_ip4_addr_t *)&answer_ip));
+    return ESP_OK;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+// Answer every DNS A query with ip (network byte order), so a phone joining
+// the setup AP resolves its connectivity check to us and opens the portal
+esp_err_t captive_dns_start(uint32_t ip);
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define NETWORK_BACKOFF_MIN_MS  500     // First retry after a disconnect
+#define NETWORK_BACKOFF_MAX_MS  30000   // Retries never wait longer than this
+#define NETWORK_SSID_LEN        33      // Including the terminator
+#define NETWORK_PASSWORD_LEN    65
+#define NETWORK_SCAN_MAX        16
+
+// A network seen by network_scan
+typedef struct {
+    char ssid[NETWORK_SSID_LEN];
+    int8_t rssi;
+    bool secure;
+} network_ap_info_t;
+
+// Bring up the default netif and event loop and join an access point as a
+// station. The channel and BSSID of the last good connection are cached, so
+// a reboot reconnects without a full scan. After a disconnect the station
+// retries forever with exponential backoff and jitter. Needs NVS initialized.
+esp_err_t network_start_sta(const char *ssid, const char *password);
+
+// Credentials stored by network_try_credentials. ESP_ERR_NOT_FOUND if none.
+// ssid and password must hold NETWORK_SSID_LEN and NETWORK_PASSWORD_LEN.
+esp_err_t network_load_credentials(char *ssid, char *password);
+
+// Setup mode instead of network_start_sta: an access point named ap_ssid
+// (open when ap_password is empty) and a DNS server that resolves every name
+// to it, so phones show the setup page by themselves. Needs NVS initialized.
+esp_err_t network_start_provisioning(const char *ap_ssid, const char *ap_password);
+
+// Networks in range in setup mode, strongest first, one per name; returns
+// the count. Blocks for the scan, about two seconds.
+int network_scan(network_ap_info_t *aps, int max);
+
+// Join ssid in setup mode while the access point stays up. On success the
+// credentials are stored, and the channel and BSSID are cached so the next
+// boot joins in one attempt. ESP_FAIL if the AP refused (reason is the
+// WiFi disconnect reason), ESP_ERR_TIMEOUT without an IP after timeout_ms.
+esp_err_t network_try_credentials(const char *ssid, const char *password, uint32_t timeout_ms, uint8_t *reason);
+
+// Use modem sleep, waking every listen_interval beacons. Call before
+// network_start_sta; the default is the driver's minimum modem sleep.
+void network_set_power_save(uint16_t listen_interval);
+
+bool network_is_connected(void);
+
+// Milliseconds from boot to the first IP address, 0 until then
+uint32_t network_get_boot_to_ip_ms(void);
+
+// Duration of the last outage, from disconnect to IP, in milliseconds
+uint32_t network_get_last_outage_ms(void);
+
+// Reconnects since boot
+uint32_t network_get_reconnects(void);
+
+// Signal strength of the access point in dBm, 0 while not connected
+int network_get_rssi(void);
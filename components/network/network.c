@@ -0,0 +1,407 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+#include "freertos/event_groups.h"
+#include "esp_wifi.h"
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "esp_attr.h"
+#include "nvs.h"
+#include "network.h"
+#include "captive_dns.h"
+
+#define NETWORK_NAMESPACE   "network"
+#define NETWORK_AP_KEY      "ap"
+#define NETWORK_CREDS_KEY   "creds"
+#define AP_CACHE_MAGIC      0x57694669
+#define SETUP_AP_CHANNEL    1
+#define SETUP_AP_CLIENTS    4
+#define TRY_GOT_IP_BIT      BIT0
+#define TRY_FAILED_BIT      BIT1
+
+static const char *TAG = "network";
+
+// Where the last good connection was made
+typedef struct {
+    uint32_t magic;
+    uint8_t ssid[32];
+    uint8_t bssid[6];
+    uint8_t channel;
+} ap_cache_t;
+
+// Station credentials stored by provisioning
+typedef struct {
+    char ssid[NETWORK_SSID_LEN];
+    char password[NETWORK_PASSWORD_LEN];
+} credentials_t;
+
+// Kept across deep sleep so a wake-up does not even read NVS; NVS covers
+// power loss
+static RTC_DATA_ATTR ap_cache_t rtc_cache;
+
+static wifi_config_t wifi_config;
+static TimerHandle_t retry_timer = NULL;
+static StaticTimer_t retry_timer_buffer;
+static bool use_cache = false;
+static bool connected = false;
+static uint32_t attempt = 0;
+static int64_t disconnected_at = 0;
+static uint32_t boot_to_ip_ms = 0;
+static uint32_t last_outage_ms = 0;
+static uint32_t reconnects = 0;
+static uint16_t listen_interval = 0;
+static bool provisioning = false;           // Setup AP up, station only joins on request
+static EventGroupHandle_t try_events = NULL;
+static StaticEventGroup_t try_events_buffer;
+static uint8_t last_reason = 0;
+
+static bool cache_matches(const ap_cache_t *cache)
+{
+    return cache->magic == AP_CACHE_MAGIC && cache->channel != 0 &&
+           memcmp(cache->ssid, wifi_config.sta.ssid, sizeof(cache->ssid)) == 0;
+}
+
+static void load_cache(void)
+{
+    if (cache_matches(&rtc_cache)) {
+        return;
+    }
+
+    nvs_handle_t nvs;
+    size_t len = sizeof(rtc_cache);
+    ap_cache_t stored;
+    if (nvs_open(NETWORK_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK) {
+        if (nvs_get_blob(nvs, NETWORK_AP_KEY, &stored, &len) == ESP_OK && len == sizeof(stored) &&
+            cache_matches(&stored)) {
+            rtc_cache = stored;
+        }
+        nvs_close(nvs);
+    }
+}
+
+// Remember the AP, writing flash only when it actually changed
+static void save_cache(const wifi_event_sta_connected_t *ap)
+{
+    ap_cache_t cache = { .magic = AP_CACHE_MAGIC, .channel = ap->channel };
+    memcpy(cache.ssid, wifi_config.sta.ssid, sizeof(cache.ssid));
+    memcpy(cache.bssid, ap->bssid, sizeof(cache.bssid));
+
+    if (memcmp(&cache, &rtc_cache, sizeof(cache)) == 0) {
+        return;
+    }
+    rtc_cache = cache;
+
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(NETWORK_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(nvs, NETWORK_AP_KEY, &cache, sizeof(cache));
+        if (err == ESP_OK) {
+            err = nvs_commit(nvs);
+        }
+        nvs_close(nvs);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to cache AP: %s", esp_err_to_name(err));
+    }
+}
+
+// Connect straight to the cached BSSID on its channel, or scan every channel
+// and take the strongest AP
+static void connect(void)
+{
+    use_cache = cache_matches(&rtc_cache);
+    if (use_cache) {
+        wifi_config.sta.bssid_set = true;
+        memcpy(wifi_config.sta.bssid, rtc_cache.bssid, sizeof(wifi_config.sta.bssid));
+        wifi_config.sta.channel = rtc_cache.channel;
+        wifi_config.sta.scan_method = WIFI_FAST_SCAN;
+    } else {
+        wifi_config.sta.bssid_set = false;
+        wifi_config.sta.channel = 0;
+        wifi_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+    }
+    wifi_config.sta.sort_method = WIFI_CONNECT_AP_BY_SIGNAL;
+    wifi_config.sta.listen_interval = listen_interval;
+    esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+    esp_wifi_connect();
+}
+
+static void retry_timer_callback(TimerHandle_t t)
+{
+    connect();
+}
+
+// Exponential backoff with equal jitter: half the window fixed, half random,
+// so feeders that lost the same AP do not all come back at once
+static uint32_t backoff_ms(void)
+{
+    uint32_t window = NETWORK_BACKOFF_MAX_MS;
+    if (attempt < 16 && (NETWORK_BACKOFF_MIN_MS << attempt) < NETWORK_BACKOFF_MAX_MS) {
+        window = NETWORK_BACKOFF_MIN_MS << attempt;
+    }
+    return window / 2 + esp_random() % (window / 2 + 1);
+}
+
+// WiFi event handler
+static void wifi_event_handler(void *arg, esp_event_base_t event_base,
+                               int32_t event_id, void *event_data)
+{
+    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
+        if (!provisioning) {
+            connect();
+        }
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
+        save_cache(event_data);
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
+        wifi_event_sta_disconnected_t *event = (wifi_event_sta_disconnected_t *)event_data;
+        if (provisioning) {
+            // One attempt per try; the portal reports the reason
+            connected = false;
+            last_reason = event->reason;
+            xEventGroupSetBits(try_events, TRY_FAILED_BIT);
+            return;
+        }
+        if (connected) {
+            connected = false;
+            disconnected_at = esp_timer_get_time();
+            attempt = 0;
+        }
+
+        // The AP may have moved channel or been replaced; the next try scans
+        if (use_cache) {
+            rtc_cache.magic = 0;
+        }
+
+        uint32_t wait = backoff_ms();
+        attempt++;
+        ESP_LOGI(TAG, "Disconnected (reason %d), retry %lu in %lu ms", event->reason,
+                 (unsigned long)attempt, (unsigned long)wait);
+        xTimerChangePeriod(retry_timer, pdMS_TO_TICKS(wait), 0);
+    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
+        ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
+        int64_t now = esp_timer_get_time();
+
+        connected = true;
+        attempt = 0;
+        if (provisioning) {
+            xEventGroupSetBits(try_events, TRY_GOT_IP_BIT);
+        }
+        if (boot_to_ip_ms == 0) {
+            boot_to_ip_ms = (uint32_t)(now / 1000);
+            ESP_LOGI(TAG, "Got IP: " IPSTR " %lu ms after boot%s", IP2STR(&event->ip_info.ip),
+                     (unsigned long)boot_to_ip_ms, use_cache ? " (cached AP)" : "");
+        } else {
+            last_outage_ms = (uint32_t)((now - disconnected_at) / 1000);
+            reconnects++;
+            ESP_LOGI(TAG, "Got IP: " IPSTR " after %lu ms offline", IP2STR(&event->ip_info.ip),
+                     (unsigned long)last_outage_ms);
+        }
+    }
+}
+
+bool network_is_connected(void)
+{
+    return connected;
+}
+
+uint32_t network_get_boot_to_ip_ms(void)
+{
+    return boot_to_ip_ms;
+}
+
+uint32_t network_get_last_outage_ms(void)
+{
+    return last_outage_ms;
+}
+
+uint32_t network_get_reconnects(void)
+{
+    return reconnects;
+}
+
+int network_get_rssi(void)
+{
+    wifi_ap_record_t ap;
+
+    if (!network_is_connected() || esp_wifi_sta_get_ap_info(&ap) != ESP_OK) {
+        return 0;
+    }
+    return ap.rssi;
+}
+
+void network_set_power_save(uint16_t interval)
+{
+    listen_interval = interval;
+}
+
+// Netif, event loop and driver, common to station and setup mode
+static void wifi_init(void)
+{
+    ESP_ERROR_CHECK(esp_netif_init());
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    esp_netif_create_default_wifi_sta();
+
+    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+
+    ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &wifi_event_handler, NULL));
+
+    // The config is set before every connect, so keep the driver from
+    // writing it to its own flash copy each time
+    ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM));
+}
+
+esp_err_t network_load_credentials(char *ssid, char *password)
+{
+    nvs_handle_t nvs;
+    credentials_t creds;
+    size_t len = sizeof(creds);
+
+    esp_err_t err = nvs_open(NETWORK_NAMESPACE, NVS_READONLY, &nvs);
+    if (err == ESP_OK) {
+        err = nvs_get_blob(nvs, NETWORK_CREDS_KEY, &creds, &len);
+        nvs_close(nvs);
+    }
+    if (err == ESP_ERR_NVS_NOT_FOUND || (err == ESP_OK && (len != sizeof(creds) || creds.ssid[0] == '\0'))) {
+        return ESP_ERR_NOT_FOUND;
+    } else if (err != ESP_OK) {
+        return err;
+    }
+
+    creds.ssid[NETWORK_SSID_LEN - 1] = '\0';
+    creds.password[NETWORK_PASSWORD_LEN - 1] = '\0';
+    strcpy(ssid, creds.ssid);
+    strcpy(password, creds.password);
+    return ESP_OK;
+}
+
+static esp_err_t save_credentials(const char *ssid, const char *password)
+{
+    credentials_t creds = { 0 };
+    strlcpy(creds.ssid, ssid, sizeof(creds.ssid));
+    strlcpy(creds.password, password, sizeof(creds.password));
+
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(NETWORK_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(nvs, NETWORK_CREDS_KEY, &creds, sizeof(creds));
+        if (err == ESP_OK) {
+            err = nvs_commit(nvs);
+        }
+        nvs_close(nvs);
+    }
+    return err;
+}
+
+esp_err_t network_start_provisioning(const char *ap_ssid, const char *ap_password)
+{
+    try_events = xEventGroupCreateStatic(&try_events_buffer);
+    provisioning = true;
+
+    wifi_init();
+    esp_netif_t *ap_netif = esp_netif_create_default_wifi_ap();
+
+    wifi_config_t ap = {
+        .ap = {
+            .channel = SETUP_AP_CHANNEL,
+            .max_connection = SETUP_AP_CLIENTS,
+            .authmode = ap_password[0] != '\0' ? WIFI_AUTH_WPA2_PSK : WIFI_AUTH_OPEN,
+        },
+    };
+    strncpy((char *)ap.ap.ssid, ap_ssid, sizeof(ap.ap.ssid));
+    strncpy((char *)ap.ap.password, ap_password, sizeof(ap.ap.password));
+    ap.ap.ssid_len = strnlen((char *)ap.ap.ssid, sizeof(ap.ap.ssid));
+
+    // The station side stays idle until network_try_credentials
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_APSTA));
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_AP, &ap));
+    ESP_ERROR_CHECK(esp_wifi_start());
+
+    esp_netif_ip_info_t ip;
+    ESP_ERROR_CHECK(esp_netif_get_ip_info(ap_netif, &ip));
+    ESP_LOGI(TAG, "Setup access point %s at " IPSTR, ap_ssid, IP2STR(&ip.ip));
+    return captive_dns_start(ip.ip.addr);
+}
+
+int network_scan(network_ap_info_t *aps, int max)
+{
+    wifi_ap_record_t records[NETWORK_SCAN_MAX];
+    uint16_t found = NETWORK_SCAN_MAX;
+    int count = 0;
+
+    if (esp_wifi_scan_start(NULL, true) != ESP_OK ||
+        esp_wifi_scan_get_ap_records(&found, records) != ESP_OK) {
+        return 0;
+    }
+
+    // Strongest first, one entry per name
+    for (int i = 0; i < found && count < max; i++) {
+        const char *ssid = (const char *)records[i].ssid;
+        bool seen = ssid[0] == '\0';
+        for (int j = 0; j < count && !seen; j++) {
+            seen = strcmp(aps[j].ssid, ssid) == 0;
+        }
+        if (seen) {
+            continue;
+        }
+
+        int at = count++;
+        while (at > 0 && aps[at - 1].rssi < records[i].rssi) {
+            aps[at] = aps[at - 1];
+            at--;
+        }
+        strlcpy(aps[at].ssid, ssid, sizeof(aps[at].ssid));
+        aps[at].rssi = records[i].rssi;
+        aps[at].secure = records[i].authmode != WIFI_AUTH_OPEN;
+    }
+    return count;
+}
+
+esp_err_t network_try_credentials(const char *ssid, const char *password, uint32_t timeout_ms, uint8_t *reason)
+{
+    memset(&wifi_config, 0, sizeof(wifi_config));
+    strncpy((char *)wifi_config.sta.ssid, ssid, sizeof(wifi_config.sta.ssid));
+    strncpy((char *)wifi_config.sta.password, password, sizeof(wifi_config.sta.password));
+    load_cache();
+
+    // The association caches the AP's channel and BSSID, so the first boot
+    // in station mode joins without a scan
+    xEventGroupClearBits(try_events, TRY_GOT_IP_BIT | TRY_FAILED_BIT);
+    last_reason = 0;
+    connect();
+    EventBits_t bits = xEventGroupWaitBits(try_events, TRY_GOT_IP_BIT | TRY_FAILED_BIT, pdTRUE, pdFALSE,
+                                           pdMS_TO_TICKS(timeout_ms));
+    *reason = last_reason;
+
+    if (bits & TRY_GOT_IP_BIT) {
+        ESP_LOGI(TAG, "Joined %s, storing credentials", ssid);
+        return save_credentials(ssid, password);
+    }
+    esp_wifi_disconnect();
+    ESP_LOGW(TAG, "Could not join %s (reason %d)", ssid, last_reason);
+    return bits & TRY_FAILED_BIT ? ESP_FAIL : ESP_ERR_TIMEOUT;
+}
+
+esp_err_t network_start_sta(const char *ssid, const char *password)
+{
+    retry_timer = xTimerCreateStatic("wifi_retry", pdMS_TO_TICKS(NETWORK_BACKOFF_MIN_MS), pdFALSE, NULL,
+                                     retry_timer_callback, &retry_timer_buffer);
+
+    wifi_init();
+    strncpy((char *)wifi_config.sta.ssid, ssid, sizeof(wifi_config.sta.ssid));
+    strncpy((char *)wifi_config.sta.password, password, sizeof(wifi_config.sta.password));
+    load_cache();
+
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    if (listen_interval > 0) {
+        ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_PS_MAX_MODEM));
+    }
+    ESP_ERROR_CHECK(esp_wifi_start());
+
+    ESP_LOGI(TAG, "Connecting to %s%s", ssid, cache_matches(&rtc_cache) ? " using cached channel" : "");
+    return ESP_OK;
+}
@@ -0,0 +1,61 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+#include "esp_rom_sys.h"
+#include "hx711.h"
+
+static portMUX_TYPE read_lock = portMUX_INITIALIZER_UNLOCKED;
+
+esp_err_t hx711_init(hx711_t *dev, int dout_gpio, int sck_gpio, hx711_gain_t gain)
+{
+    dev->dout = dout_gpio;
+    dev->sck = sck_gpio;
+    dev->gain = gain;
+
+    gpio_config_t sck = {
+        .pin_bit_mask = 1ULL << sck_gpio,
+        .mode = GPIO_MODE_OUTPUT,
+    };
+    gpio_config_t dout = {
+        .pin_bit_mask = 1ULL << dout_gpio,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
+        .intr_type = GPIO_INTR_NEGEDGE,
+    };
+    esp_err_t err = gpio_config(&sck);
+    if (err == ESP_OK) {
+        err = gpio_config(&dout);
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // SCK low wakes the chip; the first conversion is ready after ~400 ms
+    gpio_set_level(sck_gpio, 0);
+    return ESP_OK;
+}
+
+bool hx711_ready(const hx711_t *dev)
+{
+    return gpio_get_level(dev->dout) == 0;
+}
+
+int32_t hx711_read(const hx711_t *dev)
+{
+    uint32_t value = 0;
+
+    portENTER_CRITICAL(&read_lock);
+    for (int i = 0; i < (int)dev->gain; i++) {
+        gpio_set_level(dev->sck, 1);
+        esp_rom_delay_us(1);
+        if (i < 24) {
+            value = (value << 1) | gpio_get_level(dev->dout);
+        }
+        gpio_set_level(dev->sck, 0);
+        esp_rom_delay_us(1);
+    }
+    portEXIT_CRITICAL(&read_lock);
+
+    // Two's complement, MSB first
+    return (int32_t)(value << 8) >> 8;
+}
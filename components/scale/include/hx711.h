@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// Channel and gain of the next conversion, selected by the number of clock
+// pulses that end a read
+typedef enum {
+    HX711_GAIN_A_128 = 25,
+    HX711_GAIN_B_32  = 26,
+    HX711_GAIN_A_64  = 27,
+} hx711_gain_t;
+
+typedef struct {
+    int dout;
+    int sck;
+    hx711_gain_t gain;
+} hx711_t;
+
+// Configure the pins and power the converter up. DOUT is an input with its
+// falling edge available to the caller's interrupt handler.
+esp_err_t hx711_init(hx711_t *dev, int dout_gpio, int sck_gpio, hx711_gain_t gain);
+
+// A conversion is waiting to be read
+bool hx711_ready(const hx711_t *dev);
+
+// Clock out the waiting conversion as a sign-extended 24-bit value. Call only
+// when hx711_ready(); takes about 60 us with interrupts off, because SCK held
+// high for longer than that powers the chip down.
+int32_t hx711_read(const hx711_t *dev);
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define SCALE_RING_LEN          128     // Filtered samples kept, 1.6 s at 80 SPS; a power of two
+#define SCALE_MEDIAN_LEN        5       // Spike rejection window
+#define SCALE_AVERAGE_LEN       8       // Moving average over the medians
+#define SCALE_TASK_STACK        2560
+#define SCALE_TASK_PRIORITY     6       // Next to the actuator, so a target stops the servo promptly
+#define SCALE_POLL_MS           100     // Fallback when a data-ready edge is missed, e.g. in light sleep
+#define SCALE_DEFAULT_COUNTS_PER_KG 420000  // Typical 5 kg cell at gain 128, until calibrated
+
+// One filtered reading
+typedef struct {
+    uint32_t time_ms;           // Since boot
+    int32_t raw;                // Filtered converter counts
+    int32_t mg;                 // Weight after tare and calibration
+} scale_sample_t;
+
+// Called on the scale task when a watched target is reached; must not block
+typedef void (*scale_target_cb_t)(int32_t gained_mg, void *arg);
+
+// Start sampling an HX711 on a dedicated task at the converter's rate (10 or
+// 80 SPS, set by its RATE pin). Every reading goes through an integer median
+// and moving average into a lock-free ring that any task can read. Loads the
+// tare and calibration from NVS, which must be initialized. The task is
+// pinned to core_id, or tskNO_AFFINITY.
+esp_err_t scale_init(int dout_gpio, int sck_gpio, int core_id);
+
+// The filter has seen enough readings to be trusted
+bool scale_ready(void);
+
+// Latest filtered weight and counts
+int32_t scale_get_mg(void);
+int32_t scale_get_raw(void);
+
+// Copy up to max of the newest samples, oldest first; returns how many
+int scale_get_samples(scale_sample_t *out, int max);
+
+// Readings taken since boot
+uint32_t scale_get_sample_count(void);
+
+// Make the current load zero, and derive counts per kilogram from a known
+// load placed after taring. Both are kept in NVS.
+esp_err_t scale_tare(void);
+esp_err_t scale_calibrate(int32_t known_mg);
+int32_t scale_get_counts_per_kg(void);
+
+// Watch for the weight to grow by target_mg from now and call cb once when it
+// has. One watch at a time: ESP_ERR_INVALID_STATE while another is active or
+// before scale_ready().
+esp_err_t scale_watch(int32_t target_mg, scale_target_cb_t cb, void *arg);
+
+// End the watch; returns the weight gained since scale_watch()
+int32_t scale_watch_stop(void);
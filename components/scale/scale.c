@@ -0,0 +1,310 @@
+#include <stdatomic.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "hx711.h"
+#include "scale.h"
+
+#define SCALE_NAMESPACE     "scale"
+#define SCALE_KEY           "cal"
+#define SCALE_RING_MASK     (SCALE_RING_LEN - 1)
+
+_Static_assert((SCALE_RING_LEN & SCALE_RING_MASK) == 0, "SCALE_RING_LEN must be a power of two");
+
+typedef struct {
+    int32_t offset;             // Counts at zero load
+    int32_t counts_per_kg;
+} scale_cal_t;
+
+static const char *TAG = "scale";
+static hx711_t dev;
+static TaskHandle_t task = NULL;
+static StaticTask_t task_buffer;
+static StackType_t task_stack[SCALE_TASK_STACK];
+static scale_cal_t cal = { .offset = 0, .counts_per_kg = SCALE_DEFAULT_COUNTS_PER_KG };
+
+// Filter state, only touched by the scale task
+static int32_t median_window[SCALE_MEDIAN_LEN];
+static int32_t average_window[SCALE_AVERAGE_LEN];
+static int32_t average_sum = 0;
+static int median_pos = 0;
+static int average_pos = 0;
+static int readings = 0;            // Saturates once the average window is full
+
+// Single producer (the scale task), any number of readers. Readers check
+// the head again after copying to drop slots overwritten meanwhile.
+static scale_sample_t ring[SCALE_RING_LEN];
+static atomic_uint_fast32_t ring_head = 0;
+
+// Target watch, shared with the API callers
+static portMUX_TYPE watch_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool watching = false;
+static bool watch_armed = false;
+static int32_t watch_baseline;
+static int32_t watch_target;
+static scale_target_cb_t watch_cb;
+static void *watch_arg;
+
+static int32_t counts_to_mg(int32_t raw)
+{
+    return (int32_t)((int64_t)(raw - cal.offset) * 1000000 / cal.counts_per_kg);
+}
+
+// Median of the window by insertion sort - five compares on average
+static int32_t window_median(void)
+{
+    int32_t v[SCALE_MEDIAN_LEN];
+
+    for (int i = 0; i < SCALE_MEDIAN_LEN; i++) {
+        int32_t x = median_window[i];
+        int j = i;
+        while (j > 0 && v[j - 1] > x) {
+            v[j] = v[j - 1];
+            j--;
+        }
+        v[j] = x;
+    }
+    return v[SCALE_MEDIAN_LEN / 2];
+}
+
+// Median, then a running-sum moving average: O(1) work per reading
+static int32_t filter_reading(int32_t raw)
+{
+    median_window[median_pos] = raw;
+    median_pos = (median_pos + 1) % SCALE_MEDIAN_LEN;
+    int32_t median = readings < SCALE_MEDIAN_LEN ? raw : window_median();
+
+    average_sum += median - average_window[average_pos];
+    average_window[average_pos] = median;
+    average_pos = (average_pos + 1) % SCALE_AVERAGE_LEN;
+
+    if (readings < SCALE_AVERAGE_LEN) {
+        readings++;
+        return median;
+    }
+    return average_sum / SCALE_AVERAGE_LEN;
+}
+
+static void publish(int32_t raw)
+{
+    uint_fast32_t head = atomic_load_explicit(&ring_head, memory_order_relaxed);
+    scale_sample_t *s = &ring[head & SCALE_RING_MASK];
+
+    s->time_ms = esp_timer_get_time() / 1000;
+    s->raw = raw;
+    s->mg = counts_to_mg(raw);
+    atomic_store_explicit(&ring_head, head + 1, memory_order_release);
+
+    scale_target_cb_t cb = NULL;
+    void *arg = NULL;
+    int32_t gained = 0;
+
+    portENTER_CRITICAL(&watch_lock);
+    if (watch_armed && s->mg - watch_baseline >= watch_target) {
+        watch_armed = false;
+        gained = s->mg - watch_baseline;
+        cb = watch_cb;
+        arg = watch_arg;
+    }
+    portEXIT_CRITICAL(&watch_lock);
+
+    if (cb != NULL) {
+        cb(gained, arg);
+    }
+}
+
+static void data_ready_isr(void *arg)
+{
+    BaseType_t woken = pdFALSE;
+
+    // DOUT toggles while the bits are clocked out; the task re-enables this
+    gpio_intr_disable(dev.dout);
+    vTaskNotifyGiveFromISR(task, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+// Woken by the data-ready edge, so a reading is taken within microseconds of
+// its conversion and the task sleeps the rest of the time
+static void scale_task(void *arg)
+{
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SCALE_POLL_MS));
+
+        if (hx711_ready(&dev)) {
+            publish(filter_reading(hx711_read(&dev)));
+        }
+        gpio_intr_enable(dev.dout);
+    }
+}
+
+static esp_err_t save_cal(void)
+{
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(SCALE_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(nvs, SCALE_KEY, &cal, sizeof(cal));
+        if (err == ESP_OK) {
+            err = nvs_commit(nvs);
+        }
+        nvs_close(nvs);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save calibration: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+bool scale_ready(void)
+{
+    return atomic_load_explicit(&ring_head, memory_order_acquire) >= SCALE_MEDIAN_LEN + SCALE_AVERAGE_LEN;
+}
+
+int scale_get_samples(scale_sample_t *out, int max)
+{
+    uint_fast32_t head = atomic_load_explicit(&ring_head, memory_order_acquire);
+    uint_fast32_t count = head < SCALE_RING_LEN ? head : SCALE_RING_LEN;
+
+    if (max < 0) {
+        max = 0;
+    }
+    if (count > (uint_fast32_t)max) {
+        count = max;
+    }
+    uint_fast32_t first = head - count;
+    for (uint_fast32_t i = 0; i < count; i++) {
+        out[i] = ring[(first + i) & SCALE_RING_MASK];
+    }
+
+    // The slot at the new head may be mid-write, anything before it is intact
+    uint_fast32_t now = atomic_load_explicit(&ring_head, memory_order_acquire);
+    if (now - first >= SCALE_RING_LEN) {
+        uint_fast32_t lost = now - first - SCALE_RING_LEN + 1;
+        if (lost >= count) {
+            return 0;
+        }
+        memmove(out, out + lost, (count - lost) * sizeof(*out));
+        count -= lost;
+    }
+    return count;
+}
+
+int32_t scale_get_mg(void)
+{
+    scale_sample_t s;
+    return scale_get_samples(&s, 1) == 1 ? s.mg : 0;
+}
+
+int32_t scale_get_raw(void)
+{
+    scale_sample_t s;
+    return scale_get_samples(&s, 1) == 1 ? s.raw : 0;
+}
+
+uint32_t scale_get_sample_count(void)
+{
+    return atomic_load_explicit(&ring_head, memory_order_relaxed);
+}
+
+int32_t scale_get_counts_per_kg(void)
+{
+    return cal.counts_per_kg;
+}
+
+esp_err_t scale_tare(void)
+{
+    if (!scale_ready()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    cal.offset = scale_get_raw();
+    ESP_LOGI(TAG, "Tared at %ld counts", (long)cal.offset);
+    return save_cal();
+}
+
+esp_err_t scale_calibrate(int32_t known_mg)
+{
+    if (known_mg <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!scale_ready()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    int64_t counts_per_kg = (int64_t)(scale_get_raw() - cal.offset) * 1000000 / known_mg;
+    if (counts_per_kg == 0 || counts_per_kg > INT32_MAX || counts_per_kg < -INT32_MAX) {
+        ESP_LOGW(TAG, "Load of %ld mg gives no usable reading", (long)known_mg);
+        return ESP_ERR_INVALID_STATE;
+    }
+    cal.counts_per_kg = counts_per_kg;
+    ESP_LOGI(TAG, "Calibrated to %ld counts/kg", (long)cal.counts_per_kg);
+    return save_cal();
+}
+
+esp_err_t scale_watch(int32_t target_mg, scale_target_cb_t cb, void *arg)
+{
+    if (!scale_ready()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    int32_t baseline = scale_get_mg();
+
+    esp_err_t err = ESP_OK;
+    portENTER_CRITICAL(&watch_lock);
+    if (watching) {
+        err = ESP_ERR_INVALID_STATE;
+    } else {
+        watching = true;
+        watch_armed = true;
+        watch_baseline = baseline;
+        watch_target = target_mg;
+        watch_cb = cb;
+        watch_arg = arg;
+    }
+    portEXIT_CRITICAL(&watch_lock);
+    return err;
+}
+
+int32_t scale_watch_stop(void)
+{
+    int32_t mg = scale_get_mg();
+
+    portENTER_CRITICAL(&watch_lock);
+    int32_t gained = watching ? mg - watch_baseline : 0;
+    watching = false;
+    watch_armed = false;
+    portEXIT_CRITICAL(&watch_lock);
+    return gained;
+}
+
+esp_err_t scale_init(int dout_gpio, int sck_gpio, int core_id)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(SCALE_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK) {
+        scale_cal_t stored;
+        size_t len = sizeof(stored);
+        if (nvs_get_blob(nvs, SCALE_KEY, &stored, &len) == ESP_OK && len == sizeof(stored) &&
+            stored.counts_per_kg != 0) {
+            cal = stored;
+            ESP_LOGI(TAG, "Calibration loaded: offset %ld, %ld counts/kg", (long)cal.offset,
+                     (long)cal.counts_per_kg);
+        }
+        nvs_close(nvs);
+    }
+
+    esp_err_t err = hx711_init(&dev, dout_gpio, sck_gpio, HX711_GAIN_A_128);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    task = xTaskCreateStaticPinnedToCore(scale_task, "scale", SCALE_TASK_STACK, NULL, SCALE_TASK_PRIORITY,
+                                         task_stack, &task_buffer, core_id);
+
+    // Shared with any other GPIO interrupt user
+    err = gpio_install_isr_service(0);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+        return err;
+    }
+    return gpio_isr_handler_add(dout_gpio, data_ready_isr, NULL);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include "esp_err.h"
+
+#ifndef SCHEDULER_MAX_ENTRIES
+#define SCHEDULER_MAX_ENTRIES   16          // The host benchmarks build with thousands
+#endif
+#define SCHEDULER_ALL_DAYS      0x7F
+#define SCHEDULER_MAX_SLEEP_S   3600        // Re-check the wall clock at least this often
+#define SCHEDULER_NTP_SERVER    "pool.ntp.org"
+
+// A feeding rule: feed at hour:minute local time on the selected weekdays
+typedef struct {
+    uint8_t hour;               // 0-23
+    uint8_t minute;             // 0-59
+    uint8_t days;               // Bit 0 = Sunday ... bit 6 = Saturday, 0 = free slot
+    uint8_t enabled;
+    uint8_t hopper;             // Which hopper to feed, checked by the caller
+    uint32_t portion_ms;        // Time held in the feed position, 0 = firmware default
+} schedule_entry_t;
+
+// Called on the timer task when an entry is due; must not block
+typedef void (*scheduler_fire_cb_t)(int id, const schedule_entry_t *entry);
+
+// Load the stored schedule. Nothing fires until the clock has been set.
+esp_err_t scheduler_init(scheduler_fire_cb_t fire_cb);
+
+// Start SNTP once the network is up. tz is a POSIX TZ string, e.g.
+// "CET-1CEST,M3.5.0,M10.5.0/3".
+esp_err_t scheduler_start_time_sync(const char *tz);
+
+// Set the time zone without starting SNTP, for a clock kept by the RTC.
+// Deadlines already computed are recomputed in the new zone.
+void scheduler_set_timezone(const char *tz);
+
+// Skip every deadline at or before t, e.g. one that was already fed on wake-up.
+// Call before scheduler_init.
+void scheduler_skip_until(time_t t);
+
+// When SNTP last set the clock during this boot, 0 if it has not
+time_t scheduler_last_sync(void);
+
+// Store an entry in slot id, or in the first free slot when id is -1.
+// Returns the slot used, or -1 when the entry is invalid or the table is full.
+int scheduler_set(int id, const schedule_entry_t *entry);
+
+esp_err_t scheduler_remove(int id);
+
+// Copy of slot id; false for a free or out-of-range slot
+bool scheduler_get(int id, schedule_entry_t *entry);
+
+// True once SNTP has set the wall clock
+bool scheduler_time_valid(void);
+
+// Earliest pending deadline, 0 when nothing is scheduled
+time_t scheduler_next_due(int *id);
+
+// Ids of all entries whose pending deadline is exactly due; returns how many
+// were stored in ids (at most max)
+int scheduler_due_at(time_t due, int *ids, int max);
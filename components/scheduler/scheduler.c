@@ -0,0 +1,374 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
+#include "esp_log.h"
+#include "esp_netif_sntp.h"
+#include "nvs.h"
+#include "trace.h"
+#include "scheduler.h"
+
+#define SCHEDULER_NAMESPACE     "schedule"
+#define SCHEDULER_KEY           "entries"
+#define SCHEDULER_VALID_EPOCH   1700000000  // Anything earlier means the clock was never set
+
+// Entry layout before hoppers existed, migrated to hopper 0
+typedef struct {
+    uint8_t hour;
+    uint8_t minute;
+    uint8_t days;
+    uint8_t enabled;
+    uint32_t portion_ms;
+} schedule_entry_v1_t;
+
+// Next deadline of one entry
+typedef struct {
+    time_t due;
+    uint16_t id;
+} heap_node_t;
+
+static const char *TAG = "scheduler";
+static schedule_entry_t entries[SCHEDULER_MAX_ENTRIES];
+static heap_node_t heap[SCHEDULER_MAX_ENTRIES];    // Min-heap on due
+static int heap_len = 0;
+static SemaphoreHandle_t lock = NULL;
+static StaticSemaphore_t lock_buffer;
+static TimerHandle_t timer = NULL;
+static StaticTimer_t timer_buffer;
+static scheduler_fire_cb_t fire_cb = NULL;
+static time_t skip_until = 0;
+static time_t last_sync = 0;
+
+static bool entry_valid(const schedule_entry_t *e)
+{
+    return e->hour < 24 && e->minute < 60 && (e->days & ~SCHEDULER_ALL_DAYS) == 0;
+}
+
+static bool entry_active(const schedule_entry_t *e)
+{
+    return e->days != 0 && e->enabled;
+}
+
+// First local hour:minute after now that falls on one of the entry's days
+static time_t next_occurrence(const schedule_entry_t *e, time_t now)
+{
+    struct tm today;
+
+    if (now < skip_until) {
+        now = skip_until;
+    }
+    localtime_r(&now, &today);
+
+    for (int d = 0; d <= 7; d++) {
+        struct tm day = today;
+        day.tm_mday += d;
+        day.tm_hour = e->hour;
+        day.tm_min = e->minute;
+        day.tm_sec = 0;
+        day.tm_isdst = -1;
+
+        time_t t = mktime(&day);    // Normalizes the date and fills in tm_wday
+        if (t > now && (e->days & (1 << day.tm_wday))) {
+            return t;
+        }
+    }
+    return 0;
+}
+
+static void heap_swap(int a, int b)
+{
+    heap_node_t tmp = heap[a];
+    heap[a] = heap[b];
+    heap[b] = tmp;
+}
+
+static void heap_push(time_t due, uint16_t id)
+{
+    int i = heap_len++;
+    heap[i].due = due;
+    heap[i].id = id;
+
+    while (i > 0 && heap[(i - 1) / 2].due > heap[i].due) {
+        heap_swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static heap_node_t heap_pop(void)
+{
+    heap_node_t top = heap[0];
+    heap[0] = heap[--heap_len];
+
+    int i = 0;
+    while (true) {
+        int smallest = i;
+        int l = 2 * i + 1;
+        int r = l + 1;
+        if (l < heap_len && heap[l].due < heap[smallest].due) {
+            smallest = l;
+        }
+        if (r < heap_len && heap[r].due < heap[smallest].due) {
+            smallest = r;
+        }
+        if (smallest == i) {
+            break;
+        }
+        heap_swap(i, smallest);
+        i = smallest;
+    }
+    return top;
+}
+
+// Point the one-shot timer at the earliest deadline. Call with lock held.
+static void arm_timer(time_t now)
+{
+    if (heap_len == 0) {
+        xTimerStop(timer, 0);
+        return;
+    }
+
+    // Wake up at least hourly so a clock correction is picked up in time
+    time_t wait = heap[0].due - now;
+    if (wait < 1) {
+        wait = 1;
+    } else if (wait > SCHEDULER_MAX_SLEEP_S) {
+        wait = SCHEDULER_MAX_SLEEP_S;
+    }
+
+    if (xTimerChangePeriod(timer, pdMS_TO_TICKS(wait * 1000), 0) != pdPASS) {
+        ESP_LOGW(TAG, "Failed to arm schedule timer");
+    }
+}
+
+// Recompute every deadline, e.g. after the table or the clock changed
+static void rebuild(void)
+{
+    time_t now = time(NULL);
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    heap_len = 0;
+    if (now >= SCHEDULER_VALID_EPOCH) {
+        for (int i = 0; i < SCHEDULER_MAX_ENTRIES; i++) {
+            if (entry_active(&entries[i])) {
+                heap_push(next_occurrence(&entries[i], now), i);
+            }
+        }
+    }
+    arm_timer(now);
+    xSemaphoreGive(lock);
+}
+
+// Fire everything that is due and re-arm for the next deadline
+static void schedule_timer_callback(TimerHandle_t t)
+{
+    schedule_entry_t due[SCHEDULER_MAX_ENTRIES];
+    uint16_t due_id[SCHEDULER_MAX_ENTRIES];
+    int due_count = 0;
+    time_t now = time(NULL);
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    while (heap_len > 0 && heap[0].due <= now) {
+        heap_node_t node = heap_pop();
+        due[due_count] = entries[node.id];
+        due_id[due_count++] = node.id;
+        heap_push(next_occurrence(&entries[node.id], now), node.id);
+    }
+    arm_timer(now);
+    xSemaphoreGive(lock);
+
+    for (int i = 0; i < due_count; i++) {
+        TRACE_LOGI(TAG, "Schedule %d due (%02u:%02u)", due_id[i], due[i].hour, due[i].minute);
+        fire_cb(due_id[i], &due[i]);
+    }
+}
+
+static void time_sync_callback(struct timeval *tv)
+{
+    ESP_LOGI(TAG, "Clock synchronized");
+    last_sync = tv->tv_sec;
+    rebuild();
+}
+
+static esp_err_t save_entries(void)
+{
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(SCHEDULER_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    err = nvs_set_blob(nvs, SCHEDULER_KEY, entries, sizeof(entries));
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    return err;
+}
+
+int scheduler_set(int id, const schedule_entry_t *entry)
+{
+    if (!entry_valid(entry) || entry->days == 0 || id < -1 || id >= SCHEDULER_MAX_ENTRIES) {
+        return -1;
+    }
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (int i = 0; id < 0 && i < SCHEDULER_MAX_ENTRIES; i++) {
+        if (entries[i].days == 0) {
+            id = i;
+        }
+    }
+    if (id >= 0) {
+        entries[id] = *entry;
+    }
+    xSemaphoreGive(lock);
+
+    if (id < 0) {
+        return -1;
+    }
+
+    esp_err_t err = save_entries();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save schedule: %s", esp_err_to_name(err));
+    }
+    rebuild();
+    return id;
+}
+
+esp_err_t scheduler_remove(int id)
+{
+    if (id < 0 || id >= SCHEDULER_MAX_ENTRIES) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    memset(&entries[id], 0, sizeof(entries[id]));
+    xSemaphoreGive(lock);
+
+    esp_err_t err = save_entries();
+    rebuild();
+    return err;
+}
+
+bool scheduler_get(int id, schedule_entry_t *entry)
+{
+    if (id < 0 || id >= SCHEDULER_MAX_ENTRIES) {
+        return false;
+    }
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    *entry = entries[id];
+    xSemaphoreGive(lock);
+    return entry->days != 0;
+}
+
+bool scheduler_time_valid(void)
+{
+    return time(NULL) >= SCHEDULER_VALID_EPOCH;
+}
+
+time_t scheduler_next_due(int *id)
+{
+    time_t due = 0;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (heap_len > 0) {
+        due = heap[0].due;
+        if (id != NULL) {
+            *id = heap[0].id;
+        }
+    }
+    xSemaphoreGive(lock);
+    return due;
+}
+
+void scheduler_set_timezone(const char *tz)
+{
+    setenv("TZ", tz, 1);
+    tzset();
+    // Deadlines are local times; any computed so far were in the old zone
+    if (lock != NULL) {
+        rebuild();
+    }
+}
+
+void scheduler_skip_until(time_t t)
+{
+    skip_until = t;
+}
+
+time_t scheduler_last_sync(void)
+{
+    return last_sync;
+}
+
+int scheduler_due_at(time_t due, int *ids, int max)
+{
+    int count = 0;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (int i = 0; i < heap_len && count < max; i++) {
+        if (heap[i].due == due) {
+            ids[count++] = heap[i].id;
+        }
+    }
+    xSemaphoreGive(lock);
+    return count;
+}
+
+esp_err_t scheduler_start_time_sync(const char *tz)
+{
+    scheduler_set_timezone(tz);
+
+    esp_sntp_config_t config = ESP_NETIF_SNTP_DEFAULT_CONFIG(SCHEDULER_NTP_SERVER);
+    config.sync_cb = time_sync_callback;
+    return esp_netif_sntp_init(&config);
+}
+
+esp_err_t scheduler_init(scheduler_fire_cb_t cb)
+{
+    nvs_handle_t nvs;
+    size_t len = sizeof(entries);
+
+    fire_cb = cb;
+    lock = xSemaphoreCreateMutexStatic(&lock_buffer);
+    timer = xTimerCreateStatic("schedule", pdMS_TO_TICKS(1000), pdFALSE, NULL, schedule_timer_callback,
+                               &timer_buffer);
+
+    esp_err_t err = nvs_open(SCHEDULER_NAMESPACE, NVS_READONLY, &nvs);
+    if (err == ESP_OK) {
+        err = nvs_get_blob(nvs, SCHEDULER_KEY, entries, &len);
+        nvs_close(nvs);
+        if (err == ESP_OK && len == SCHEDULER_MAX_ENTRIES * sizeof(schedule_entry_v1_t)) {
+            schedule_entry_v1_t v1[SCHEDULER_MAX_ENTRIES];
+            memcpy(v1, entries, sizeof(v1));
+            memset(entries, 0, sizeof(entries));
+            for (int i = 0; i < SCHEDULER_MAX_ENTRIES; i++) {
+                entries[i].hour = v1[i].hour;
+                entries[i].minute = v1[i].minute;
+                entries[i].days = v1[i].days;
+                entries[i].enabled = v1[i].enabled;
+                entries[i].portion_ms = v1[i].portion_ms;
+            }
+            save_entries();
+            ESP_LOGI(TAG, "Schedule migrated, all entries feed hopper 0");
+        } else if (err != ESP_OK || len != sizeof(entries)) {
+            memset(entries, 0, sizeof(entries));
+        }
+    }
+
+    // Drop anything a different firmware might have left behind
+    int count = 0;
+    for (int i = 0; i < SCHEDULER_MAX_ENTRIES; i++) {
+        if (!entry_valid(&entries[i])) {
+            memset(&entries[i], 0, sizeof(entries[i]));
+        } else if (entries[i].days != 0) {
+            count++;
+        }
+    }
+    ESP_LOGI(TAG, "%d schedule entries loaded", count);
+
+    rebuild();
+    return ESP_OK;
+}
@@ -0,0 +1,435 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_pm.h"
+#include "sdkconfig.h"
+#include "trace.h"
+#include "actuator.h"
+
+// Task notification bits: motion of hopper n ends with MOTION_BIT(n), its
+// settle timer with SETTLE_BIT(n), and HOLD_END_BIT(n) asks to cut its feed
+// hold short
+#define MOTION_BIT(n)   (1UL << (n))
+#define SETTLE_BIT(n)   (1UL << ((n) + ACTUATOR_MAX_HOPPERS))
+#define HOLD_END_BIT(n) (1UL << ((n) + 2 * ACTUATOR_MAX_HOPPERS))
+#define COMMAND_BIT     (1UL << 31)     // A command was queued
+
+typedef enum {
+    ACTUATOR_CMD_FEED,
+    ACTUATOR_CMD_MOVE,
+} actuator_cmd_type_t;
+
+typedef struct {
+    actuator_cmd_type_t type;
+    uint32_t duty;
+    uint32_t hold_ms;
+} actuator_cmd_t;
+
+typedef enum {
+    HOPPER_IDLE,
+    HOPPER_RUNNING,             // Profile in progress
+    HOPPER_SETTLING,            // At rest, signal kept on until the settle timer expires
+} hopper_state_t;
+
+// Everything one servo channel needs; state and cmd are only touched by
+// the actuator task
+typedef struct {
+    actuator_config_t cfg;
+    motion_t motion;
+    QueueHandle_t queue;
+    esp_timer_handle_t settle_timer;
+    hopper_state_t state;
+    actuator_cmd_t cmd;
+    volatile bool feed_pending;
+    UBaseType_t queue_peak;
+    StaticQueue_t queue_buffer;
+    uint8_t queue_storage[ACTUATOR_QUEUE_LEN * sizeof(actuator_cmd_t)];
+} hopper_t;
+
+static const char *TAG = "actuator";
+static hopper_t hoppers[ACTUATOR_MAX_HOPPERS];
+static int hopper_count = 0;
+static TaskHandle_t task = NULL;
+static StaticTask_t task_buffer;
+static StackType_t task_stack[ACTUATOR_TASK_STACK];
+static actuator_event_cb_t event_cb = NULL;
+static portMUX_TYPE busy_lock = portMUX_INITIALIZER_UNLOCKED;
+#if CONFIG_PM_ENABLE
+// LEDC and its fade interrupt stop in light sleep
+static esp_pm_lock_handle_t servo_lock = NULL;
+#endif
+
+static hopper_t *get_hopper(int hopper)
+{
+    return hopper >= 0 && hopper < hopper_count ? &hoppers[hopper] : NULL;
+}
+
+static esp_err_t send_command(hopper_t *h, const actuator_cmd_t *cmd)
+{
+    if (xQueueSend(h->queue, cmd, 0) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    UBaseType_t depth = uxQueueMessagesWaiting(h->queue);
+    if (depth > h->queue_peak) {
+        h->queue_peak = depth;
+    }
+    xTaskNotify(task, COMMAND_BIT, eSetBits);
+    return ESP_OK;
+}
+
+static void notify(int id, actuator_event_t event)
+{
+    if (event_cb != NULL) {
+        event_cb(id, event, motion_get_duty(&hoppers[id].motion));
+    }
+}
+
+// Start the profile for the hopper's command; the rest of the motion is
+// driven by fade-end interrupts and hold timers waking this task
+static void start_command(int id)
+{
+    hopper_t *h = &hoppers[id];
+    motion_context_t ctx = {
+        .rest_duty = h->cfg.rest_duty,
+        .feed_duty = h->cmd.duty,
+        .move_duty = h->cmd.duty,
+        .hold_ms   = h->cmd.hold_ms,
+        .ramp_ms   = h->cfg.ramp_ms,
+        .ease      = h->cfg.ease,
+        .min_duty  = h->cfg.min_duty,
+        .max_duty  = h->cfg.max_duty,
+    };
+
+    if (h->state == HOPPER_IDLE) {
+#if CONFIG_PM_ENABLE
+        esp_pm_lock_acquire(servo_lock);
+#endif
+        if (h->cfg.release_at_rest) {
+            // Resume the pulses where the servo was left
+            ledc_set_duty(LEDC_LOW_SPEED_MODE, id, motion_get_duty(&h->motion));
+            ledc_update_duty(LEDC_LOW_SPEED_MODE, id);
+        }
+    } else {
+        esp_timer_stop(h->settle_timer);
+    }
+    h->state = HOPPER_RUNNING;
+
+    if (h->cmd.type == ACTUATOR_CMD_FEED) {
+        TRACE_LOGI(TAG, "Hopper %d feeding at PWM %lu for %lu ms", id, (unsigned long)h->cmd.duty,
+                   (unsigned long)h->cmd.hold_ms);
+        motion_start(&h->motion, h->cfg.profile, &ctx);
+        notify(id, ACTUATOR_EVENT_FEED);
+    } else {
+        motion_start(&h->motion, &motion_profile_move, &ctx);
+    }
+}
+
+// Back to idle, letting go of the signal and the PM lock
+static void stop_hopper(int id)
+{
+    hopper_t *h = &hoppers[id];
+
+    if (h->cfg.release_at_rest) {
+        ledc_stop(LEDC_LOW_SPEED_MODE, id, 0);
+    }
+    h->state = HOPPER_IDLE;
+#if CONFIG_PM_ENABLE
+    esp_pm_lock_release(servo_lock);
+#endif
+}
+
+static void finish_command(int id)
+{
+    hopper_t *h = &hoppers[id];
+
+    if (h->cmd.type == ACTUATOR_CMD_FEED) {
+        TRACE_LOGI(TAG, "Hopper %d back at rest position (PWM: %lu)", id,
+                   (unsigned long)motion_get_duty(&h->motion));
+        h->feed_pending = false;
+        notify(id, ACTUATOR_EVENT_RESET);
+    } else {
+        notify(id, ACTUATOR_EVENT_MOVE);
+    }
+
+    if (h->cfg.release_at_rest) {
+        // Let the servo reach the last position before the pulses stop
+        h->state = HOPPER_SETTLING;
+        esp_timer_start_once(h->settle_timer, ACTUATOR_SETTLE_MS * 1000ULL);
+    } else {
+        stop_hopper(id);
+    }
+}
+
+static void settle_timer_callback(void *arg)
+{
+    xTaskNotify(task, SETTLE_BIT((intptr_t)arg), eSetBits);
+}
+
+// The task sleeps until a fade, hold or settle timer of some hopper ends, or
+// a command arrives
+static void actuator_task(void *arg)
+{
+    uint32_t bits;
+
+    while (true) {
+        xTaskNotifyWait(0, UINT32_MAX, &bits, portMAX_DELAY);
+
+        for (int id = 0; id < hopper_count; id++) {
+            hopper_t *h = &hoppers[id];
+
+            if ((bits & HOLD_END_BIT(id)) && h->state == HOPPER_RUNNING && h->cmd.type == ACTUATOR_CMD_FEED) {
+                motion_end_hold(&h->motion);
+            }
+
+            if ((bits & MOTION_BIT(id)) && h->state == HOPPER_RUNNING && motion_advance(&h->motion)) {
+                finish_command(id);
+            }
+
+            // A settle timer stopped by a new command may still have fired
+            if ((bits & SETTLE_BIT(id)) && h->state == HOPPER_SETTLING &&
+                !esp_timer_is_active(h->settle_timer) && uxQueueMessagesWaiting(h->queue) == 0) {
+                stop_hopper(id);
+            }
+
+            if (h->state != HOPPER_RUNNING && xQueueReceive(h->queue, &h->cmd, 0) == pdTRUE) {
+                start_command(id);
+            }
+        }
+    }
+}
+
+esp_err_t actuator_feed(int hopper, uint32_t feed_duty, uint32_t hold_ms)
+{
+    hopper_t *h = get_hopper(hopper);
+    actuator_cmd_t cmd = {
+        .type    = ACTUATOR_CMD_FEED,
+        .duty    = feed_duty,
+        .hold_ms = hold_ms,
+    };
+
+    if (h == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Claim the feed slot first so two callers can't both get through
+    portENTER_CRITICAL(&busy_lock);
+    bool busy = h->feed_pending;
+    h->feed_pending = true;
+    portEXIT_CRITICAL(&busy_lock);
+
+    if (busy) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (send_command(h, &cmd) != ESP_OK) {
+        h->feed_pending = false;
+        return ESP_ERR_TIMEOUT;
+    }
+
+    return ESP_OK;
+}
+
+void actuator_end_hold(int hopper)
+{
+    if (get_hopper(hopper) != NULL) {
+        xTaskNotify(task, HOLD_END_BIT(hopper), eSetBits);
+    }
+}
+
+esp_err_t actuator_move(int hopper, uint32_t duty)
+{
+    hopper_t *h = get_hopper(hopper);
+    actuator_cmd_t cmd = {
+        .type = ACTUATOR_CMD_MOVE,
+        .duty = duty,
+    };
+
+    if (h == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (h->feed_pending) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    return send_command(h, &cmd);
+}
+
+void actuator_set_rest_duty(int hopper, uint32_t duty)
+{
+    hopper_t *h = get_hopper(hopper);
+    if (h != NULL) {
+        h->cfg.rest_duty = duty;
+    }
+}
+
+void actuator_set_motion(int hopper, const motion_profile_t *profile, uint32_t ramp_ms, motion_ease_t ease)
+{
+    hopper_t *h = get_hopper(hopper);
+    if (h == NULL) {
+        return;
+    }
+
+    // Picked up by the next command, a running profile keeps its copy
+    if (profile != NULL) {
+        h->cfg.profile = profile;
+    }
+    h->cfg.ramp_ms = ramp_ms;
+    h->cfg.ease = ease;
+}
+
+int actuator_hopper_count(void)
+{
+    return hopper_count;
+}
+
+bool actuator_is_busy(int hopper)
+{
+    hopper_t *h = get_hopper(hopper);
+    return h != NULL && h->feed_pending;
+}
+
+bool actuator_all_idle(void)
+{
+    for (int id = 0; id < hopper_count; id++) {
+        if (hoppers[id].state != HOPPER_IDLE || uxQueueMessagesWaiting(hoppers[id].queue) > 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t actuator_get_duty(int hopper)
+{
+    hopper_t *h = get_hopper(hopper);
+    return h != NULL ? motion_get_duty(&h->motion) : 0;
+}
+
+uint32_t actuator_get_ramp_ms(int hopper)
+{
+    hopper_t *h = get_hopper(hopper);
+    return h != NULL ? h->cfg.ramp_ms : 0;
+}
+
+const motion_profile_t *actuator_get_profile(int hopper)
+{
+    hopper_t *h = get_hopper(hopper);
+    return h != NULL ? h->cfg.profile : &motion_profile_dispense;
+}
+
+uint32_t actuator_get_queue_depth(void)
+{
+    uint32_t depth = 0;
+    for (int id = 0; id < hopper_count; id++) {
+        depth += uxQueueMessagesWaiting(hoppers[id].queue);
+    }
+    return depth;
+}
+
+uint32_t actuator_get_queue_peak(void)
+{
+    UBaseType_t peak = 0;
+    for (int id = 0; id < hopper_count; id++) {
+        if (hoppers[id].queue_peak > peak) {
+            peak = hoppers[id].queue_peak;
+        }
+    }
+    return peak;
+}
+
+// Configure one hopper's LEDC channel, starting at rest
+static esp_err_t init_hopper(int id, const actuator_config_t *config)
+{
+    hopper_t *h = &hoppers[id];
+
+    h->cfg = *config;
+    if (h->cfg.profile == NULL) {
+        h->cfg.profile = &motion_profile_dispense;
+    }
+    if (h->cfg.rest_duty < h->cfg.min_duty) {
+        h->cfg.rest_duty = h->cfg.min_duty;
+    } else if (h->cfg.rest_duty > h->cfg.max_duty) {
+        h->cfg.rest_duty = h->cfg.max_duty;
+    }
+
+    ledc_channel_config_t ledc_channel = {
+        .channel = id,
+        .duty = h->cfg.rest_duty,
+        .gpio_num = h->cfg.gpio_num,
+        .speed_mode = LEDC_LOW_SPEED_MODE,
+        .timer_sel = SERVO_TIMER,
+    };
+    ESP_ERROR_CHECK(ledc_channel_config(&ledc_channel));
+
+    h->queue = xQueueCreateStatic(ACTUATOR_QUEUE_LEN, sizeof(actuator_cmd_t), h->queue_storage, &h->queue_buffer);
+    const esp_timer_create_args_t settle_args = {
+        .callback = settle_timer_callback,
+        .arg = (void *)(intptr_t)id,
+        .name = "servo_settle",
+    };
+    esp_err_t err = esp_timer_create(&settle_args, &h->settle_timer);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    h->state = HOPPER_IDLE;
+    if (h->cfg.release_at_rest) {
+        // Give the servo time to reach rest after power-up, then let go
+#if CONFIG_PM_ENABLE
+        esp_pm_lock_acquire(servo_lock);
+#endif
+        h->state = HOPPER_SETTLING;
+        esp_timer_start_once(h->settle_timer, ACTUATOR_SETTLE_MS * 1000ULL);
+    }
+
+    return motion_init(&h->motion, LEDC_LOW_SPEED_MODE, id, h->cfg.rest_duty, task, MOTION_BIT(id));
+}
+
+esp_err_t actuator_init(const actuator_config_t *configs, int count, actuator_event_cb_t cb, int core_id)
+{
+    if (count < 1 || count > ACTUATOR_MAX_HOPPERS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    event_cb = cb;
+
+    // All channels share one LEDC timer. With power management the APB
+    // clock follows the CPU frequency, so run from the fixed 1 MHz REF_TICK
+    // instead (20000 counts per period, enough for 13 bits).
+    ledc_timer_config_t ledc_timer = {
+        .duty_resolution = SERVO_RESOLUTION,
+        .freq_hz = SERVO_FREQUENCY,
+        .speed_mode = LEDC_LOW_SPEED_MODE,
+        .timer_num = SERVO_TIMER,
+#if CONFIG_PM_ENABLE
+        .clk_cfg = LEDC_USE_REF_TICK,
+#else
+        .clk_cfg = LEDC_AUTO_CLK,
+#endif
+    };
+    ESP_ERROR_CHECK(ledc_timer_config(&ledc_timer));
+
+#if CONFIG_PM_ENABLE
+    esp_err_t err = esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "servo", &servo_lock);
+    if (err != ESP_OK) {
+        return err;
+    }
+#endif
+
+    // The task blocks on its first notification wait, so starting it before
+    // the hoppers exist is safe
+    task = xTaskCreateStaticPinnedToCore(actuator_task, "actuator", ACTUATOR_TASK_STACK, NULL,
+                                         ACTUATOR_TASK_PRIORITY, task_stack, &task_buffer, core_id);
+
+    for (int id = 0; id < count; id++) {
+        esp_err_t ret = init_hopper(id, &configs[id]);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        hopper_count = id + 1;
+    }
+
+    ESP_LOGI(TAG, "%d hopper(s) ready", hopper_count);
+    return ESP_OK;
+}
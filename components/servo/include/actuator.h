@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "driver/ledc.h"
+#include "motion.h"
+
+#define SERVO_TIMER         LEDC_TIMER_0
+#define SERVO_FREQUENCY     50          // 50Hz for servo control
+#define SERVO_RESOLUTION    LEDC_TIMER_13_BIT
+
+#define ACTUATOR_MAX_HOPPERS    8       // One LEDC channel each, all sharing SERVO_TIMER
+#define ACTUATOR_QUEUE_LEN      4       // Per hopper
+#define ACTUATOR_TASK_STACK     3072
+#define ACTUATOR_TASK_PRIORITY  6       // Above httpd so motion is never stuck behind a response
+#define ACTUATOR_RAMP_MS        400     // Default ramp time between positions
+#define ACTUATOR_SETTLE_MS      300     // Signal kept after the last fade when released at rest
+
+// State changes reported from the actuator task
+typedef enum {
+    ACTUATOR_EVENT_FEED,        // Servo moved to the feed position
+    ACTUATOR_EVENT_MOVE,        // Servo moved on request
+    ACTUATOR_EVENT_RESET,       // Feed finished, servo back at rest
+} actuator_event_t;
+
+// Called on the actuator task; must not block for long
+typedef void (*actuator_event_cb_t)(int hopper, actuator_event_t event, uint32_t duty);
+
+// One hopper's servo
+typedef struct {
+    int gpio_num;
+    uint32_t rest_duty;         // Position held between feeds
+    uint32_t min_duty;          // Requested duties are clamped to this range
+    uint32_t max_duty;
+    uint32_t ramp_ms;           // Fade time per move, 0 jumps straight to the target
+    motion_ease_t ease;
+    const motion_profile_t *profile;    // Feed sequence, NULL for motion_profile_dispense
+    bool release_at_rest;       // Switch the signal off when idle so the chip can light sleep
+} actuator_config_t;
+
+// Configure one LEDC channel per hopper (hopper i on LEDC channel i) and
+// start the actuator task, which drives all of them, pinned to core_id
+// (tskNO_AFFINITY to let the scheduler pick)
+esp_err_t actuator_init(const actuator_config_t *hoppers, int count, actuator_event_cb_t event_cb, int core_id);
+
+int actuator_hopper_count(void);
+
+// Queue a feed: run the feed profile around feed_duty, holding for hold_ms.
+// Never blocks. Returns ESP_ERR_INVALID_STATE while another feed on the same
+// hopper is queued or running, ESP_ERR_TIMEOUT if its command queue is full
+// and ESP_ERR_INVALID_ARG for an unknown hopper. Hoppers feed independently.
+esp_err_t actuator_feed(int hopper, uint32_t feed_duty, uint32_t hold_ms);
+
+// End a running feed's hold early, e.g. once the portion is dispensed. The
+// servo returns to rest as if the hold had timed out. Callable from any task.
+void actuator_end_hold(int hopper);
+
+// Queue a plain move. Refused with ESP_ERR_INVALID_STATE during a feed.
+esp_err_t actuator_move(int hopper, uint32_t duty);
+
+// Change the position the servo returns to after a feed
+void actuator_set_rest_duty(int hopper, uint32_t duty);
+
+// Change the feed profile (NULL keeps the current one), ramp time and easing
+void actuator_set_motion(int hopper, const motion_profile_t *profile, uint32_t ramp_ms, motion_ease_t ease);
+
+uint32_t actuator_get_ramp_ms(int hopper);
+const motion_profile_t *actuator_get_profile(int hopper);
+
+// True from the moment a feed is accepted until the servo is back at rest
+bool actuator_is_busy(int hopper);
+
+// True when no hopper has a command queued, running or settling
+bool actuator_all_idle(void);
+
+// Duty the servo is at, or fading towards
+uint32_t actuator_get_duty(int hopper);
+
+// Commands waiting in all queues now, and the most one queue has ever held
+uint32_t actuator_get_queue_depth(void);
+uint32_t actuator_get_queue_peak(void);
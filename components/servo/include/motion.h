@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "driver/ledc.h"
+
+#define MOTION_SEGMENTS         4       // Linear fade pieces used to approximate an easing curve
+#define MOTION_HOLD_FEED        0xFFFF  // Step hold_ms placeholder for the requested feed time
+#define MOTION_RAMP_DEFAULT     0xFFFF  // Step ramp_ms placeholder for the configured ramp time
+#define MOTION_AGITATE_OFFSET   40      // Duty counts either side of the feed position
+
+typedef enum {
+    MOTION_EASE_LINEAR,
+    MOTION_EASE_IN,             // Slow start - gentle on the supply
+    MOTION_EASE_OUT,            // Slow stop - avoids slamming the end position
+    MOTION_EASE_IN_OUT,
+} motion_ease_t;
+
+// Where a step is heading
+typedef enum {
+    MOTION_TARGET_REST,
+    MOTION_TARGET_FEED,
+    MOTION_TARGET_MOVE,         // Duty given in motion_context_t.move_duty
+} motion_target_t;
+
+typedef struct {
+    motion_target_t target;
+    int16_t offset;             // Duty counts added to the target
+    uint16_t ramp_ms;           // Time to reach the target, or MOTION_RAMP_DEFAULT
+    uint16_t hold_ms;           // Dwell after arriving, or MOTION_HOLD_FEED
+    motion_ease_t ease;         // Ignored for MOTION_RAMP_DEFAULT steps, which use the configured curve
+} motion_step_t;
+
+typedef struct {
+    const char *name;
+    const motion_step_t *steps;
+    size_t count;
+} motion_profile_t;
+
+// Positions and timings a profile is resolved against when it starts
+typedef struct {
+    uint32_t rest_duty;
+    uint32_t feed_duty;
+    uint32_t move_duty;
+    uint32_t hold_ms;
+    uint32_t ramp_ms;
+    motion_ease_t ease;
+    uint32_t min_duty;          // Resolved targets are clamped to this range
+    uint32_t max_duty;
+} motion_context_t;
+
+// One servo channel. Fields are private to motion.c; the running profile
+// state is only touched by the owner task.
+typedef struct {
+    ledc_mode_t mode;
+    ledc_channel_t chan;
+    TaskHandle_t owner;
+    uint32_t notify_bits;       // Set on the owner task when a fade or hold ends
+    esp_timer_handle_t hold_timer;  // One-shot, microsecond resolution
+    const motion_profile_t *profile;
+    motion_context_t ctx;
+    size_t step_index;
+    int segment;                // 0..MOTION_SEGMENTS-1 fading, MOTION_SEGMENTS holding
+    uint32_t step_from;
+    uint32_t step_to;
+    uint32_t segment_ms;
+    volatile uint32_t current_duty;
+} motion_t;
+
+// Built-in sequences
+extern const motion_profile_t motion_profile_dispense;  // Ramp to feed, hold, ramp back
+extern const motion_profile_t motion_profile_agitate;   // Shake around the feed position first
+extern const motion_profile_t motion_profile_move;      // Single ramp to move_duty
+
+// Install the LEDC fade service on the channel. Every completed fade or
+// hold sets notify_bits on owner_task (eSetBits), so one task can drive
+// several channels; the task then calls motion_advance().
+esp_err_t motion_init(motion_t *m, ledc_mode_t speed_mode, ledc_channel_t channel,
+                      uint32_t initial_duty, TaskHandle_t owner_task, uint32_t notify_bits);
+
+// Begin a profile from the current position
+void motion_start(motion_t *m, const motion_profile_t *profile, const motion_context_t *ctx);
+
+// Program the next fade segment or hold. Returns true once the profile has
+// finished.
+bool motion_advance(motion_t *m);
+
+// Cut the feed hold short: a running MOTION_HOLD_FEED dwell ends now and
+// later ones in the profile are skipped. Owner task only.
+void motion_end_hold(motion_t *m);
+
+// True while a profile is running
+bool motion_active(const motion_t *m);
+
+// Duty the channel is at, or heading to within the current segment
+uint32_t motion_get_duty(const motion_t *m);
+
+// Look up a built-in profile by name, NULL if unknown
+const motion_profile_t *motion_find_profile(const char *name);
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "actuator.h"
+
+// Pulse range of the servo model, mapped onto 0..180 degrees
+#define SERVO_PULSE_MIN_US      500
+#define SERVO_PULSE_MAX_US      2500
+#define SERVO_MAX_ANGLE         180
+
+// Exact integer duty for a pulse width at the configured LEDC timer, rounded
+// to the nearest count - usable in constant expressions
+#define SERVO_US_TO_DUTY(us) \
+    ((uint32_t)(((uint64_t)(us) * (1ULL << SERVO_RESOLUTION) * SERVO_FREQUENCY + 500000) / 1000000))
+
+// Untrimmed duty for an angle, also a constant expression
+#define SERVO_ANGLE_TO_DUTY(deg) \
+    ((uint32_t)((((uint64_t)SERVO_PULSE_MIN_US * SERVO_MAX_ANGLE + \
+                  (uint64_t)(SERVO_PULSE_MAX_US - SERVO_PULSE_MIN_US) * (deg)) * \
+                 (1ULL << SERVO_RESOLUTION) * SERVO_FREQUENCY + SERVO_MAX_ANGLE * 500000ULL) / \
+                (SERVO_MAX_ANGLE * 1000000ULL)))
+
+// Per-device correction, stored in NVS and shared by all hoppers
+typedef struct {
+    int16_t offset;             // Duty counts added to every angle
+    uint16_t span_permille;     // Scale of the travel around 90 degrees, 1000 = nominal
+    uint8_t min_angle;          // Mechanical limits of this feeder
+    uint8_t max_angle;
+} servo_trim_t;
+
+// Load the trim from NVS, falling back to no correction
+esp_err_t servo_cal_init(void);
+
+// Replace the trim and persist it
+esp_err_t servo_cal_set_trim(const servo_trim_t *trim);
+
+const servo_trim_t *servo_cal_get_trim(void);
+
+// Trimmed duty for an angle: one table lookup plus integer math
+uint32_t servo_angle_to_duty(uint32_t degrees);
+
+// Queue a move to an angle, alongside the raw-duty actuator_move()
+esp_err_t servo_set_angle(int hopper, uint32_t degrees);
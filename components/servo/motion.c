@@ -0,0 +1,258 @@
+#include <string.h>
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "motion.h"
+
+#define AGITATE_RAMP_MS     120
+
+static const char *TAG = "motion";
+
+// Progress (permille) at the end of each fade segment, per easing curve
+static const uint16_t ease_table[][MOTION_SEGMENTS] = {
+    [MOTION_EASE_LINEAR] = { 250, 500, 750, 1000 },
+    [MOTION_EASE_IN]     = {  63, 250, 563, 1000 },    // t^2
+    [MOTION_EASE_OUT]    = { 438, 750, 938, 1000 },    // 1 - (1 - t)^2
+    [MOTION_EASE_IN_OUT] = { 156, 500, 844, 1000 },    // 3t^2 - 2t^3
+};
+
+static const motion_step_t dispense_steps[] = {
+    { MOTION_TARGET_FEED, 0, MOTION_RAMP_DEFAULT, MOTION_HOLD_FEED, MOTION_EASE_IN_OUT },
+    { MOTION_TARGET_REST, 0, MOTION_RAMP_DEFAULT, 0,                MOTION_EASE_IN_OUT },
+};
+
+static const motion_step_t agitate_steps[] = {
+    { MOTION_TARGET_FEED, 0,                      MOTION_RAMP_DEFAULT, 0,                MOTION_EASE_IN_OUT },
+    { MOTION_TARGET_FEED, -MOTION_AGITATE_OFFSET, AGITATE_RAMP_MS,     0,                MOTION_EASE_LINEAR },
+    { MOTION_TARGET_FEED, MOTION_AGITATE_OFFSET,  AGITATE_RAMP_MS * 2, 0,                MOTION_EASE_LINEAR },
+    { MOTION_TARGET_FEED, -MOTION_AGITATE_OFFSET, AGITATE_RAMP_MS * 2, 0,                MOTION_EASE_LINEAR },
+    { MOTION_TARGET_FEED, 0,                      AGITATE_RAMP_MS,     MOTION_HOLD_FEED, MOTION_EASE_LINEAR },
+    { MOTION_TARGET_REST, 0,                      MOTION_RAMP_DEFAULT, 0,                MOTION_EASE_IN_OUT },
+};
+
+static const motion_step_t move_steps[] = {
+    { MOTION_TARGET_MOVE, 0, MOTION_RAMP_DEFAULT, 0, MOTION_EASE_IN_OUT },
+};
+
+const motion_profile_t motion_profile_dispense = { "dispense", dispense_steps, sizeof(dispense_steps) / sizeof(dispense_steps[0]) };
+const motion_profile_t motion_profile_agitate  = { "agitate",  agitate_steps,  sizeof(agitate_steps) / sizeof(agitate_steps[0]) };
+const motion_profile_t motion_profile_move     = { "move",     move_steps,     sizeof(move_steps) / sizeof(move_steps[0]) };
+
+// Fade-end interrupt: the hardware finished a segment, wake the owner task
+static IRAM_ATTR bool fade_end_cb(const ledc_cb_param_t *param, void *user_arg)
+{
+    motion_t *m = user_arg;
+    BaseType_t woken = pdFALSE;
+
+    if (param->event == LEDC_FADE_END_EVT) {
+        xTaskNotifyFromISR(m->owner, m->notify_bits, eSetBits, &woken);
+    }
+    return woken == pdTRUE;
+}
+
+static void wake_owner(motion_t *m)
+{
+    xTaskNotify(m->owner, m->notify_bits, eSetBits);
+}
+
+// Runs on the esp_timer task, so the hold ends on time whatever the tick rate
+static void hold_timer_callback(void *arg)
+{
+    wake_owner(arg);
+}
+
+static uint32_t resolve_target(const motion_t *m, const motion_step_t *step)
+{
+    int32_t duty;
+
+    switch (step->target) {
+    case MOTION_TARGET_FEED:
+        duty = m->ctx.feed_duty;
+        break;
+    case MOTION_TARGET_MOVE:
+        duty = m->ctx.move_duty;
+        break;
+    default:
+        duty = m->ctx.rest_duty;
+        break;
+    }
+
+    duty += step->offset;
+    if (duty < (int32_t)m->ctx.min_duty) {
+        duty = m->ctx.min_duty;
+    } else if (duty > (int32_t)m->ctx.max_duty) {
+        duty = m->ctx.max_duty;
+    }
+    return duty;
+}
+
+// Write a duty directly and signal completion ourselves - used when there
+// is nothing to fade, since the hardware raises no end event for that
+static void jump_to(motion_t *m, uint32_t duty)
+{
+    ledc_set_duty(m->mode, m->chan, duty);
+    ledc_update_duty(m->mode, m->chan);
+    m->current_duty = duty;
+    wake_owner(m);
+}
+
+static void begin_step(motion_t *m)
+{
+    const motion_step_t *step = &m->profile->steps[m->step_index];
+    uint32_t ramp = step->ramp_ms == MOTION_RAMP_DEFAULT ? m->ctx.ramp_ms : step->ramp_ms;
+
+    m->step_from = m->current_duty;
+    m->step_to = resolve_target(m, step);
+    m->segment_ms = ramp / MOTION_SEGMENTS;
+    m->segment = 0;
+}
+
+// Start fade segment m->segment of the current step
+static void start_segment(motion_t *m)
+{
+    const motion_step_t *step = &m->profile->steps[m->step_index];
+    motion_ease_t ease = step->ramp_ms == MOTION_RAMP_DEFAULT ? m->ctx.ease : step->ease;
+    int32_t delta = (int32_t)m->step_to - (int32_t)m->step_from;
+    uint32_t target = (int32_t)m->step_from + delta * ease_table[ease][m->segment] / 1000;
+
+    if (m->segment_ms == 0) {
+        // No ramp requested - collapse the step into one jump
+        m->segment = MOTION_SEGMENTS - 1;
+        jump_to(m, m->step_to);
+        return;
+    }
+    if (target == m->current_duty) {
+        // Curve too flat here to move a single count, skip the segment
+        wake_owner(m);
+        return;
+    }
+
+    if (ledc_set_fade_with_time(m->mode, m->chan, target, m->segment_ms) != ESP_OK ||
+        ledc_fade_start(m->mode, m->chan, LEDC_FADE_NO_WAIT) != ESP_OK) {
+        ESP_LOGW(TAG, "Fade failed, jumping to %lu", (unsigned long)target);
+        jump_to(m, target);
+        return;
+    }
+    m->current_duty = target;
+}
+
+void motion_start(motion_t *m, const motion_profile_t *p, const motion_context_t *c)
+{
+    esp_timer_stop(m->hold_timer);
+    m->profile = p;
+    m->ctx = *c;
+    m->step_index = 0;
+
+    begin_step(m);
+    start_segment(m);
+}
+
+bool motion_advance(motion_t *m)
+{
+    if (m->profile == NULL) {
+        return true;
+    }
+
+    const motion_step_t *step = &m->profile->steps[m->step_index];
+
+    if (m->segment < MOTION_SEGMENTS - 1) {
+        m->segment++;
+        start_segment(m);
+        return false;
+    }
+
+    if (m->segment == MOTION_SEGMENTS - 1) {
+        // Arrived - dwell if the step asks for it
+        uint32_t hold = step->hold_ms == MOTION_HOLD_FEED ? m->ctx.hold_ms : step->hold_ms;
+        m->segment = MOTION_SEGMENTS;
+        if (hold > 0) {
+            ESP_ERROR_CHECK(esp_timer_start_once(m->hold_timer, (uint64_t)hold * 1000));
+            return false;
+        }
+    }
+
+    if (++m->step_index >= m->profile->count) {
+        m->profile = NULL;
+        return true;
+    }
+
+    begin_step(m);
+    start_segment(m);
+    return false;
+}
+
+void motion_end_hold(motion_t *m)
+{
+    if (m->profile == NULL) {
+        return;
+    }
+    m->ctx.hold_ms = 0;
+
+    // A timer that already fired has woken the owner itself
+    const motion_step_t *step = &m->profile->steps[m->step_index];
+    if (m->segment == MOTION_SEGMENTS && step->hold_ms == MOTION_HOLD_FEED &&
+        esp_timer_stop(m->hold_timer) == ESP_OK) {
+        wake_owner(m);
+    }
+}
+
+bool motion_active(const motion_t *m)
+{
+    return m->profile != NULL;
+}
+
+uint32_t motion_get_duty(const motion_t *m)
+{
+    return m->current_duty;
+}
+
+const motion_profile_t *motion_find_profile(const char *name)
+{
+    static const motion_profile_t *const profiles[] = {
+        &motion_profile_dispense,
+        &motion_profile_agitate,
+    };
+
+    for (size_t i = 0; i < sizeof(profiles) / sizeof(profiles[0]); i++) {
+        if (strcmp(profiles[i]->name, name) == 0) {
+            return profiles[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t motion_init(motion_t *m, ledc_mode_t speed_mode, ledc_channel_t channel,
+                      uint32_t initial_duty, TaskHandle_t owner_task, uint32_t notify_bits)
+{
+    static bool fade_installed = false;
+
+    m->mode = speed_mode;
+    m->chan = channel;
+    m->owner = owner_task;
+    m->notify_bits = notify_bits;
+    m->profile = NULL;
+    m->current_duty = initial_duty;
+
+    const esp_timer_create_args_t hold_args = {
+        .callback = hold_timer_callback,
+        .arg = m,
+        .name = "motion_hold",
+    };
+    esp_err_t err = esp_timer_create(&hold_args, &m->hold_timer);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // One fade service serves every channel
+    if (!fade_installed) {
+        err = ledc_fade_func_install(0);
+        if (err != ESP_OK) {
+            return err;
+        }
+        fade_installed = true;
+    }
+
+    ledc_cbs_t cbs = {
+        .fade_cb = fade_end_cb,
+    };
+    return ledc_cb_register(m->mode, m->chan, &cbs, m);
+}
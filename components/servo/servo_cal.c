@@ -0,0 +1,116 @@
+#include "esp_log.h"
+#include "nvs.h"
+#include "servo_cal.h"
+
+#define SERVO_CAL_NAMESPACE     "servo_cal"
+#define SERVO_CAL_KEY           "trim"
+
+#define LUT_1(a)    SERVO_ANGLE_TO_DUTY(a),
+#define LUT_10(a)   LUT_1(a) LUT_1(a + 1) LUT_1(a + 2) LUT_1(a + 3) LUT_1(a + 4) \
+                    LUT_1(a + 5) LUT_1(a + 6) LUT_1(a + 7) LUT_1(a + 8) LUT_1(a + 9)
+
+// Angle to duty for the current resolution and frequency, built by the compiler
+static const uint16_t angle_lut[SERVO_MAX_ANGLE + 1] = {
+    LUT_10(0)   LUT_10(10)  LUT_10(20)  LUT_10(30)  LUT_10(40)  LUT_10(50)
+    LUT_10(60)  LUT_10(70)  LUT_10(80)  LUT_10(90)  LUT_10(100) LUT_10(110)
+    LUT_10(120) LUT_10(130) LUT_10(140) LUT_10(150) LUT_10(160) LUT_10(170)
+    LUT_1(180)
+};
+
+_Static_assert(SERVO_ANGLE_TO_DUTY(SERVO_MAX_ANGLE) <= UINT16_MAX,
+               "servo duty table needs a wider type at this resolution");
+_Static_assert(SERVO_ANGLE_TO_DUTY(SERVO_MAX_ANGLE) < (1ULL << SERVO_RESOLUTION),
+               "servo pulse range does not fit the LEDC period");
+
+static const char *TAG = "servo_cal";
+
+static servo_trim_t trim = {
+    .offset        = 0,
+    .span_permille = 1000,
+    .min_angle     = 0,
+    .max_angle     = SERVO_MAX_ANGLE,
+};
+
+static bool trim_valid(const servo_trim_t *t)
+{
+    return t->span_permille >= 500 && t->span_permille <= 1500 &&
+           t->min_angle < t->max_angle && t->max_angle <= SERVO_MAX_ANGLE;
+}
+
+uint32_t servo_angle_to_duty(uint32_t degrees)
+{
+    if (degrees < trim.min_angle) {
+        degrees = trim.min_angle;
+    } else if (degrees > trim.max_angle) {
+        degrees = trim.max_angle;
+    }
+
+    int32_t center = angle_lut[SERVO_MAX_ANGLE / 2];
+    int32_t duty = center + ((int32_t)angle_lut[degrees] - center) * trim.span_permille / 1000 + trim.offset;
+
+    return duty > 0 ? duty : 0;
+}
+
+esp_err_t servo_set_angle(int hopper, uint32_t degrees)
+{
+    return actuator_move(hopper, servo_angle_to_duty(degrees));
+}
+
+const servo_trim_t *servo_cal_get_trim(void)
+{
+    return &trim;
+}
+
+esp_err_t servo_cal_set_trim(const servo_trim_t *t)
+{
+    if (!trim_valid(t)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(SERVO_CAL_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    err = nvs_set_blob(nvs, SERVO_CAL_KEY, t, sizeof(*t));
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+
+    if (err == ESP_OK) {
+        trim = *t;
+        ESP_LOGI(TAG, "Trim set: offset %d, span %u, angles %u-%u", trim.offset,
+                 trim.span_permille, trim.min_angle, trim.max_angle);
+    }
+    return err;
+}
+
+esp_err_t servo_cal_init(void)
+{
+    nvs_handle_t nvs;
+    servo_trim_t stored;
+    size_t len = sizeof(stored);
+
+    ESP_LOGI(TAG, "Pulse %d-%d us = duty %lu-%lu at %d bit / %d Hz", SERVO_PULSE_MIN_US, SERVO_PULSE_MAX_US,
+             (unsigned long)angle_lut[0], (unsigned long)angle_lut[SERVO_MAX_ANGLE], SERVO_RESOLUTION, SERVO_FREQUENCY);
+
+    esp_err_t err = nvs_open(SERVO_CAL_NAMESPACE, NVS_READONLY, &nvs);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        return ESP_OK;          // Never calibrated
+    } else if (err != ESP_OK) {
+        return err;
+    }
+
+    err = nvs_get_blob(nvs, SERVO_CAL_KEY, &stored, &len);
+    nvs_close(nvs);
+
+    if (err == ESP_OK && len == sizeof(stored) && trim_valid(&stored)) {
+        trim = stored;
+        ESP_LOGI(TAG, "Loaded trim: offset %d, span %u", trim.offset, trim.span_permille);
+    } else if (err != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGW(TAG, "Ignoring stored trim (%s)", esp_err_to_name(err));
+    }
+    return ESP_OK;
+}
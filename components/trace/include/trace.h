@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_log.h"
+
+#define TRACE_RING_LEN          32      // Records waiting for the trace task; a power of two
+#define TRACE_HISTORY_LEN       32      // Records kept for trace_read(); a power of two
+#define TRACE_MAX_ARGS          3
+#define TRACE_LINE_LEN          128     // One formatted message
+#define TRACE_TASK_STACK        3072
+#define TRACE_TASK_PRIORITY     1       // Only ever runs when nothing else wants the CPU
+
+// What a call site logs; one per TRACE_LOG() in flash
+typedef struct {
+    esp_log_level_t level;
+    const char *fmt;
+} trace_event_t;
+
+// One message, unformatted; 32 bytes on the ESP32
+typedef struct {
+    int64_t time_us;            // esp_timer_get_time() when it was written
+    uint32_t seq;               // Increases by one per record taken into the ring
+    const char *tag;
+    const trace_event_t *event;
+    uint32_t args[TRACE_MAX_ARGS];
+} trace_record_t;
+
+// Log like ESP_LOGx, for paths where the time a log line takes matters: the
+// record goes into a lock-free ring in about a microsecond and is formatted
+// later by the trace task. Up to TRACE_MAX_ARGS integer arguments (no %s,
+// %f or 64-bit values); tag must outlive the record, like the usual static
+// TAG. Safe from any task or timer callback, not from an ISR.
+#define TRACE_LOG(level, tag, fmt, ...) do {                                        \
+        if ((level) <= LOG_LOCAL_LEVEL) {                                           \
+            static const trace_event_t trace_event_ = { (level), (fmt) };           \
+            if (0) {                                                                \
+                trace_check_format_(fmt, ##__VA_ARGS__);                            \
+            }                                                                       \
+            trace_write(tag, &trace_event_, (const uint32_t[TRACE_MAX_ARGS]) { __VA_ARGS__ }); \
+        }                                                                           \
+    } while (0)
+
+#define TRACE_LOGW(tag, fmt, ...)   TRACE_LOG(ESP_LOG_WARN, tag, fmt, ##__VA_ARGS__)
+#define TRACE_LOGI(tag, fmt, ...)   TRACE_LOG(ESP_LOG_INFO, tag, fmt, ##__VA_ARGS__)
+#define TRACE_LOGD(tag, fmt, ...)   TRACE_LOG(ESP_LOG_DEBUG, tag, fmt, ##__VA_ARGS__)
+
+// Start the trace task, pinned to core_id. It prints every record through
+// esp_log_write(), with the time it was written, and keeps the last
+// TRACE_HISTORY_LEN. Until then records are printed straight away.
+esp_err_t trace_start(int core_id);
+
+// Records at or after seq, oldest first, copied to out. Returns how many;
+// those printed longest ago are gone.
+int trace_read(uint32_t seq, trace_record_t *out, int max);
+
+// The message of a record, without the level, time and tag
+int trace_format(const trace_record_t *record, char *buf, size_t size);
+
+// Records written but not printed yet, e.g. to wait for before deep sleep
+bool trace_pending(void);
+
+// Records lost because the ring was full
+uint32_t trace_get_dropped(void);
+
+// The letter ESP_LOGx prints for a level, e.g. 'I'
+char trace_level_char(esp_log_level_t level);
+
+// Use TRACE_LOG() instead
+void trace_write(const char *tag, const trace_event_t *event, const uint32_t *args);
+static inline void __attribute__((format(printf, 1, 2))) trace_check_format_(const char *fmt, ...)
+{
+}
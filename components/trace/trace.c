@@ -0,0 +1,201 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "trace.h"
+
+#define RING_MASK       (TRACE_RING_LEN - 1)
+#define HISTORY_MASK    (TRACE_HISTORY_LEN - 1)
+
+_Static_assert((TRACE_RING_LEN & RING_MASK) == 0, "TRACE_RING_LEN must be a power of two");
+_Static_assert((TRACE_HISTORY_LEN & HISTORY_MASK) == 0, "TRACE_HISTORY_LEN must be a power of two");
+
+// turn says who a slot belongs to, relative to the first position of the
+// lap it is in: 0 free for a writer, 1 written and waiting for the trace
+// task, which hands it to the next lap with TRACE_RING_LEN. Zeroed memory
+// is an empty ring.
+typedef struct {
+    atomic_uint_fast32_t turn;
+    trace_record_t record;
+} slot_t;
+
+static const char *TAG = "trace";
+
+// Any number of writers claim positions with a compare-and-swap on head;
+// the trace task is the only reader
+static slot_t ring[TRACE_RING_LEN];
+static atomic_uint_fast32_t head = 0;
+static atomic_uint_fast32_t dropped = 0;
+static atomic_bool idle = false;            // The trace task waits for a notification
+static TaskHandle_t task = NULL;
+static StaticTask_t task_buffer;
+static StackType_t task_stack[TRACE_TASK_STACK];
+static uint32_t tail = 0;                   // Trace task only
+
+// Printed records, filled by the trace task in seq order
+static trace_record_t history[TRACE_HISTORY_LEN];
+static uint32_t history_next = 0;           // seq after the newest
+static uint32_t history_count = 0;
+static portMUX_TYPE history_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t lap(uint32_t pos)
+{
+    return pos & ~(uint32_t)RING_MASK;
+}
+
+int trace_format(const trace_record_t *record, char *buf, size_t size)
+{
+    // unsigned long is as wide as int and long on the ESP32; the format
+    // decides how each argument is read
+    return snprintf(buf, size, record->event->fmt, (unsigned long)record->args[0],
+                    (unsigned long)record->args[1], (unsigned long)record->args[2]);
+}
+
+char trace_level_char(esp_log_level_t level)
+{
+    return "NEWIDV"[level];
+}
+
+static void print(const trace_record_t *record)
+{
+    char line[TRACE_LINE_LEN];
+    esp_log_level_t level = record->event->level;
+
+    trace_format(record, line, sizeof(line));
+    esp_log_write(level, record->tag, "%c (%lu) %s: %s\n", trace_level_char(level),
+                  (unsigned long)(record->time_us / 1000), record->tag, line);
+}
+
+void trace_write(const char *tag, const trace_event_t *event, const uint32_t *args)
+{
+    trace_record_t record = {
+        .time_us = esp_timer_get_time(),
+        .tag     = tag,
+        .event   = event,
+        .args    = { args[0], args[1], args[2] },
+    };
+
+    if (task == NULL) {
+        print(&record);
+        return;
+    }
+
+    uint_fast32_t pos = atomic_load_explicit(&head, memory_order_relaxed);
+    slot_t *s;
+    while (true) {
+        s = &ring[pos & RING_MASK];
+        uint32_t turn = atomic_load_explicit(&s->turn, memory_order_acquire);
+        int32_t behind = (int32_t)(turn - lap(pos));
+        if (behind == 0) {
+            if (atomic_compare_exchange_weak_explicit(&head, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (behind < 0) {
+            // Still holds a record from the last lap
+            atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+            return;
+        } else {
+            pos = atomic_load_explicit(&head, memory_order_relaxed);
+        }
+    }
+
+    record.seq = pos;
+    s->record = record;
+    atomic_store(&s->turn, lap(pos) + 1);
+    // Pairs with the trace task setting idle before it looks at the ring once more
+    if (atomic_exchange(&idle, false)) {
+        xTaskNotifyGive(task);
+    }
+}
+
+static bool take(trace_record_t *out)
+{
+    slot_t *s = &ring[tail & RING_MASK];
+
+    if (atomic_load(&s->turn) != lap(tail) + 1) {
+        return false;
+    }
+    *out = s->record;
+    atomic_store_explicit(&s->turn, lap(tail) + TRACE_RING_LEN, memory_order_release);
+    tail++;
+    return true;
+}
+
+static void keep(const trace_record_t *record)
+{
+    portENTER_CRITICAL(&history_lock);
+    history[record->seq & HISTORY_MASK] = *record;
+    history_next = record->seq + 1;
+    if (history_count < TRACE_HISTORY_LEN) {
+        history_count++;
+    }
+    portEXIT_CRITICAL(&history_lock);
+}
+
+// Drain the ring, then sleep until a writer finds the task idle
+static void trace_task(void *arg)
+{
+    uint32_t reported = 0;
+
+    while (true) {
+        trace_record_t record;
+        if (!take(&record)) {
+            uint32_t lost = atomic_load_explicit(&dropped, memory_order_relaxed);
+            if (lost != reported) {
+                ESP_LOGW(TAG, "Ring full, %lu records dropped", (unsigned long)(lost - reported));
+                reported = lost;
+            }
+            atomic_store(&idle, true);
+            if (!take(&record)) {
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+                continue;
+            }
+            atomic_store(&idle, false);
+        }
+        print(&record);
+        keep(&record);
+    }
+}
+
+esp_err_t trace_start(int core_id)
+{
+    if (task != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    task = xTaskCreateStaticPinnedToCore(trace_task, "trace", TRACE_TASK_STACK, NULL, TRACE_TASK_PRIORITY,
+                                         task_stack, &task_buffer, core_id);
+    return task != NULL ? ESP_OK : ESP_FAIL;
+}
+
+int trace_read(uint32_t seq, trace_record_t *out, int max)
+{
+    int count = 0;
+
+    portENTER_CRITICAL(&history_lock);
+    uint32_t first = history_next - history_count;
+    if ((int32_t)(seq - first) < 0) {
+        seq = first;
+    }
+    while (count < max && (int32_t)(history_next - seq) > 0) {
+        out[count++] = history[seq & HISTORY_MASK];
+        seq++;
+    }
+    portEXIT_CRITICAL(&history_lock);
+    return count;
+}
+
+bool trace_pending(void)
+{
+    portENTER_CRITICAL(&history_lock);
+    uint32_t printed = history_next;
+    portEXIT_CRITICAL(&history_lock);
+    return (uint32_t)atomic_load(&head) != printed;
+}
+
+uint32_t trace_get_dropped(void)
+{
+    return atomic_load_explicit(&dropped, memory_order_relaxed);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Every result is a cost (time per operation, per request, per simulated
+// day), so a larger value than the baseline is a regression.
+
+// Monotonic host clock
+uint64_t bench_now_ns(void);
+
+// Record a result of the running suite
+void bench_report(const char *name, double value, const char *unit);
+
+// Check an invariant of the simulation; a failure fails the suite
+bool bench_expect(bool ok, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+// Set by --quick: smaller tables and fewer simulated days
+extern bool bench_quick;
+
+// Suites, each run in a process of its own since the components keep their
+// state in statics. arg selects a variant, e.g. the schedule table size.
+void bench_scheduler(int rules);
+void bench_scheduler_wake(int arg);
+void bench_json(int arg);
+void bench_feeding(int arg);
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+#include "actuator.h"
+#include "servo_cal.h"
+#include "scheduler.h"
+#include "sim.h"
+#include "bench.h"
+
+#define HOPPERS             4
+#define DAYS                30
+#define QUICK_DAYS          7
+#define AUTO_FEED_MINUTES   240
+#define AUTO_FEED_HOLD_MS   2000
+#define DEFAULT_HOLD_MS     5000
+#define REST_DUTY           SERVO_ANGLE_TO_DUTY(90)
+#define FEED_DUTY           SERVO_ANGLE_TO_DUTY(75)
+#define BENCH_TZ            "CET-1CEST,M3.5.0,M10.5.0/3"
+
+// Meals per hopper and day
+static const uint8_t meals[][2] = { { 7, 0 }, { 12, 30 }, { 19, 0 } };
+
+typedef struct {
+    bool feeding;
+    uint32_t feeds;
+    uint32_t resets;
+    uint32_t refused;
+    int64_t started_us;
+    int64_t longest_us;
+} hopper_stats_t;
+
+static hopper_stats_t stats[HOPPERS];
+static TimerHandle_t auto_feed_timer = NULL;
+static bool ordered = true;
+
+// Runs on the actuator task
+static void actuator_event(int hopper, actuator_event_t event, uint32_t duty)
+{
+    hopper_stats_t *s = &stats[hopper];
+
+    if (event == ACTUATOR_EVENT_FEED) {
+        ordered &= bench_expect(!s->feeding, "hopper %d started a feed during a feed", hopper);
+        s->feeding = true;
+        s->feeds++;
+        s->started_us = sim_now_us();
+    } else if (event == ACTUATOR_EVENT_RESET) {
+        ordered &= bench_expect(s->feeding, "hopper %d reset without a feed", hopper);
+        ordered &= bench_expect(duty == REST_DUTY, "hopper %d reset at duty %u", hopper, (unsigned)duty);
+        s->feeding = false;
+        s->resets++;
+        if (sim_now_us() - s->started_us > s->longest_us) {
+            s->longest_us = sim_now_us() - s->started_us;
+        }
+    }
+}
+
+static void feed(int hopper, uint32_t hold_ms)
+{
+    if (actuator_feed(hopper, FEED_DUTY, hold_ms) != ESP_OK) {
+        stats[hopper].refused++;
+    }
+}
+
+// Timer service context on the chip, the simulation loop here
+static void schedule_fire(int id, const schedule_entry_t *entry)
+{
+    feed(entry->hopper, entry->portion_ms > 0 ? entry->portion_ms : DEFAULT_HOLD_MS);
+}
+
+static void auto_feed_timer_callback(TimerHandle_t timer)
+{
+    for (int i = 0; i < HOPPERS; i++) {
+        feed(i, AUTO_FEED_HOLD_MS);
+    }
+}
+
+// What update_auto_feed_timer does in the firmware
+static void set_auto_feed(uint32_t minutes)
+{
+    if (minutes == 0) {
+        xTimerStop(auto_feed_timer, 0);
+    } else {
+        xTimerChangePeriod(auto_feed_timer, pdMS_TO_TICKS(minutes * 60 * 1000), 0);
+    }
+}
+
+void bench_feeding(int arg)
+{
+    int days = bench_quick ? QUICK_DAYS : DAYS;
+
+    // Monday 3 June 2024, 00:00:30 local
+    scheduler_set_timezone(BENCH_TZ);
+    struct tm tm = { .tm_year = 2024 - 1900, .tm_mon = 5, .tm_mday = 3, .tm_sec = 30, .tm_isdst = -1 };
+    sim_set_time(mktime(&tm));
+
+    actuator_config_t hoppers[HOPPERS];
+    for (int i = 0; i < HOPPERS; i++) {
+        hoppers[i] = (actuator_config_t) {
+            .gpio_num        = 18 + i,
+            .rest_duty       = REST_DUTY,
+            .min_duty        = SERVO_ANGLE_TO_DUTY(0),
+            .max_duty        = SERVO_ANGLE_TO_DUTY(SERVO_MAX_ANGLE),
+            .ramp_ms         = ACTUATOR_RAMP_MS,
+            .ease            = MOTION_EASE_IN_OUT,
+            .profile         = i == 2 ? &motion_profile_agitate : &motion_profile_dispense,
+            .release_at_rest = i == 3,
+        };
+    }
+    ESP_ERROR_CHECK(servo_cal_init());
+    ESP_ERROR_CHECK(actuator_init(hoppers, HOPPERS, actuator_event, tskNO_AFFINITY));
+
+    ESP_ERROR_CHECK(scheduler_init(schedule_fire));
+    ESP_ERROR_CHECK(scheduler_start_time_sync(BENCH_TZ));
+    for (int h = 0; h < HOPPERS; h++) {
+        for (size_t m = 0; m < sizeof(meals) / sizeof(meals[0]); m++) {
+            schedule_entry_t e = {
+                .hour       = meals[m][0],
+                .minute     = meals[m][1],
+                .days       = SCHEDULER_ALL_DAYS,
+                .enabled    = 1,
+                .hopper     = h,
+                .portion_ms = 3000 + 1000 * h,
+            };
+            bench_expect(scheduler_set(-1, &e) >= 0, "schedule table full");
+        }
+    }
+
+    auto_feed_timer = xTimerCreate("auto_feed_timer", pdMS_TO_TICKS(60 * 60 * 1000), pdTRUE, NULL,
+                                   auto_feed_timer_callback);
+    set_auto_feed(AUTO_FEED_MINUTES);
+
+    uint64_t switches = sim_task_switches();
+    uint64_t start = bench_now_ns();
+    for (int d = 0; d < days; d++) {
+        sim_run_for(SIM_US_PER_DAY);
+        if (d == days / 2) {
+            sim_sntp_sync();    // A resync rebuilds the schedule mid-run
+        }
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    switches = sim_task_switches() - switches;
+
+    // Let the last feed finish
+    sim_run_for(60 * 1000000LL);
+
+    uint32_t feeds = 0;
+    for (int h = 0; h < HOPPERS; h++) {
+        feeds += stats[h].feeds;
+    }
+    bench_report("feeding/sim_day", elapsed / 1e6 / days, "ms");
+    bench_report("feeding/feed", feeds > 0 ? elapsed / 1000.0 / feeds : 0, "us");
+    bench_report("feeding/switches_per_feed", feeds > 0 ? (double)switches / feeds : 0, "switches");
+
+    uint32_t per_day = sizeof(meals) / sizeof(meals[0]) + 24 * 60 / AUTO_FEED_MINUTES;
+    for (int h = 0; h < HOPPERS; h++) {
+        hopper_stats_t *s = &stats[h];
+        bench_expect(s->feeds == per_day * days && s->refused == 0,
+                     "hopper %d: %u feeds, %u refused, expected %u", h, s->feeds, s->refused, per_day * days);
+        bench_expect(s->resets == s->feeds, "hopper %d: %u feeds but %u resets", h, s->feeds, s->resets);
+        bench_expect(sim_ledc_duty(h) == REST_DUTY, "hopper %d left at duty %u", h, (unsigned)sim_ledc_duty(h));
+        bench_expect(s->longest_us < 10 * 1000000LL, "hopper %d: a feed took %lld ms", h,
+                     (long long)(s->longest_us / 1000));
+    }
+    bench_expect(ordered, "feed events out of order");
+    bench_expect(actuator_all_idle(), "actuator still busy");
+    bench_expect(!sim_ledc_running(3), "hopper 3 signal not released at rest");
+}
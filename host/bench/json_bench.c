@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <string.h>
+#include "esp_http_server.h"
+#include "json_writer.h"
+#include "json_reader.h"
+#include "bench.h"
+
+#define ROUNDS              20000
+#define QUICK_ROUNDS        2000
+#define SCHEDULE_ROWS       16
+#define BATCH_COMMANDS      16
+#define TCP_SEGMENT         536     // Default MSS, the most one recv returns
+
+typedef struct {
+    int events;
+    int commands;
+} batch_count_t;
+
+// GET /schedule with a full table: 256 byte buffer, sent in chunks
+static void write_schedule(httpd_req_t *req)
+{
+    char buf[256];
+    json_writer_t w;
+
+    json_writer_init(&w, req, buf, sizeof(buf));
+    json_begin_object(&w, NULL);
+    json_add_bool(&w, "time_valid", true);
+    json_add_int(&w, "now", 1717365630);
+    json_add_int(&w, "next", 1717390800);
+    json_add_int(&w, "next_id", 3);
+    json_begin_array(&w, "entries");
+    for (int i = 0; i < SCHEDULE_ROWS; i++) {
+        json_begin_object(&w, NULL);
+        json_add_int(&w, "id", i);
+        json_add_int(&w, "hopper", i % 4);
+        json_add_int(&w, "hour", 7 + i % 12);
+        json_add_int(&w, "minute", (i * 7) % 60);
+        json_add_int(&w, "days", 62);
+        json_add_int(&w, "portion_ms", 3000);
+        json_add_bool(&w, "enabled", true);
+        json_end_object(&w);
+    }
+    json_end_array(&w);
+    json_end_object(&w);
+    json_writer_finish(&w);
+}
+
+// State push message, built without a request
+static size_t write_state(char *buf, size_t size)
+{
+    json_writer_t w;
+
+    json_writer_init(&w, NULL, buf, size);
+    json_begin_object(&w, NULL);
+    json_add_string(&w, "event", "feeding");
+    json_add_int(&w, "hopper", 1);
+    json_add_int(&w, "hoppers", 4);
+    json_add_int(&w, "pwm", 614);
+    json_add_int(&w, "minutes", 240);
+    json_end_object(&w);
+    return json_writer_finish(&w) == ESP_OK ? w.total : 0;
+}
+
+static esp_err_t batch_event(const json_event_t *event, void *ctx)
+{
+    batch_count_t *count = ctx;
+
+    count->events++;
+    if (event->type == JSON_EVENT_OBJECT_START && event->depth == 1) {
+        count->commands++;
+    }
+    return ESP_OK;
+}
+
+static void build_batch(char *body, size_t size)
+{
+    size_t len = snprintf(body, size, "[");
+    for (int i = 0; i < BATCH_COMMANDS; i++) {
+        const char *sep = i > 0 ? "," : "";
+        switch (i % 3) {
+        case 0:
+            len += snprintf(body + len, size - len, "%s{\"cmd\":\"set_pwm\",\"hopper\":%d,\"feed_pwm\":540,\"reset_delay_ms\":4000}", sep, i % 4);
+            break;
+        case 1:
+            len += snprintf(body + len, size - len, "%s{\"cmd\":\"set_timer\",\"minutes\":240}", sep);
+            break;
+        default:
+            len += snprintf(body + len, size - len, "%s{\"cmd\":\"feed\",\"hopper\":%d}", sep, i % 4);
+            break;
+        }
+    }
+    snprintf(body + len, size - len, "]");
+}
+
+static void decode(const char *name, const char *body, size_t piece, int rounds)
+{
+    batch_count_t count = { 0 };
+    esp_err_t err = ESP_OK;
+
+    uint64_t start = bench_now_ns();
+    for (int i = 0; i < rounds && err == ESP_OK; i++) {
+        httpd_req_t req;
+        json_reader_t reader;
+        sim_httpd_req_init(&req, "/batch", body, NULL, 0);
+        req.recv_piece = piece;
+        count.commands = 0;
+        json_reader_init(&reader, batch_event, &count);
+        err = json_reader_parse_request(&reader, &req);
+    }
+    bench_report(name, (double)(bench_now_ns() - start) / rounds, "ns/req");
+    bench_expect(err == ESP_OK && count.commands == BATCH_COMMANDS, "%s: %s, %d commands", name,
+                 esp_err_to_name(err), count.commands);
+}
+
+void bench_json(int arg)
+{
+    int rounds = bench_quick ? QUICK_ROUNDS : ROUNDS;
+    char resp[2048];
+    httpd_req_t req;
+
+    uint64_t start = bench_now_ns();
+    for (int i = 0; i < rounds; i++) {
+        sim_httpd_req_init(&req, "/schedule", NULL, resp, sizeof(resp));
+        write_schedule(&req);
+    }
+    bench_report("json/encode_schedule", (double)(bench_now_ns() - start) / rounds, "ns/req");
+    bench_expect(req.resp_len < sizeof(resp) && resp[req.resp_len - 1] == '}' && req.chunks > 1,
+                 "schedule response: %zu bytes in %d chunks", req.resp_len, req.chunks);
+
+    char state[256];
+    size_t len = 0;
+    start = bench_now_ns();
+    for (int i = 0; i < rounds; i++) {
+        len = write_state(state, sizeof(state));
+    }
+    bench_report("json/encode_state", (double)(bench_now_ns() - start) / rounds, "ns/msg");
+    bench_expect(len > 0 && strcmp(state + len - 1, "}") == 0, "state message: %s", state);
+
+    char body[2048];
+    build_batch(body, sizeof(body));
+    decode("json/decode_batch", body, TCP_SEGMENT, rounds);
+    decode("json/decode_batch_split", body, 7, rounds);
+}
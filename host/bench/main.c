@@ -0,0 +1,229 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "esp_log.h"
+#include "sim.h"
+#include "bench.h"
+
+#define MAX_RESULTS     64
+#define NAME_LEN        48
+#define UNIT_LEN        16
+#define DEFAULT_TOLERANCE_PCT   25
+
+typedef struct {
+    const char *name;
+    void (*run)(int arg);
+    int arg;
+    bool full_only;             // Skipped with --quick
+} suite_t;
+
+typedef struct {
+    char name[NAME_LEN];
+    double value;
+    char unit[UNIT_LEN];
+} result_t;
+
+static const suite_t suites[] = {
+    { "scheduler/16",       bench_scheduler, 16,    false },
+    { "scheduler/256",      bench_scheduler, 256,   false },
+    { "scheduler/1024",     bench_scheduler, 1024,  false },
+    { "scheduler/4096",     bench_scheduler, 4096,  true  },
+    { "scheduler/wake",     bench_scheduler_wake, 0, false },
+    { "json",               bench_json,      0,     false },
+    { "feeding",            bench_feeding,   0,     false },
+};
+
+bool bench_quick = false;
+static FILE *result_pipe = NULL;       // Child side
+static bool suite_failed = false;
+static result_t results[MAX_RESULTS];
+static int result_count = 0;
+
+uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void bench_report(const char *name, double value, const char *unit)
+{
+    fprintf(result_pipe, "%s\t%.6g\t%s\n", name, value, unit);
+    fflush(result_pipe);
+}
+
+bool bench_expect(bool ok, const char *format, ...)
+{
+    va_list args;
+
+    if (!ok) {
+        va_start(args, format);
+        fprintf(stderr, "FAILED: ");
+        vfprintf(stderr, format, args);
+        fprintf(stderr, "\n");
+        va_end(args);
+        suite_failed = true;
+    }
+    return ok;
+}
+
+// Run one suite in a child process and collect what it reports
+static bool run_suite(const suite_t *s)
+{
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        return false;
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        result_pipe = fdopen(fds[1], "w");
+        esp_log_level_set("*", ESP_LOG_WARN);
+        sim_start(0);
+        s->run(s->arg);
+        fclose(result_pipe);
+        _exit(suite_failed ? 1 : 0);
+    }
+    close(fds[1]);
+
+    FILE *in = fdopen(fds[0], "r");
+    char line[128];
+    while (fgets(line, sizeof(line), in) != NULL && result_count < MAX_RESULTS) {
+        result_t *r = &results[result_count];
+        if (sscanf(line, "%47[^\t]\t%lf\t%15s", r->name, &r->value, r->unit) == 3) {
+            result_count++;
+        }
+    }
+    fclose(in);
+
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "%s: suite failed\n", s->name);
+        return false;
+    }
+    return true;
+}
+
+static bool selected(const suite_t *s, int argc, char **argv, int first)
+{
+    if (first == argc) {
+        return !(bench_quick && s->full_only);
+    }
+    for (int i = first; i < argc; i++) {
+        if (strncmp(s->name, argv[i], strlen(argv[i])) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static const result_t *find_baseline(const result_t *base, int count, const char *name)
+{
+    for (int i = 0; i < count; i++) {
+        if (strcmp(base[i].name, name) == 0) {
+            return &base[i];
+        }
+    }
+    return NULL;
+}
+
+static int load_baseline(const char *path, result_t *base)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        exit(2);
+    }
+    int count = 0;
+    char line[128];
+    while (fgets(line, sizeof(line), f) != NULL && count < MAX_RESULTS) {
+        if (sscanf(line, "%47s %lf %15s", base[count].name, &base[count].value, base[count].unit) == 3) {
+            count++;
+        }
+    }
+    fclose(f);
+    return count;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [--quick] [--save FILE] [--compare FILE] [--tolerance PCT] [SUITE...]\n"
+                    "Suites:", prog);
+    for (size_t i = 0; i < sizeof(suites) / sizeof(suites[0]); i++) {
+        fprintf(stderr, " %s", suites[i].name);
+    }
+    fprintf(stderr, "\nA SUITE argument selects every suite it is a prefix of.\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    const char *save_path = NULL;
+    const char *compare_path = NULL;
+    double tolerance = DEFAULT_TOLERANCE_PCT;
+    int first = 1;
+
+    for (; first < argc && argv[first][0] == '-'; first++) {
+        if (strcmp(argv[first], "--quick") == 0) {
+            bench_quick = true;
+        } else if (strcmp(argv[first], "--save") == 0 && first + 1 < argc) {
+            save_path = argv[++first];
+        } else if (strcmp(argv[first], "--compare") == 0 && first + 1 < argc) {
+            compare_path = argv[++first];
+        } else if (strcmp(argv[first], "--tolerance") == 0 && first + 1 < argc) {
+            tolerance = atof(argv[++first]);
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    result_t base[MAX_RESULTS];
+    int base_count = compare_path != NULL ? load_baseline(compare_path, base) : 0;
+
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(suites) / sizeof(suites[0]); i++) {
+        if (selected(&suites[i], argc, argv, first)) {
+            ok &= run_suite(&suites[i]);
+        }
+    }
+
+    int regressions = 0;
+    printf("%-40s %14s %-10s %s\n", "benchmark", "value", "unit", compare_path != NULL ? "vs baseline" : "");
+    for (int i = 0; i < result_count; i++) {
+        const result_t *r = &results[i];
+        const result_t *b = find_baseline(base, base_count, r->name);
+        printf("%-40s %14.2f %-10s", r->name, r->value, r->unit);
+        if (b != NULL && b->value > 0) {
+            double change = (r->value / b->value - 1) * 100;
+            bool regressed = change > tolerance;
+            regressions += regressed;
+            printf(" %+6.1f%%%s", change, regressed ? "  REGRESSION" : "");
+        }
+        printf("\n");
+    }
+
+    if (save_path != NULL) {
+        FILE *f = fopen(save_path, "w");
+        if (f == NULL) {
+            perror(save_path);
+            return 2;
+        }
+        for (int i = 0; i < result_count; i++) {
+            fprintf(f, "%s %.6g %s\n", results[i].name, results[i].value, results[i].unit);
+        }
+        fclose(f);
+    }
+
+    if (regressions > 0) {
+        fprintf(stderr, "%d result(s) more than %.0f%% above the baseline\n", regressions, tolerance);
+    }
+    return ok && regressions == 0 ? 0 : 1;
+}
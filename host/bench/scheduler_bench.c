@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "nvs.h"
+#include "scheduler.h"
+#include "sim.h"
+#include "bench.h"
+
+#define BENCH_TZ            "CET-1CEST,M3.5.0,M10.5.0/3"
+#define SET_ROUNDS          20
+#define SIM_DAYS            7
+
+static uint32_t fires = 0;
+static uint16_t fires_per_rule[SCHEDULER_MAX_ENTRIES];
+
+static void fire_cb(int id, const schedule_entry_t *entry)
+{
+    fires++;
+    fires_per_rule[id]++;
+}
+
+static schedule_entry_t random_rule(void)
+{
+    schedule_entry_t e = {
+        .hour       = rand() % 24,
+        .minute     = rand() % 60,
+        .days       = 1 + rand() % SCHEDULER_ALL_DAYS,
+        .enabled    = 1,
+        .hopper     = rand() % 4,
+        .portion_ms = 1000 + rand() % 4000,
+    };
+    return e;
+}
+
+// Monday 3 June 2024, 00:00:30 local: a week without a DST change, started
+// past the full minute so every rule's occurrence today-at-midnight is
+// already over and each matching day fires exactly once
+static time_t week_start(void)
+{
+    struct tm tm = {
+        .tm_year  = 2024 - 1900,
+        .tm_mon   = 5,
+        .tm_mday  = 3,
+        .tm_sec   = 30,
+        .tm_isdst = -1,
+    };
+    return mktime(&tm);
+}
+
+void bench_scheduler(int rules)
+{
+    char name[48];
+    schedule_entry_t *table = calloc(SCHEDULER_MAX_ENTRIES, sizeof(schedule_entry_t));
+    uint32_t expected = 0;
+
+    if (!bench_expect(rules <= SCHEDULER_MAX_ENTRIES, "%d rules, table holds %d", rules, SCHEDULER_MAX_ENTRIES)) {
+        return;
+    }
+
+    // Store the table the way the firmware does, so init loads it in one go
+    // instead of paying a rebuild per rule
+    srand(rules);
+    for (int i = 0; i < rules; i++) {
+        table[i] = random_rule();
+        expected += __builtin_popcount(table[i].days);
+    }
+    nvs_handle_t nvs;
+    nvs_open("schedule", NVS_READWRITE, &nvs);
+    nvs_set_blob(nvs, "entries", table, SCHEDULER_MAX_ENTRIES * sizeof(schedule_entry_t));
+    nvs_close(nvs);
+
+    scheduler_set_timezone(BENCH_TZ);
+    sim_set_time(week_start());
+
+    uint64_t start = bench_now_ns();
+    scheduler_init(fire_cb);
+    snprintf(name, sizeof(name), "scheduler/init_%d", rules);
+    bench_report(name, (bench_now_ns() - start) / 1000.0, "us");
+
+    // Every change recomputes all deadlines and stores the table
+    start = bench_now_ns();
+    for (int i = 0; i < SET_ROUNDS; i++) {
+        schedule_entry_t e = table[0];
+        e.minute = (e.minute + 1) % 60;
+        table[0] = e;
+        scheduler_set(0, &e);
+    }
+    snprintf(name, sizeof(name), "scheduler/set_%d", rules);
+    bench_report(name, (bench_now_ns() - start) / 1000.0 / SET_ROUNDS, "us/op");
+
+    // A week of firing; the timer wakes at every deadline and at least hourly
+    uint64_t events = sim_events_fired();
+    start = bench_now_ns();
+    sim_run_for(SIM_DAYS * SIM_US_PER_DAY);
+    uint64_t elapsed = bench_now_ns() - start;
+    snprintf(name, sizeof(name), "scheduler/week_%d", rules);
+    bench_report(name, elapsed / 1e6, "ms");
+    snprintf(name, sizeof(name), "scheduler/fire_%d", rules);
+    bench_report(name, fires > 0 ? elapsed / 1000.0 / fires : 0, "us/fire");
+
+    bench_expect(fires == expected, "%d rules fired %u times in a week, expected %u", rules, fires, expected);
+    for (int i = 0; i < rules; i++) {
+        if (!bench_expect(fires_per_rule[i] == __builtin_popcount(table[i].days),
+                          "rule %d (days 0x%02x) fired %u times", i, table[i].days, fires_per_rule[i])) {
+            break;
+        }
+    }
+    bench_expect(sim_events_fired() - events >= SIM_DAYS * 24, "timer woke less than hourly");
+    free(table);
+}
+
+// Wake-up from deep sleep for a 07:30 feed: the clock is kept by the RTC, the
+// chip boots without a time zone and the deadline that woke it was already
+// fed. The next one must be tomorrow's 07:30 in local time, not today's in
+// UTC (an hour or two later) which would feed the same meal again.
+void bench_scheduler_wake(int arg)
+{
+    schedule_entry_t table[SCHEDULER_MAX_ENTRIES] = {
+        { .hour = 7, .minute = 30, .days = SCHEDULER_ALL_DAYS, .enabled = 1, .portion_ms = 3000 },
+    };
+    nvs_handle_t nvs;
+    nvs_open("schedule", NVS_READWRITE, &nvs);
+    nvs_set_blob(nvs, "entries", table, sizeof(table));
+    nvs_close(nvs);
+
+    scheduler_set_timezone(BENCH_TZ);
+    struct tm tm = { .tm_year = 2024 - 1900, .tm_mon = 5, .tm_mday = 3, .tm_hour = 7, .tm_min = 30,
+                     .tm_isdst = -1 };
+    time_t due = mktime(&tm);
+    unsetenv("TZ");
+    tzset();
+    sim_set_time(due + 2);
+
+    // The order of app_main() before it was fixed: the zone after init
+    scheduler_skip_until(due);
+    scheduler_init(fire_cb);
+    scheduler_set_timezone(BENCH_TZ);
+
+    time_t next = scheduler_next_due(NULL);
+    bench_expect(next == due + 24 * 3600, "next feed %+lld s after the one that woke the chip, expected +86400",
+                 (long long)(next - due));
+    sim_run_for(6 * 3600 * 1000000LL);
+    bench_expect(fires == 0, "the wake-up feed fired again %u times", fires);
+}
@@ -0,0 +1,557 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_netif_sntp.h"
+#include "esp_http_server.h"
+#include "nvs.h"
+#include "driver/ledc.h"
+#include "sim.h"
+
+#define NVS_MAX_NAMESPACES  16
+#define NVS_KEY_LEN         16      // As on the chip, including the terminator
+#define MOCK_FREE_HEAP      200000
+
+// ---- Errors and logging -------------------------------------------------------
+
+static esp_log_level_t log_level = CONFIG_LOG_DEFAULT_LEVEL;
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+    case ESP_OK:                    return "ESP_OK";
+    case ESP_FAIL:                  return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:            return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:       return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:     return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:      return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:         return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:     return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:           return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_RESPONSE:  return "ESP_ERR_INVALID_RESPONSE";
+    case ESP_ERR_NVS_NOT_FOUND:     return "ESP_ERR_NVS_NOT_FOUND";
+    default:                        return "UNKNOWN ERROR";
+    }
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    if (strcmp(tag, "*") == 0) {
+        log_level = level;
+    }
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    static const char letters[] = "NEWIDV";
+    va_list args;
+
+    if (level > log_level) {
+        return;
+    }
+    va_start(args, format);
+    printf("%c (%lld) %s: ", letters[level], (long long)(sim_now_us() / 1000), tag);
+    vprintf(format, args);
+    printf("\n");
+    va_end(args);
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    return MOCK_FREE_HEAP;
+}
+
+uint32_t esp_get_minimum_free_heap_size(void)
+{
+    return MOCK_FREE_HEAP;
+}
+
+void esp_restart(void)
+{
+    sim_panic("esp_restart");
+}
+
+// ---- esp_timer --------------------------------------------------------------------
+
+struct esp_timer {
+    sim_event_t expiry;
+    esp_timer_cb_t callback;
+    void *arg;
+    uint64_t period_us;         // 0 for one-shot
+};
+
+static void esp_timer_fire(sim_event_t *e)
+{
+    struct esp_timer *t = (struct esp_timer *)e;
+
+    if (t->period_us > 0) {
+        sim_event_schedule(e, e->at + t->period_us, esp_timer_fire);
+    }
+    t->callback(t->arg);
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out_handle)
+{
+    struct esp_timer *t = calloc(1, sizeof(*t));
+    if (t == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    t->callback = args->callback;
+    t->arg = args->arg;
+    *out_handle = t;
+    return ESP_OK;
+}
+
+// Starting a running timer is an error, as in ESP-IDF
+esp_err_t esp_timer_start_once(esp_timer_handle_t t, uint64_t timeout_us)
+{
+    if (t->expiry.queued) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    t->period_us = 0;
+    sim_event_schedule(&t->expiry, sim_now_us() + timeout_us, esp_timer_fire);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t t, uint64_t period_us)
+{
+    if (t->expiry.queued) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    t->period_us = period_us;
+    sim_event_schedule(&t->expiry, sim_now_us() + period_us, esp_timer_fire);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t t)
+{
+    if (!t->expiry.queued) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    sim_event_cancel(&t->expiry);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t t)
+{
+    if (t->expiry.queued) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    free(t);
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t t)
+{
+    return t->expiry.queued;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return sim_now_us();
+}
+
+// ---- LEDC -------------------------------------------------------------------------
+
+typedef struct {
+    sim_event_t fade_end;
+    uint32_t duty;              // Set, not yet updated
+    uint32_t output;            // Duty at the pin
+    uint32_t fade_target;
+    int fade_ms;
+    bool running;
+    bool configured;
+    uint32_t fades;
+    ledc_cb_t cb;
+    void *cb_arg;
+} ledc_sim_channel_t;
+
+static ledc_sim_channel_t channels[LEDC_CHANNEL_MAX];
+static bool fade_installed = false;
+
+static ledc_sim_channel_t *get_channel(ledc_channel_t channel)
+{
+    return channel >= 0 && channel < LEDC_CHANNEL_MAX && channels[channel].configured ? &channels[channel] : NULL;
+}
+
+static void fade_end_fire(sim_event_t *e)
+{
+    ledc_sim_channel_t *c = (ledc_sim_channel_t *)e;
+    ledc_cb_param_t param = {
+        .event      = LEDC_FADE_END_EVT,
+        .speed_mode = LEDC_LOW_SPEED_MODE,
+        .channel    = (uint32_t)(c - channels),
+        .duty       = c->fade_target,
+    };
+
+    c->output = c->duty = c->fade_target;
+    if (c->cb != NULL) {
+        c->cb(&param, c->cb_arg);
+    }
+}
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t *timer_conf)
+{
+    return ESP_OK;
+}
+
+esp_err_t ledc_channel_config(const ledc_channel_config_t *conf)
+{
+    if (conf->channel < 0 || conf->channel >= LEDC_CHANNEL_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    ledc_sim_channel_t *c = &channels[conf->channel];
+    c->configured = true;
+    c->running = true;
+    c->duty = c->output = conf->duty;
+    return ESP_OK;
+}
+
+esp_err_t ledc_set_duty(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t duty)
+{
+    ledc_sim_channel_t *c = get_channel(channel);
+    if (c == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    c->duty = duty;
+    return ESP_OK;
+}
+
+esp_err_t ledc_update_duty(ledc_mode_t speed_mode, ledc_channel_t channel)
+{
+    ledc_sim_channel_t *c = get_channel(channel);
+    if (c == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    sim_event_cancel(&c->fade_end);
+    c->output = c->duty;
+    c->running = true;
+    return ESP_OK;
+}
+
+uint32_t ledc_get_duty(ledc_mode_t speed_mode, ledc_channel_t channel)
+{
+    ledc_sim_channel_t *c = get_channel(channel);
+    return c != NULL ? c->output : 0;
+}
+
+esp_err_t ledc_stop(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t idle_level)
+{
+    ledc_sim_channel_t *c = get_channel(channel);
+    if (c == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    c->running = false;
+    return ESP_OK;
+}
+
+esp_err_t ledc_fade_func_install(int intr_alloc_flags)
+{
+    if (fade_installed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    fade_installed = true;
+    return ESP_OK;
+}
+
+esp_err_t ledc_set_fade_with_time(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t target_duty, int max_fade_time_ms)
+{
+    ledc_sim_channel_t *c = get_channel(channel);
+    if (c == NULL || !fade_installed) {
+        return c == NULL ? ESP_ERR_INVALID_ARG : ESP_ERR_INVALID_STATE;
+    }
+    c->fade_target = target_duty;
+    c->fade_ms = max_fade_time_ms;
+    return ESP_OK;
+}
+
+esp_err_t ledc_fade_start(ledc_mode_t speed_mode, ledc_channel_t channel, ledc_fade_mode_t fade_mode)
+{
+    ledc_sim_channel_t *c = get_channel(channel);
+    if (c == NULL || !fade_installed) {
+        return c == NULL ? ESP_ERR_INVALID_ARG : ESP_ERR_INVALID_STATE;
+    }
+    if (fade_mode != LEDC_FADE_NO_WAIT) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    c->running = true;
+    c->fades++;
+    sim_event_schedule(&c->fade_end, sim_now_us() + (int64_t)c->fade_ms * 1000, fade_end_fire);
+    return ESP_OK;
+}
+
+esp_err_t ledc_cb_register(ledc_mode_t speed_mode, ledc_channel_t channel, ledc_cbs_t *cbs, void *user_arg)
+{
+    ledc_sim_channel_t *c = get_channel(channel);
+    if (c == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    c->cb = cbs->fade_cb;
+    c->cb_arg = user_arg;
+    return ESP_OK;
+}
+
+uint32_t sim_ledc_duty(int channel)
+{
+    return ledc_get_duty(LEDC_LOW_SPEED_MODE, channel);
+}
+
+bool sim_ledc_running(int channel)
+{
+    ledc_sim_channel_t *c = get_channel(channel);
+    return c != NULL && c->running;
+}
+
+uint32_t sim_ledc_fades(int channel)
+{
+    ledc_sim_channel_t *c = get_channel(channel);
+    return c != NULL ? c->fades : 0;
+}
+
+// ---- NVS --------------------------------------------------------------------------
+
+typedef struct nvs_entry {
+    char key[NVS_KEY_LEN];
+    void *value;
+    size_t len;
+    struct nvs_entry *next;
+} nvs_entry_t;
+
+typedef struct {
+    char name[NVS_KEY_LEN];
+    nvs_entry_t *entries;
+} nvs_namespace_t;
+
+static nvs_namespace_t namespaces[NVS_MAX_NAMESPACES];
+static int namespace_count = 0;
+static uint32_t commits = 0;
+
+// Handles are namespace index + 1
+static nvs_namespace_t *get_namespace(nvs_handle_t handle)
+{
+    return handle >= 1 && handle <= (nvs_handle_t)namespace_count ? &namespaces[handle - 1] : NULL;
+}
+
+static nvs_entry_t **find_entry(nvs_namespace_t *ns, const char *key)
+{
+    nvs_entry_t **p = &ns->entries;
+    while (*p != NULL && strcmp((*p)->key, key) != 0) {
+        p = &(*p)->next;
+    }
+    return p;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    if (strlen(name) >= NVS_KEY_LEN) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int i = 0; i < namespace_count; i++) {
+        if (strcmp(namespaces[i].name, name) == 0) {
+            *out_handle = i + 1;
+            return ESP_OK;
+        }
+    }
+    if (open_mode == NVS_READONLY) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (namespace_count == NVS_MAX_NAMESPACES) {
+        return ESP_ERR_NO_MEM;
+    }
+    strcpy(namespaces[namespace_count].name, name);
+    *out_handle = ++namespace_count;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    if (get_namespace(handle) == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    commits++;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    nvs_namespace_t *ns = get_namespace(handle);
+    if (ns == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    nvs_entry_t *e = *find_entry(ns, key);
+    if (e == NULL) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (out_value == NULL) {
+        *length = e->len;
+        return ESP_OK;
+    }
+    if (*length < e->len) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(out_value, e->value, e->len);
+    *length = e->len;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    nvs_namespace_t *ns = get_namespace(handle);
+    if (ns == NULL || strlen(key) >= NVS_KEY_LEN) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    void *copy = malloc(length > 0 ? length : 1);
+    if (copy == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(copy, value, length);
+
+    nvs_entry_t **p = find_entry(ns, key);
+    if (*p == NULL) {
+        *p = calloc(1, sizeof(nvs_entry_t));
+        if (*p == NULL) {
+            free(copy);
+            return ESP_ERR_NO_MEM;
+        }
+        strcpy((*p)->key, key);
+    }
+    free((*p)->value);
+    (*p)->value = copy;
+    (*p)->len = length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    nvs_namespace_t *ns = get_namespace(handle);
+    if (ns == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    nvs_entry_t **p = find_entry(ns, key);
+    nvs_entry_t *e = *p;
+    if (e == NULL) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    *p = e->next;
+    free(e->value);
+    free(e);
+    return ESP_OK;
+}
+
+uint32_t sim_nvs_commits(void)
+{
+    return commits;
+}
+
+// ---- SNTP -------------------------------------------------------------------------
+
+static esp_sntp_time_cb_t sntp_cb = NULL;
+
+esp_err_t esp_netif_sntp_init(const esp_sntp_config_t *config)
+{
+    sntp_cb = config->sync_cb;
+    return ESP_OK;
+}
+
+bool sim_sntp_sync(void)
+{
+    if (sntp_cb == NULL) {
+        return false;
+    }
+    struct timeval tv = { .tv_sec = time(NULL) };
+    sntp_cb(&tv);
+    return true;
+}
+
+// ---- HTTP server --------------------------------------------------------------------
+
+void sim_httpd_req_init(httpd_req_t *req, const char *uri, const char *body, char *resp, size_t resp_size)
+{
+    memset(req, 0, sizeof(*req));
+    req->uri = uri;
+    req->method = body != NULL ? HTTP_POST : HTTP_GET;
+    req->body = body;
+    req->content_len = body != NULL ? strlen(body) : 0;
+    req->resp = resp;
+    req->resp_size = resp_size;
+    req->status = 200;
+}
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len)
+{
+    size_t left = r->content_len - r->body_pos;
+    size_t n = buf_len < left ? buf_len : left;
+
+    if (r->recv_piece > 0 && n > r->recv_piece) {
+        n = r->recv_piece;
+    }
+    memcpy(buf, r->body + r->body_pos, n);
+    r->body_pos += n;
+    return (int)n;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type)
+{
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status)
+{
+    r->status = atoi(status);
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value)
+{
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    if (buf == NULL) {
+        return ESP_OK;          // End of a chunked response
+    }
+    size_t len = buf_len == HTTPD_RESP_USE_STRLEN ? strlen(buf) : (size_t)buf_len;
+
+    // Keep what fits, terminated, and count the rest
+    if (r->resp != NULL && r->resp_len + 1 < r->resp_size) {
+        size_t room = r->resp_size - 1 - r->resp_len;
+        size_t n = len < room ? len : room;
+        memcpy(r->resp + r->resp_len, buf, n);
+        r->resp[r->resp_len + n] = '\0';
+    }
+    r->resp_len += len;
+    r->chunks++;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    return buf != NULL ? httpd_resp_send_chunk(r, buf, buf_len) : ESP_OK;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *r, httpd_err_code_t error, const char *msg)
+{
+    static const int codes[] = { 400, 404, 408, 500 };
+    r->status = codes[error];
+    return httpd_resp_send(r, msg, HTTPD_RESP_USE_STRLEN);
+}
+
+esp_err_t httpd_resp_send_500(httpd_req_t *r)
+{
+    return httpd_resp_send_err(r, HTTPD_500_INTERNAL_SERVER_ERROR, "Internal Server Error");
+}
+
+esp_err_t httpd_resp_send_408(httpd_req_t *r)
+{
+    return httpd_resp_send_err(r, HTTPD_408_REQ_TIMEOUT, "Request Timeout");
+}
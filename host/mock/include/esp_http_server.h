@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "esp_err.h"
+
+// A request is a prepared body to receive and a sink counting the response;
+// enough to run the JSON reader and writer the way the handlers do
+#define HTTPD_SOCK_ERR_FAIL     -1
+#define HTTPD_SOCK_ERR_INVALID  -2
+#define HTTPD_SOCK_ERR_TIMEOUT  -3
+#define HTTPD_RESP_USE_STRLEN   -1
+
+typedef void *httpd_handle_t;
+
+typedef enum {
+    HTTP_GET,
+    HTTP_POST,
+} httpd_method_t;
+
+typedef enum {
+    HTTPD_400_BAD_REQUEST,
+    HTTPD_404_NOT_FOUND,
+    HTTPD_408_REQ_TIMEOUT,
+    HTTPD_500_INTERNAL_SERVER_ERROR,
+} httpd_err_code_t;
+
+typedef struct httpd_req {
+    const char *uri;
+    int method;
+    size_t content_len;
+    // Simulation side
+    const char *body;           // Request body, content_len bytes
+    size_t body_pos;
+    size_t recv_piece;          // Most bytes one httpd_req_recv returns, 0 = no limit
+    char *resp;                 // Response copy, may be NULL
+    size_t resp_size;
+    size_t resp_len;            // Bytes sent, also counted past resp_size
+    int chunks;
+    int status;
+} httpd_req_t;
+
+// Fill in a request for uri with body (NULL for none)
+void sim_httpd_req_init(httpd_req_t *req, const char *uri, const char *body, char *resp, size_t resp_size);
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len);
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type);
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status);
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value);
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len);
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len);
+esp_err_t httpd_resp_send_err(httpd_req_t *r, httpd_err_code_t error, const char *msg);
+esp_err_t httpd_resp_send_500(httpd_req_t *r);
+esp_err_t httpd_resp_send_408(httpd_req_t *r);
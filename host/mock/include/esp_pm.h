@@ -0,0 +1,12 @@
+#pragma once
+
+#include "esp_err.h"
+
+// CONFIG_PM_ENABLE is off in the simulation; only the types are needed
+typedef struct esp_pm_lock *esp_pm_lock_handle_t;
+
+typedef enum {
+    ESP_PM_CPU_FREQ_MAX,
+    ESP_PM_APB_FREQ_MAX,
+    ESP_PM_NO_LIGHT_SLEEP,
+} esp_pm_lock_type_t;
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+// Heap of the host process is not tracked; a constant keeps the deltas at 0
+uint32_t esp_get_free_heap_size(void);
+uint32_t esp_get_minimum_free_heap_size(void);
+
+// Aborts the simulation; nothing in it is expected to restart
+void esp_restart(void) __attribute__((noreturn));
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+
+// FreeRTOS API on simulated time. Tasks are host threads, but only one of
+// them runs at a time and only until it blocks, so they behave as on a
+// single core without preemption (see sim.h).
+typedef int32_t BaseType_t;
+typedef uint32_t UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE             ((BaseType_t)0)
+#define pdTRUE              ((BaseType_t)1)
+#define pdFAIL              pdFALSE
+#define pdPASS              pdTRUE
+#define portMAX_DELAY       ((TickType_t)0xffffffffUL)
+#define configTICK_RATE_HZ  CONFIG_FREERTOS_HZ
+#define configMAX_TASK_NAME_LEN 16
+#define portTICK_PERIOD_MS  (1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)   ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000))
+#define tskNO_AFFINITY      0x7FFFFFFF
+
+// Buffers of the ...Static() constructors; the simulation ignores them and
+// allocates its own objects
+typedef uint8_t StackType_t;    // ESP-IDF counts stack depth in bytes
+typedef struct {
+    int unused;
+} StaticQueue_t;
+typedef StaticQueue_t StaticSemaphore_t;
+typedef StaticQueue_t StaticTimer_t;
+typedef StaticQueue_t StaticTask_t;
+
+// Nothing preempts, so critical sections need no lock
+typedef struct {
+    int unused;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED    { 0 }
+#define portENTER_CRITICAL(mux)         ((void)(mux))
+#define portEXIT_CRITICAL(mux)          ((void)(mux))
+#define portENTER_CRITICAL_ISR(mux)     ((void)(mux))
+#define portEXIT_CRITICAL_ISR(mux)      ((void)(mux))
+#define portYIELD_FROM_ISR(woken)       ((void)(woken))
+
+#define BIT0    0x00000001
+#define BIT1    0x00000002
+#define BIT2    0x00000004
+#define BIT3    0x00000008
@@ -0,0 +1,5 @@
+#pragma once
+
+// The few options the simulated components read; everything else is off
+#define CONFIG_FREERTOS_HZ          100
+#define CONFIG_LOG_DEFAULT_LEVEL    3
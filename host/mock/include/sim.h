@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+// Host simulation of the FreeRTOS and ESP-IDF calls the components make.
+//
+// Time is simulated: it only moves inside sim_run_until/sim_run_for (or a
+// vTaskDelay outside a task), jumping straight to the next timer, fade end
+// or task timeout. Tasks are threads of which exactly one runs at a time, the
+// caller of the sim_* functions (the harness) or one task until it blocks.
+// Timer, esp_timer and fade-end callbacks run on the simulation loop between
+// tasks.
+
+#define SIM_US_PER_DAY  (24LL * 3600 * 1000000)
+
+// Common header of everything that waits on simulated time
+typedef struct sim_event {
+    int64_t at;                 // Simulated microseconds
+    void (*fire)(struct sim_event *event);
+    bool queued;
+    struct sim_event *next;
+} sim_event_t;
+
+// Call once, first thing in main. The wall clock (time()) starts at epoch.
+void sim_start(time_t epoch);
+
+// Run tasks and fire every event due up to at (simulated microseconds)
+void sim_run_until(int64_t at);
+void sim_run_for(int64_t us);
+
+int64_t sim_now_us(void);
+
+// Events fired and task switches made since sim_start
+uint64_t sim_events_fired(void);
+uint64_t sim_task_switches(void);
+
+// Move the wall clock without moving simulated time, like an SNTP correction
+void sim_set_time(time_t t);
+
+// Call the SNTP sync callback registered by esp_netif_sntp_init with the
+// current wall clock; false if none was registered
+bool sim_sntp_sync(void);
+
+// Schedule event to fire at (clamped to now); rescheduling moves it. Events
+// due at the same time fire in the order they were scheduled.
+void sim_event_schedule(sim_event_t *event, int64_t at, void (*fire)(sim_event_t *event));
+void sim_event_cancel(sim_event_t *event);
+
+// What the simulated peripherals did
+uint32_t sim_ledc_duty(int channel);
+bool sim_ledc_running(int channel);         // False after ledc_stop until the next update
+uint32_t sim_ledc_fades(int channel);
+uint32_t sim_nvs_commits(void);
+
+// Abort with a message; used for calls the simulation cannot honor
+void sim_panic(const char *format, ...) __attribute__((noreturn, format(printf, 1, 2)));
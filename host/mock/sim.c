@@ -0,0 +1,638 @@
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
+#include "sim.h"
+
+typedef enum {
+    TASK_READY,
+    TASK_RUNNING,
+    TASK_BLOCKED,
+    TASK_DEAD,
+} task_state_t;
+
+// The timeout comes first so the event can be cast back to its task
+struct sim_task {
+    sim_event_t timeout;
+    pthread_t thread;
+    pthread_cond_t cond;
+    TaskFunction_t fn;
+    void *arg;
+    char name[configMAX_TASK_NAME_LEN];
+    UBaseType_t priority;
+    task_state_t state;
+    bool go;                    // This thread holds the turn
+    bool timed_out;
+    const void *wait_obj;       // What the task is blocked on
+    uint64_t ready_order;       // FIFO among tasks of equal priority
+    uint32_t notify_value;
+    bool notify_pending;
+    struct sim_task *next;
+};
+
+struct sim_queue {
+    uint8_t *items;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t count;
+    UBaseType_t head;
+};
+
+struct sim_timer {
+    sim_event_t expiry;
+    const char *name;
+    TickType_t period;
+    bool auto_reload;
+    void *id;
+    TimerCallbackFunction_t callback;
+};
+
+// Whoever runs holds big; the others wait on their condition variable
+static pthread_mutex_t big = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t loop_cond = PTHREAD_COND_INITIALIZER;
+static struct sim_task *tasks = NULL;
+static struct sim_task *current = NULL;    // NULL while the harness or the loop runs
+static sim_event_t *events = NULL;         // Sorted by time
+static int64_t now_us = 0;
+static time_t wall_base = 0;
+static uint64_t order = 0;
+static uint64_t events_fired = 0;
+static uint64_t task_switches = 0;
+
+void sim_panic(const char *format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    fprintf(stderr, "sim: ");
+    vfprintf(stderr, format, args);
+    fprintf(stderr, " (task %s, t=%.3f s)\n", current != NULL ? current->name : "-", now_us / 1e6);
+    va_end(args);
+    abort();
+}
+
+static int64_t ticks_to_us(TickType_t ticks)
+{
+    return (int64_t)ticks * 1000000 / configTICK_RATE_HZ;
+}
+
+// ---- Events -----------------------------------------------------------------
+
+void sim_event_cancel(sim_event_t *e)
+{
+    if (!e->queued) {
+        return;
+    }
+    for (sim_event_t **p = &events; *p != NULL; p = &(*p)->next) {
+        if (*p == e) {
+            *p = e->next;
+            break;
+        }
+    }
+    e->queued = false;
+}
+
+void sim_event_schedule(sim_event_t *e, int64_t at, void (*fire)(sim_event_t *event))
+{
+    sim_event_cancel(e);
+    e->at = at > now_us ? at : now_us;
+    e->fire = fire;
+    e->queued = true;
+
+    sim_event_t **p = &events;
+    while (*p != NULL && (*p)->at <= e->at) {
+        p = &(*p)->next;
+    }
+    e->next = *p;
+    *p = e;
+}
+
+// ---- Tasks ------------------------------------------------------------------
+
+static struct sim_task *self(const char *call)
+{
+    if (current == NULL) {
+        sim_panic("%s outside a task", call);
+    }
+    return current;
+}
+
+static void make_ready(struct sim_task *t)
+{
+    if (t->state != TASK_BLOCKED) {
+        return;
+    }
+    sim_event_cancel(&t->timeout);
+    t->state = TASK_READY;
+    t->ready_order = ++order;
+}
+
+static void wake_waiters(const void *obj)
+{
+    for (struct sim_task *t = tasks; t != NULL; t = t->next) {
+        if (t->state == TASK_BLOCKED && t->wait_obj == obj) {
+            make_ready(t);
+        }
+    }
+}
+
+// Hand the turn back to the loop until the task is picked again
+static void yield(struct sim_task *t)
+{
+    t->go = false;
+    current = NULL;
+    pthread_cond_signal(&loop_cond);
+    while (!t->go) {
+        pthread_cond_wait(&t->cond, &big);
+    }
+}
+
+static void timeout_fire(sim_event_t *e)
+{
+    struct sim_task *t = (struct sim_task *)e;
+    t->timed_out = true;
+    make_ready(t);
+}
+
+// Block the running task on obj until woken or the deadline (-1 for none);
+// false on timeout
+static bool block(const void *obj, int64_t deadline)
+{
+    struct sim_task *t = current;
+
+    t->state = TASK_BLOCKED;
+    t->wait_obj = obj;
+    t->timed_out = false;
+    if (deadline >= 0) {
+        sim_event_schedule(&t->timeout, deadline, timeout_fire);
+    }
+    yield(t);
+    t->wait_obj = NULL;
+    return !t->timed_out;
+}
+
+static int64_t deadline_after(TickType_t ticks)
+{
+    return ticks == portMAX_DELAY ? -1 : now_us + ticks_to_us(ticks);
+}
+
+static void *task_thread(void *arg)
+{
+    struct sim_task *t = arg;
+
+    pthread_mutex_lock(&big);
+    while (!t->go) {
+        pthread_cond_wait(&t->cond, &big);
+    }
+    t->fn(t->arg);
+    vTaskDelete(NULL);          // FreeRTOS tasks must not return
+    return NULL;
+}
+
+static struct sim_task *next_ready(void)
+{
+    struct sim_task *best = NULL;
+
+    for (struct sim_task *t = tasks; t != NULL; t = t->next) {
+        if (t->state == TASK_READY && (best == NULL || t->priority > best->priority ||
+                                       (t->priority == best->priority && t->ready_order < best->ready_order))) {
+            best = t;
+        }
+    }
+    return best;
+}
+
+static void run_task(struct sim_task *t)
+{
+    task_switches++;
+    t->state = TASK_RUNNING;
+    t->go = true;
+    current = t;
+    pthread_cond_signal(&t->cond);
+    while (current != NULL) {
+        pthread_cond_wait(&loop_cond, &big);
+    }
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *out_handle, BaseType_t core_id)
+{
+    struct sim_task *t = calloc(1, sizeof(*t));
+    if (t == NULL) {
+        return pdFAIL;
+    }
+    t->fn = fn;
+    t->arg = arg;
+    t->priority = priority;
+    snprintf(t->name, sizeof(t->name), "%s", name);
+    pthread_cond_init(&t->cond, NULL);
+
+    // Runs once the loop picks it, like a task created from a lower priority
+    t->state = TASK_READY;
+    t->ready_order = ++order;
+    if (pthread_create(&t->thread, NULL, task_thread, t) != 0) {
+        free(t);
+        return pdFAIL;
+    }
+    pthread_detach(t->thread);
+    t->next = tasks;
+    tasks = t;
+
+    if (out_handle != NULL) {
+        *out_handle = t;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                       UBaseType_t priority, TaskHandle_t *out_handle)
+{
+    return xTaskCreatePinnedToCore(fn, name, stack_depth, arg, priority, out_handle, tskNO_AFFINITY);
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                                           UBaseType_t priority, StackType_t *stack, StaticTask_t *buffer,
+                                           BaseType_t core_id)
+{
+    TaskHandle_t handle = NULL;
+    xTaskCreatePinnedToCore(fn, name, stack_depth, arg, priority, &handle, core_id);
+    return handle;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    struct sim_task *t = task != NULL ? task : self("vTaskDelete");
+
+    sim_event_cancel(&t->timeout);
+    t->state = TASK_DEAD;
+    if (t == current) {
+        current = NULL;
+        pthread_cond_signal(&loop_cond);
+        pthread_mutex_unlock(&big);
+        pthread_exit(NULL);
+    }
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    if (current == NULL) {
+        // The harness waiting lets the simulation run
+        sim_run_for(ticks_to_us(ticks));
+        return;
+    }
+    block(&current->timeout, now_us + ticks_to_us(ticks));
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(now_us * configTICK_RATE_HZ / 1000000);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return current;
+}
+
+BaseType_t xTaskNotify(TaskHandle_t t, uint32_t value, eNotifyAction action)
+{
+    switch (action) {
+    case eSetBits:
+        t->notify_value |= value;
+        break;
+    case eIncrement:
+        t->notify_value++;
+        break;
+    case eSetValueWithOverwrite:
+        t->notify_value = value;
+        break;
+    default:
+        break;
+    }
+    t->notify_pending = true;
+    wake_waiters(&t->notify_value);
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t t, uint32_t value, eNotifyAction action, BaseType_t *woken)
+{
+    if (woken != NULL) {
+        *woken = pdTRUE;
+    }
+    return xTaskNotify(t, value, action);
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t *value, TickType_t ticks)
+{
+    struct sim_task *t = self("xTaskNotifyWait");
+    int64_t deadline = deadline_after(ticks);
+
+    if (!t->notify_pending) {
+        t->notify_value &= ~clear_on_entry;
+        while (!t->notify_pending && ticks != 0 && block(&t->notify_value, deadline)) {
+        }
+    }
+    if (value != NULL) {
+        *value = t->notify_value;
+    }
+    if (!t->notify_pending) {
+        return pdFALSE;
+    }
+    t->notify_value &= ~clear_on_exit;
+    t->notify_pending = false;
+    return pdTRUE;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks)
+{
+    struct sim_task *t = self("ulTaskNotifyTake");
+    int64_t deadline = deadline_after(ticks);
+
+    while (t->notify_value == 0 && ticks != 0 && block(&t->notify_value, deadline)) {
+    }
+    uint32_t value = t->notify_value;
+    if (value != 0) {
+        t->notify_value = clear_on_exit ? 0 : value - 1;
+    }
+    t->notify_pending = false;
+    return value;
+}
+
+// ---- Queues and semaphores ----------------------------------------------------
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct sim_queue *q = calloc(1, sizeof(*q));
+    if (q == NULL) {
+        return NULL;
+    }
+    q->length = length;
+    q->item_size = item_size;
+    if (item_size > 0) {
+        q->items = calloc(length, item_size);
+        if (q->items == NULL) {
+            free(q);
+            return NULL;
+        }
+    }
+    return q;
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t *storage, StaticQueue_t *buffer)
+{
+    return xQueueCreate(length, item_size);
+}
+
+void vQueueDelete(QueueHandle_t q)
+{
+    free(q->items);
+    free(q);
+}
+
+// Wait on q while full (or empty); only tasks can wait
+static bool wait_queue(QueueHandle_t q, bool for_space, TickType_t ticks)
+{
+    int64_t deadline = deadline_after(ticks);
+
+    while (for_space ? q->count == q->length : q->count == 0) {
+        if (ticks == 0) {
+            return false;
+        }
+        if (current == NULL) {
+            sim_panic("harness would block on a queue");
+        }
+        if (!block(q, deadline)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t ticks)
+{
+    if (!wait_queue(q, true, ticks)) {
+        return pdFALSE;
+    }
+    if (q->item_size > 0) {
+        memcpy(q->items + ((q->head + q->count) % q->length) * q->item_size, item, q->item_size);
+    }
+    q->count++;
+    wake_waiters(q);
+    return pdTRUE;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t q, const void *item, BaseType_t *woken)
+{
+    if (woken != NULL) {
+        *woken = pdTRUE;
+    }
+    return xQueueSend(q, item, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t ticks)
+{
+    if (!wait_queue(q, false, ticks)) {
+        return pdFALSE;
+    }
+    if (q->item_size > 0) {
+        memcpy(item, q->items + q->head * q->item_size, q->item_size);
+    }
+    q->head = (q->head + 1) % q->length;
+    q->count--;
+    wake_waiters(q);
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q)
+{
+    return q->count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial)
+{
+    QueueHandle_t q = xQueueCreate(max, 0);
+    if (q != NULL) {
+        q->count = initial;
+    }
+    return q;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return xSemaphoreCreateCounting(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buffer)
+{
+    return xSemaphoreCreateMutex();
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return xSemaphoreCreateCounting(1, 0);
+}
+
+// ---- Software timers ------------------------------------------------------------
+
+static void timer_fire(sim_event_t *e)
+{
+    struct sim_timer *tm = (struct sim_timer *)e;
+
+    if (tm->auto_reload) {
+        sim_event_schedule(e, e->at + ticks_to_us(tm->period), timer_fire);
+    }
+    tm->callback(tm);
+}
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload, void *id,
+                           TimerCallbackFunction_t callback)
+{
+    if (period == 0) {
+        return NULL;
+    }
+    struct sim_timer *tm = calloc(1, sizeof(*tm));
+    if (tm != NULL) {
+        tm->name = name;
+        tm->period = period;
+        tm->auto_reload = auto_reload;
+        tm->id = id;
+        tm->callback = callback;
+    }
+    return tm;
+}
+
+TimerHandle_t xTimerCreateStatic(const char *name, TickType_t period, UBaseType_t auto_reload, void *id,
+                                 TimerCallbackFunction_t callback, StaticTimer_t *buffer)
+{
+    return xTimerCreate(name, period, auto_reload, id, callback);
+}
+
+BaseType_t xTimerStart(TimerHandle_t tm, TickType_t ticks)
+{
+    sim_event_schedule(&tm->expiry, now_us + ticks_to_us(tm->period), timer_fire);
+    return pdPASS;
+}
+
+BaseType_t xTimerReset(TimerHandle_t tm, TickType_t ticks)
+{
+    return xTimerStart(tm, ticks);
+}
+
+BaseType_t xTimerStop(TimerHandle_t tm, TickType_t ticks)
+{
+    sim_event_cancel(&tm->expiry);
+    return pdPASS;
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t tm, TickType_t period, TickType_t ticks)
+{
+    if (period == 0) {
+        return pdFAIL;
+    }
+    tm->period = period;
+    return xTimerStart(tm, ticks);
+}
+
+BaseType_t xTimerDelete(TimerHandle_t tm, TickType_t ticks)
+{
+    sim_event_cancel(&tm->expiry);
+    free(tm);
+    return pdPASS;
+}
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t tm)
+{
+    return tm->expiry.queued ? pdTRUE : pdFALSE;
+}
+
+TickType_t xTimerGetPeriod(TimerHandle_t tm)
+{
+    return tm->period;
+}
+
+TickType_t xTimerGetExpiryTime(TimerHandle_t tm)
+{
+    return (TickType_t)(tm->expiry.at * configTICK_RATE_HZ / 1000000);
+}
+
+void *pvTimerGetTimerID(TimerHandle_t tm)
+{
+    return tm->id;
+}
+
+// ---- Simulation loop --------------------------------------------------------------
+
+void sim_start(time_t epoch)
+{
+    // The harness holds the turn from here on, except inside sim_run_until
+    pthread_mutex_lock(&big);
+    wall_base = epoch;
+}
+
+void sim_run_until(int64_t at)
+{
+    if (current != NULL) {
+        sim_panic("sim_run_until from a task");
+    }
+
+    while (true) {
+        struct sim_task *t = next_ready();
+        if (t != NULL) {
+            run_task(t);
+            continue;
+        }
+        if (events != NULL && events->at <= at) {
+            sim_event_t *e = events;
+            events = e->next;
+            e->queued = false;
+            now_us = e->at;
+            events_fired++;
+            e->fire(e);
+            continue;
+        }
+        break;
+    }
+    if (now_us < at) {
+        now_us = at;
+    }
+}
+
+void sim_run_for(int64_t us)
+{
+    sim_run_until(now_us + us);
+}
+
+int64_t sim_now_us(void)
+{
+    return now_us;
+}
+
+uint64_t sim_events_fired(void)
+{
+    return events_fired;
+}
+
+uint64_t sim_task_switches(void)
+{
+    return task_switches;
+}
+
+void sim_set_time(time_t t)
+{
+    wall_base = t - (time_t)(now_us / 1000000);
+}
+
+// Linked with --wrap=time, so the components' time(NULL) reads this clock
+time_t __wrap_time(time_t *out)
+{
+    time_t t = wall_base + (time_t)(now_us / 1000000);
+    if (out != NULL) {
+        *out = t;
+    }
+    return t;
+}
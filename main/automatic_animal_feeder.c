@@ -1,176 +1,397 @@
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/param.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/timers.h"
+#include "freertos/semphr.h"
 #include "esp_system.h"
-#include "esp_wifi.h"
-#include "esp_event.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
-#include "lwip/err.h"
-#include "lwip/sys.h"
-#include "driver/ledc.h"
 #include "esp_http_server.h"
+#include "sdkconfig.h"
+#include "web_assets.h"
+#include "ws_push.h"
+#include "actuator.h"
+#include "servo_cal.h"
+#include "config_store.h"
+#include "scheduler.h"
+#include "json_writer.h"
+#include "json_reader.h"
+#include "metrics.h"
+#include "http_async.h"
+#include "http_arena.h"
+#include "rate_limit.h"
+#include "network.h"
+#include "trace.h"
+#include "feeder.h"
+#if CONFIG_FEEDER_POWER_SAVE
+#include "power.h"
+#endif
+#if CONFIG_FEEDER_DEEP_SLEEP
+#include "deep_sleep.h"
+#endif
+#if CONFIG_FEEDER_SCALE
+#include "scale.h"
+#endif
+#if CONFIG_FEEDER_EVENT_LOG
+#include "event_log.h"
+#endif
+#if CONFIG_FEEDER_FILL_LEVEL
+#include "fill_level.h"
+#endif
+#if CONFIG_FEEDER_FILL_LEVEL || CONFIG_FEEDER_CURRENT_SENSE
+#include "adc_stream.h"
+#endif
 
-#define SERVO_PIN           15       // GPIO pin for servo control
-#define SERVO_TIMER         LEDC_TIMER_0
-#define SERVO_CHANNEL       LEDC_CHANNEL_0
-#define SERVO_FREQUENCY     50          // 50Hz for servo control
-#define SERVO_RESOLUTION    LEDC_TIMER_13_BIT
+// Pin, positions, WiFi credentials and optional features are set in
+// menuconfig under "Animal Feeder" (main/Kconfig.projbuild)
 
-// Pulse width values for servo positions
-#define SERVO_90_DEGREES    (4096 * 0.5 / 20)  // 90 degrees (center position)
-#define SERVO_75_DEGREES    (4096 * 1.5 / 20) // 75 degrees (rotate)
-
-// WiFi configuration
-#define WIFI_SSID       "pet_feeder"
-#define WIFI_PASSWORD   "12341234"
-#define MAX_RETRY       5
+// httpd keeps three sockets of its own besides the client connections
+#define FEEDER_HTTPD_SOCKETS    MIN(CONFIG_FEEDER_HTTPD_MAX_SOCKETS, CONFIG_LWIP_MAX_SOCKETS - 3)
 
 static const char *TAG = "automatic_feeder";
-static TimerHandle_t servo_reset_timer = NULL;
 static TimerHandle_t auto_feed_timer = NULL;
+static StaticTimer_t auto_feed_timer_buffer;
 static httpd_handle_t server = NULL;
-static int auto_feed_interval = 0; // In minutes, 0 means disabled
+static int servo_gpios[ACTUATOR_MAX_HOPPERS];
+static int hopper_count = 0;
+
+// Per hopper: who asked for the queued feed and the hold it asked for (0
+// for the hopper's default), then the same for the running one. The queued
+// values are only written once actuator_feed() has accepted the feed, and
+// latched when it starts, both under feed_lock, so a request refused while
+// another feed is queued or running cannot relabel it.
+static SemaphoreHandle_t feed_lock = NULL;
+static StaticSemaphore_t feed_lock_buffer;
+static feed_source_t next_source[ACTUATOR_MAX_HOPPERS];
+static feed_source_t feed_source[ACTUATOR_MAX_HOPPERS];
+static uint32_t next_hold[ACTUATOR_MAX_HOPPERS];
+static uint32_t feed_hold[ACTUATOR_MAX_HOPPERS];
+
+static const char *const source_names[] = {
+    [FEED_SOURCE_HTTP]     = "http",
+    [FEED_SOURCE_WS]       = "ws",
+    [FEED_SOURCE_TIMER]    = "timer",
+    [FEED_SOURCE_SCHEDULE] = "schedule",
+    [FEED_SOURCE_WAKE]     = "wake",
+    [FEED_SOURCE_BATCH]    = "batch",
+    [FEED_SOURCE_MQTT]     = "mqtt",
+};
 
-// Initialize servo motor
-static void servo_init(void)
+// One hopper per GPIO in CONFIG_FEEDER_SERVO_GPIOS, e.g. "15,16,17"
+static void parse_servo_gpios(void)
 {
-    // Configure LEDC timer for servo control
-    ledc_timer_config_t ledc_timer = {
-        .duty_resolution = SERVO_RESOLUTION,
-        .freq_hz = SERVO_FREQUENCY,
-        .speed_mode = LEDC_LOW_SPEED_MODE,
-        .timer_num = SERVO_TIMER,
-        .clk_cfg = LEDC_AUTO_CLK,
-    };
-    ledc_timer_config(&ledc_timer);
-
-    // Configure LEDC channel for servo control
-    ledc_channel_config_t ledc_channel = {
-        .channel = SERVO_CHANNEL,
-        .duty = SERVO_90_DEGREES,  // Default 90 degrees
-        .gpio_num = SERVO_PIN,
-        .speed_mode = LEDC_LOW_SPEED_MODE,
-        .timer_sel = SERVO_TIMER,
-    };
-    ledc_channel_config(&ledc_channel);
+    const char *p = CONFIG_FEEDER_SERVO_GPIOS;
 
-    // Set servo to default position (90 degrees)
-    ledc_set_duty(LEDC_LOW_SPEED_MODE, SERVO_CHANNEL, SERVO_90_DEGREES);
-    ledc_update_duty(LEDC_LOW_SPEED_MODE, SERVO_CHANNEL);
+    while (*p != '\0' && hopper_count < ACTUATOR_MAX_HOPPERS) {
+        char *end;
+        long gpio = strtol(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        servo_gpios[hopper_count++] = gpio;
+        p = end;
+        while (*p == ',' || *p == ' ') {
+            p++;
+        }
+    }
+    if (hopper_count == 0) {
+        ESP_LOGE(TAG, "No servo GPIO configured, CONFIG_FEEDER_SERVO_GPIOS is \"%s\"", CONFIG_FEEDER_SERVO_GPIOS);
+    }
 }
 
-// Set servo position
-static void set_servo_position(uint32_t duty)
+esp_err_t feeder_query_uint(httpd_req_t *req, const char *key, uint32_t *value)
 {
-    ledc_set_duty(LEDC_LOW_SPEED_MODE, SERVO_CHANNEL, duty);
-    ledc_update_duty(LEDC_LOW_SPEED_MODE, SERVO_CHANNEL);
+    char query[64];
+    char param[12];
+
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+        httpd_query_key_value(query, key, param, sizeof(param)) != ESP_OK) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    char *end;
+    unsigned long parsed = strtoul(param, &end, 10);
+    if (end == param || *end != '\0' || param[0] == '-' || parsed > UINT32_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *value = parsed;
+    return ESP_OK;
 }
 
-// Execute feeding action
-static void do_feed(void)
+bool feeder_request_hopper(httpd_req_t *req, int *hopper)
 {
-    ESP_LOGI(TAG, "Moving servo to 75 degrees for feeding");
+    uint32_t value;
+
+    *hopper = 0;
+    esp_err_t err = feeder_query_uint(req, "hopper", &value);
+    if (err == ESP_ERR_NOT_FOUND) {
+        return true;
+    }
+    if (err != ESP_OK || value >= (uint32_t)actuator_hopper_count()) {
+        return false;
+    }
+    *hopper = value;
+    return true;
+}
 
-    // Move servo to 75 degrees
-    set_servo_position(SERVO_75_DEGREES);
+void feeder_write_settings(json_writer_t *w, int hopper)
+{
+    const hopper_config_t *hc = &config_store_get()->hoppers[hopper];
 
-    // Start timer to reset servo after 5 seconds
-    xTimerReset(servo_reset_timer, 100);
+    json_add_int(w, "current_pwm", actuator_get_duty(hopper));
+    json_add_int(w, "default_pwm", hc->default_pwm);
+    json_add_int(w, "feed_pwm", hc->feed_pwm);
+    json_add_int(w, "reset_delay_ms", hc->reset_delay_ms);
+    json_add_int(w, "ramp_ms", actuator_get_ramp_ms(hopper));
+    json_add_string(w, "profile", actuator_get_profile(hopper)->name);
+#if CONFIG_FEEDER_FILL_LEVEL
+    json_add_int(w, "level", fill_level_get(hopper));
+#endif
 }
 
-// Timer callback to reset servo to default position
-static void servo_reset_timer_callback(TimerHandle_t xTimer)
+const char *feeder_source_name(feed_source_t source)
 {
-    ESP_LOGI(TAG, "Resetting servo to 90 degrees (default position)");
-    set_servo_position(SERVO_90_DEGREES);
+    if ((unsigned)source < sizeof(source_names) / sizeof(source_names[0]) && source_names[source] != NULL) {
+        return source_names[source];
+    }
+    return "unknown";
 }
 
-// Automatic feeding timer callback
-static void auto_feed_timer_callback(TimerHandle_t xTimer)
+void feeder_format_state(char *buf, size_t size, int hopper, const char *event)
 {
-    ESP_LOGI(TAG, "Auto feeding triggered");
-    do_feed();
+    json_writer_t w;
+    json_writer_init(&w, NULL, buf, size);
+    json_begin_object(&w, NULL);
+    json_add_string(&w, "event", event);
+    json_add_int(&w, "hopper", hopper);
+    json_add_int(&w, "hoppers", actuator_hopper_count());
+    json_add_int(&w, "pwm", actuator_get_duty(hopper));
+    json_add_int(&w, "minutes", config_store_get()->auto_feed_interval);
+    feeder_write_settings(&w, hopper);
+    json_end_object(&w);
+    json_writer_finish(&w);
 }
 
-// WiFi event handler
-static void wifi_event_handler(void *arg, esp_event_base_t event_base,
-                               int32_t event_id, void *event_data)
+void feeder_push_state(int hopper, const char *event)
 {
-    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
-        esp_wifi_connect();
-    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        static int s_retry_num = 0;
-        if (s_retry_num < MAX_RETRY) {
-            esp_wifi_connect();
-            s_retry_num++;
-            ESP_LOGI(TAG, "Retrying to connect to the AP");
-        } else {
-            ESP_LOGI(TAG, "Failed to connect to the AP");
-        }
-    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
-        ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
-        ESP_LOGI(TAG, "Got IP: " IPSTR, IP2STR(&event->ip_info.ip));
+    char msg[FEEDER_STATE_LEN];
+    feeder_format_state(msg, sizeof(msg), hopper, event);
+    ws_push_broadcast(msg);
+#if CONFIG_FEEDER_MQTT
+    mqtt_link_state_changed(hopper);
+#endif
+}
+
+// Actuator state changes, reported from the actuator task
+static void actuator_event_handler(int hopper, actuator_event_t event, uint32_t duty)
+{
+    if (event == ACTUATOR_EVENT_FEED) {
+        xSemaphoreTake(feed_lock, portMAX_DELAY);
+        feed_source[hopper] = next_source[hopper];
+        feed_hold[hopper] = next_hold[hopper];
+        xSemaphoreGive(feed_lock);
+    }
+
+#if CONFIG_FEEDER_FEED_LIMIT
+    feed_guard_actuator_event(hopper, event);
+#endif
+    // The portion and the current measurement close first, so they go into
+    // the log record
+#if CONFIG_FEEDER_SCALE
+    portion_actuator_event(hopper, event);
+#endif
+#if CONFIG_FEEDER_CURRENT_SENSE
+    jam_detect_actuator_event(hopper, event, feed_source[hopper], feed_hold[hopper]);
+#endif
+#if CONFIG_FEEDER_EVENT_LOG
+    feed_log_actuator_event(hopper, event, duty, feed_source[hopper]);
+#endif
+#if CONFIG_FEEDER_MQTT
+    mqtt_link_actuator_event(hopper, event, duty, feed_source[hopper]);
+#endif
+    if (event == ACTUATOR_EVENT_FEED) {
+        feeder_push_state(hopper, "feed");
+    } else if (event == ACTUATOR_EVENT_MOVE) {
+        feeder_push_state(hopper, "servo");
+    } else {
+        feeder_push_state(hopper, "reset");
     }
 }
 
-// Initialize WiFi as station
-static void wifi_init_sta(void)
+int feeder_actuator_config(actuator_config_t *hoppers)
 {
-    ESP_ERROR_CHECK(esp_netif_init());
-    ESP_ERROR_CHECK(esp_event_loop_create_default());
-    esp_netif_create_default_wifi_sta();
+    const feeder_config_t *cfg = config_store_get();
 
-    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+    for (int i = 0; i < hopper_count; i++) {
+        const hopper_config_t *hc = &cfg->hoppers[i];
+        hoppers[i] = (actuator_config_t) {
+            .gpio_num  = servo_gpios[i],
+            .rest_duty = hc->default_pwm,
+            .min_duty  = servo_angle_to_duty(0),
+            .max_duty  = servo_angle_to_duty(SERVO_MAX_ANGLE),
+            .ramp_ms   = hc->ramp_ms,
+            .ease      = MOTION_EASE_IN_OUT,
+            .profile   = motion_find_profile(hc->profile),
+#if CONFIG_FEEDER_POWER_SAVE
+            .release_at_rest = true,
+#endif
+        };
+    }
+    return hopper_count;
+}
 
-    ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, NULL));
-    ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &wifi_event_handler, NULL));
+esp_err_t feeder_feed(int hopper, uint32_t hold_ms, feed_source_t source)
+{
+    if (hopper < 0 || hopper >= actuator_hopper_count()) {
+        TRACE_LOGW(TAG, "No hopper %d", hopper);
+        return ESP_ERR_INVALID_ARG;
+    }
+    const hopper_config_t *hc = &config_store_get()->hoppers[hopper];
+    // actuator_feed() never blocks; the feed event waits for the labels
+    xSemaphoreTake(feed_lock, portMAX_DELAY);
+    esp_err_t err = actuator_feed(hopper, hc->feed_pwm, hold_ms > 0 ? hold_ms : hc->reset_delay_ms);
+    if (err == ESP_OK) {
+        next_source[hopper] = source;
+        next_hold[hopper] = hold_ms;
+    }
+    xSemaphoreGive(feed_lock);
+    if (err == ESP_ERR_INVALID_STATE) {
+        TRACE_LOGI(TAG, "Hopper %d already feeding", hopper);
+    } else if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Feed not queued: %s", esp_err_to_name(err));
+    }
+    return err;
+}
 
-    wifi_config_t wifi_config = {
-        .sta = {
-            .ssid = WIFI_SSID,
-            .password = WIFI_PASSWORD,
-        },
-    };
-    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
-    ESP_ERROR_CHECK(esp_wifi_start());
+// Feed nobody is watching; an empty hopper is skipped rather than having
+// the servo grind through nothing
+static void timed_feed(int hopper, uint32_t hold_ms, feed_source_t source)
+{
+#if CONFIG_FEEDER_FILL_LEVEL
+    if (fill_monitor_empty(hopper)) {
+        ESP_LOGW(TAG, "Hopper %d empty, %s feed skipped", hopper, feeder_source_name(source));
+        return;
+    }
+#endif
+    feeder_feed(hopper, hold_ms, source);
+}
 
-    ESP_LOGI(TAG, "wifi_init_sta finished");
+// Automatic feeding timer callback - every hopper at once
+static void auto_feed_timer_callback(TimerHandle_t xTimer)
+{
+    TRACE_LOGI(TAG, "Auto feeding triggered");
+    for (int i = 0; i < actuator_hopper_count(); i++) {
+        timed_feed(i, 0, FEED_SOURCE_TIMER);
+    }
 }
 
-// Update timer interval
-static void update_auto_feed_timer(int minutes)
+#if CONFIG_FEEDER_SCHEDULER
+// Scheduled feeding, called from the scheduler's timer
+static void schedule_fire_callback(int id, const schedule_entry_t *entry)
 {
-    auto_feed_interval = minutes;
+    timed_feed(entry->hopper, entry->portion_ms, FEED_SOURCE_SCHEDULE);
+}
+#endif
 
+void feeder_restart_auto_feed_timer(uint32_t minutes)
+{
     if (auto_feed_timer != NULL) {
         xTimerStop(auto_feed_timer, 0);
 
         if (minutes > 0) {
-            // Convert minutes to ticks
-            uint32_t timer_period = pdMS_TO_TICKS(minutes * 60 * 1000);
+            // Convert minutes to ticks; pdMS_TO_TICKS() would overflow its
+            // 32-bit product well below a week
+            minutes = MIN(minutes, FEEDER_MAX_TIMER_MIN);
+            TickType_t timer_period = (TickType_t)((uint64_t)minutes * 60 * configTICK_RATE_HZ);
 
             xTimerChangePeriod(auto_feed_timer, timer_period, 0);
             xTimerStart(auto_feed_timer, 0);
 
-            ESP_LOGI(TAG, "Auto feeding timer set to %d minutes", minutes);
+            ESP_LOGI(TAG, "Auto feeding timer set to %lu minutes", (unsigned long)minutes);
         } else {
             ESP_LOGI(TAG, "Auto feeding timer disabled");
         }
     }
 }
 
-// Feed handler - activates the servo when requested
+// Update timer interval
+static void update_auto_feed_timer(uint32_t minutes)
+{
+    feeder_config_t cfg = *config_store_get();
+
+    // Also brings an interval stored before the limit back into range
+    minutes = MIN(minutes, FEEDER_MAX_TIMER_MIN);
+    // Persisted by the config store's writer task, not here
+    cfg.auto_feed_interval = minutes;
+    config_store_set(&cfg);
+
+    feeder_restart_auto_feed_timer(minutes);
+    feeder_push_state(0, "timer");
+}
+
+// Feed handler - activates the servo when requested, by time or by weight
+// with ?grams=N
 static esp_err_t feed_handler(httpd_req_t *req)
 {
-    do_feed();
+    int hopper;
+    if (!feeder_request_hopper(req, &hopper)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown hopper");
+        return ESP_FAIL;
+    }
+    uint32_t grams = 0;
+#if CONFIG_FEEDER_SCALE
+    esp_err_t query = feeder_query_uint(req, "grams", &grams);
+    if (query == ESP_ERR_INVALID_ARG || (query == ESP_OK && grams == 0)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid grams");
+        return ESP_FAIL;
+    }
+#endif
+
+    char resp[100];
+#if CONFIG_FEEDER_FEED_LIMIT
+    // Double taps, retries and scripts are answered here, without a feed
+    uint32_t retry_ms;
+    feed_guard_result_t admit = feed_guard_check(req, hopper, &retry_ms);
+    if (admit == FEED_GUARD_LIMITED) {
+        return rate_limit_send_429(req, retry_ms, "Too many feed requests");
+    } else if (admit == FEED_GUARD_MERGED) {
+        snprintf(resp, sizeof(resp), "Hopper %d already feeding, request merged", hopper);
+        httpd_resp_set_type(req, "text/plain");
+        return httpd_resp_sendstr(req, resp);
+    }
+#endif
+
+#if CONFIG_FEEDER_SCALE
+    esp_err_t err = grams > 0 ? portion_feed(hopper, grams, FEED_SOURCE_HTTP) : feeder_feed(hopper, 0, FEED_SOURCE_HTTP);
+#else
+    esp_err_t err = feeder_feed(hopper, 0, FEED_SOURCE_HTTP);
+#endif
+#if CONFIG_FEEDER_FEED_LIMIT
+    if (err == ESP_OK) {
+        feed_guard_started(req, hopper);
+    }
+#endif
 
     // Prepare response
-    const char *resp = "Feeding started, servo will reset to 90 degrees in 5 seconds";
+    if (err == ESP_ERR_INVALID_STATE) {
+        httpd_resp_set_status(req, "409 Conflict");
+        snprintf(resp, sizeof(resp), "Busy: a feed is already in progress");
+    } else if (err == ESP_ERR_NOT_FOUND) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        snprintf(resp, sizeof(resp), "Scale not ready");
+    } else if (err != ESP_OK) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        snprintf(resp, sizeof(resp), "Busy: feeder command queue is full");
+    } else if (grams > 0) {
+        snprintf(resp, sizeof(resp), "Hopper %d feeding %lu g", hopper, (unsigned long)grams);
+    } else {
+        snprintf(resp, sizeof(resp), "Hopper %d feeding, servo will reset in %lu ms", hopper,
+                 (unsigned long)config_store_get()->hoppers[hopper].reset_delay_ms);
+    }
     httpd_resp_set_type(req, "text/plain");
     httpd_resp_send(req, resp, strlen(resp));
 
@@ -180,29 +401,22 @@ static esp_err_t feed_handler(httpd_req_t *req)
 // Timer setting handler
 static esp_err_t set_timer_handler(httpd_req_t *req)
 {
-    char buf[50];
-    int ret, minutes;
-
-    // Get query string
-    ret = httpd_req_get_url_query_str(req, buf, sizeof(buf));
-    if (ret != ESP_OK) {
+    uint32_t minutes;
+    esp_err_t err = feeder_query_uint(req, "minutes", &minutes);
+    if (err == ESP_ERR_NOT_FOUND) {
         httpd_resp_send_404(req);
         return ESP_FAIL;
     }
-
-    char param[32];
-    ret = httpd_query_key_value(buf, "minutes", param, sizeof(param));
-    if (ret != ESP_OK) {
-        httpd_resp_send_404(req);
+    if (err != ESP_OK || minutes > FEEDER_MAX_TIMER_MIN) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid minutes");
         return ESP_FAIL;
     }
 
-    minutes = atoi(param);
     update_auto_feed_timer(minutes);
 
     char resp[100];
     if (minutes > 0) {
-        snprintf(resp, sizeof(resp), "Auto feeding timer set to %d minutes", minutes);
+        snprintf(resp, sizeof(resp), "Auto feeding timer set to %lu minutes", (unsigned long)minutes);
     } else {
         snprintf(resp, sizeof(resp), "Auto feeding timer disabled");
     }
@@ -217,7 +431,7 @@ static esp_err_t set_timer_handler(httpd_req_t *req)
 static esp_err_t get_timer_status_handler(httpd_req_t *req)
 {
     char resp[50];
-    snprintf(resp, sizeof(resp), "%d", auto_feed_interval);
+    snprintf(resp, sizeof(resp), "%d", (int)config_store_get()->auto_feed_interval);
 
     httpd_resp_set_type(req, "text/plain");
     httpd_resp_send(req, resp, strlen(resp));
@@ -225,121 +439,313 @@ static esp_err_t get_timer_status_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
+#if CONFIG_FEEDER_SCHEDULER
+// List the feeding schedule and the next deadline
+static esp_err_t get_schedule_handler(httpd_req_t *req)
+{
+    int next_id = -1;
+    time_t next = scheduler_next_due(&next_id);
+
+    char buf[256];
+    json_writer_t w;
+    json_writer_init(&w, req, buf, sizeof(buf));
+    json_begin_object(&w, NULL);
+    json_add_bool(&w, "time_valid", scheduler_time_valid());
+    json_add_int(&w, "now", time(NULL));
+    json_add_int(&w, "next", next);
+    json_add_int(&w, "next_id", next_id);
+
+    // A full table is larger than buf and goes out in chunks
+    json_begin_array(&w, "entries");
+    for (int i = 0; i < SCHEDULER_MAX_ENTRIES; i++) {
+        schedule_entry_t entry;
+        if (!scheduler_get(i, &entry)) {
+            continue;
+        }
+        json_begin_object(&w, NULL);
+        json_add_int(&w, "id", i);
+        json_add_int(&w, "hopper", entry.hopper);
+        json_add_int(&w, "hour", entry.hour);
+        json_add_int(&w, "minute", entry.minute);
+        json_add_int(&w, "days", entry.days);
+        json_add_int(&w, "portion_ms", entry.portion_ms);
+        json_add_bool(&w, "enabled", entry.enabled);
+        json_end_object(&w);
+    }
+    json_end_array(&w);
+    json_end_object(&w);
+
+    return json_writer_finish(&w);
+}
+
+// Fields of a schedule request, see set_schedule_handler
+typedef struct {
+    int id;
+    bool delete;
+    bool has_hour;
+    bool has_minute;
+    bool has_days;
+    int hour;
+    int minute;
+    int days;
+    int hopper;
+    int portion_ms;
+    bool enabled;
+} schedule_request_t;
+
+static esp_err_t schedule_event(const json_event_t *ev, void *ctx)
+{
+    schedule_request_t *r = ctx;
+
+    if (ev->depth != 1 || ev->key == NULL) {
+        return ESP_OK;
+    }
+    if (strcmp(ev->key, "delete") == 0) {
+        r->delete = ev->type == JSON_EVENT_BOOL && ev->boolean;
+    } else if (strcmp(ev->key, "enabled") == 0) {
+        r->enabled = ev->type == JSON_EVENT_BOOL && ev->boolean;
+    } else if (ev->type != JSON_EVENT_NUMBER) {
+        return ESP_OK;
+    }
+
+    // Out of range numbers end up negative and are refused below
+    int value = ev->number >= INT32_MIN && ev->number <= INT32_MAX ? (int)ev->number : -1;
+    if (strcmp(ev->key, "id") == 0) {
+        r->id = value;
+    } else if (strcmp(ev->key, "hour") == 0) {
+        r->has_hour = true;
+        r->hour = value;
+    } else if (strcmp(ev->key, "minute") == 0) {
+        r->has_minute = true;
+        r->minute = value;
+    } else if (strcmp(ev->key, "days") == 0) {
+        r->has_days = true;
+        r->days = value;
+    } else if (strcmp(ev->key, "hopper") == 0) {
+        r->hopper = value;
+    } else if (strcmp(ev->key, "portion_ms") == 0) {
+        r->portion_ms = value;
+    }
+    return ESP_OK;
+}
+
+// Add, replace or delete a schedule entry:
+// {"id":2,"hopper":1,"hour":7,"minute":30,"days":62,"portion_ms":3000,"enabled":true}
+// {"id":2,"delete":true}
+static esp_err_t set_schedule_handler(httpd_req_t *req)
+{
+    schedule_request_t request = { .id = -1, .enabled = true };
+    json_reader_t reader;
+
+    json_reader_init(&reader, schedule_event, &request);
+    esp_err_t err = json_reader_parse_request(&reader, req);
+    if (err == ESP_ERR_TIMEOUT) {
+        httpd_resp_send_408(req);
+        return ESP_FAIL;
+    } else if (err == ESP_FAIL) {
+        return ESP_FAIL;                // Connection lost
+    } else if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
+        return ESP_FAIL;
+    }
+
+    int id = request.id;
+    bool delete = request.delete;
+    if (delete) {
+        if (scheduler_remove(id) == ESP_ERR_INVALID_ARG) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid id");
+            return ESP_FAIL;
+        }
+    } else {
+        if (!request.has_hour || !request.has_minute) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing hour or minute");
+            return ESP_FAIL;
+        }
+
+        // Checked before the narrowing to the entry's fields, which would
+        // turn hour 256 into 0
+        if (request.hour < 0 || request.hour > 23 || request.minute < 0 || request.minute > 59 ||
+            request.hopper < 0 || request.hopper >= actuator_hopper_count() ||
+            request.portion_ms < 0 || request.portion_ms > FEEDER_MAX_HOLD_MS ||
+            (request.has_days && (request.days < 0 || request.days > SCHEDULER_ALL_DAYS))) {
+            id = -1;
+        } else {
+            schedule_entry_t entry = {
+                .hour       = request.hour,
+                .minute     = request.minute,
+                .days       = request.has_days ? request.days : SCHEDULER_ALL_DAYS,
+                .enabled    = request.enabled,
+                .portion_ms = request.portion_ms,
+                .hopper     = request.hopper,
+            };
+            id = scheduler_set(id, &entry);
+        }
+        if (id < 0) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid entry or schedule full");
+            return ESP_FAIL;
+        }
+    }
+
+    feeder_push_state(0, "schedule");
+
+    char buf[32];
+    json_writer_t w;
+    json_writer_init(&w, req, buf, sizeof(buf));
+    json_begin_object(&w, NULL);
+    json_add_int(&w, delete ? "deleted" : "id", id);
+    json_end_object(&w);
+    return json_writer_finish(&w);
+}
+
+#endif
+
+// Fields of a WebSocket command, e.g. {"cmd":"set_timer","minutes":60}
+typedef struct {
+    char cmd[12];
+    bool has_minutes;
+    int minutes;
+    int hopper;
+    uint32_t grams;             // Weighed feed when non-zero
+} ws_command_t;
+
+static esp_err_t ws_command_event(const json_event_t *ev, void *ctx)
+{
+    ws_command_t *c = ctx;
+
+    if (ev->depth != 1 || ev->key == NULL) {
+        return ESP_OK;
+    }
+    if (ev->type == JSON_EVENT_STRING && strcmp(ev->key, "cmd") == 0) {
+        snprintf(c->cmd, sizeof(c->cmd), "%s", ev->str);
+    } else if (ev->type == JSON_EVENT_NUMBER && strcmp(ev->key, "minutes") == 0) {
+        c->has_minutes = true;
+        c->minutes = ev->number >= 0 && ev->number <= FEEDER_MAX_TIMER_MIN ? (int)ev->number : -1;
+    } else if (ev->type == JSON_EVENT_NUMBER && strcmp(ev->key, "hopper") == 0) {
+        c->hopper = ev->number >= 0 && ev->number < ACTUATOR_MAX_HOPPERS ? (int)ev->number : -1;
+    } else if (ev->type == JSON_EVENT_NUMBER && strcmp(ev->key, "grams") == 0) {
+        c->grams = ev->number > 0 && ev->number < UINT16_MAX ? (uint32_t)ev->number : 0;
+    }
+    return ESP_OK;
+}
+
+// WebSocket command handler - same actions as /feed and /set_timer
+static void ws_command_handler(httpd_req_t *req, const char *payload, size_t len)
+{
+    char resp[FEEDER_STATE_LEN];
+    ws_command_t command = { 0 };
+    json_reader_t reader;
+
+    json_reader_init(&reader, ws_command_event, &command);
+    if (json_reader_feed(&reader, payload, len) != ESP_OK || json_reader_finish(&reader) != ESP_OK ||
+        command.cmd[0] == '\0') {
+        ws_push_reply(req, "{\"error\":\"Invalid command\"}");
+    } else if (command.hopper < 0 || command.hopper >= actuator_hopper_count()) {
+        ws_push_reply(req, "{\"error\":\"Unknown hopper\"}");
+    } else if (strcmp(command.cmd, "feed") == 0) {
+#if CONFIG_FEEDER_FEED_LIMIT
+        uint32_t retry_ms;
+        feed_guard_result_t admit = feed_guard_check(req, command.hopper, &retry_ms);
+        if (admit != FEED_GUARD_ALLOW) {
+            // A merged request gets no reply, the same as an accepted one
+            if (admit == FEED_GUARD_LIMITED) {
+                snprintf(resp, sizeof(resp), "{\"error\":\"Too many feed requests\",\"retry_ms\":%lu}",
+                         (unsigned long)retry_ms);
+                ws_push_reply(req, resp);
+            }
+            return;
+        }
+#endif
+#if CONFIG_FEEDER_SCALE
+        esp_err_t err = command.grams > 0 ? portion_feed(command.hopper, command.grams, FEED_SOURCE_WS)
+                                          : feeder_feed(command.hopper, 0, FEED_SOURCE_WS);
+#else
+        esp_err_t err = feeder_feed(command.hopper, 0, FEED_SOURCE_WS);
+#endif
+#if CONFIG_FEEDER_FEED_LIMIT
+        if (err == ESP_OK) {
+            feed_guard_started(req, command.hopper);
+        }
+#endif
+        if (err == ESP_ERR_NOT_FOUND) {
+            ws_push_reply(req, "{\"error\":\"Scale not ready\"}");
+        } else if (err != ESP_OK) {
+            ws_push_reply(req, "{\"error\":\"Busy: a feed is already in progress\"}");
+        }
+    } else if (strcmp(command.cmd, "set_timer") == 0) {
+        if (!command.has_minutes) {
+            ws_push_reply(req, "{\"error\":\"Missing minutes\"}");
+        } else if (command.minutes < 0) {
+            ws_push_reply(req, "{\"error\":\"Invalid minutes\"}");
+        } else {
+            update_auto_feed_timer(command.minutes);
+        }
+    } else if (strcmp(command.cmd, "get") == 0) {
+        feeder_format_state(resp, sizeof(resp), command.hopper, "state");
+        ws_push_reply(req, resp);
+#if CONFIG_FEEDER_PWM_TUNING
+    } else if (pwm_tuning_ws_command(req, command.cmd, payload, len)) {
+        // Handled by the tuning page's command set
+#endif
+    } else {
+        ws_push_reply(req, "{\"error\":\"Unknown command\"}");
+    }
+}
+
+// Wrappers nest from the inside out: the response arena, the PM lock, then
+// metrics, so all of them cover the handler wherever it runs, then the
+// hand-off to a worker
+static esp_err_t register_uri(httpd_handle_t server, const httpd_uri_t *uri, bool slow)
+{
+    httpd_uri_t wrapped = *uri;
+
+    http_arena_wrap_uri(&wrapped);
+#if CONFIG_FEEDER_POWER_SAVE
+    power_wrap_uri(&wrapped);
+#endif
+#if CONFIG_FEEDER_METRICS
+    metrics_wrap_uri(&wrapped);
+#endif
+#if CONFIG_FEEDER_HTTPD_ASYNC
+    if (slow) {
+        http_async_wrap_uri(&wrapped);
+    }
+#endif
+    return httpd_register_uri_handler(server, &wrapped);
+}
+
+esp_err_t feeder_register_uri(httpd_handle_t server, const httpd_uri_t *uri)
+{
+    return register_uri(server, uri, false);
+}
+
+esp_err_t feeder_register_slow_uri(httpd_handle_t server, const httpd_uri_t *uri)
+{
+    return register_uri(server, uri, true);
+}
+
 // HTTP GET handler serving the web page
 static esp_err_t index_handler(httpd_req_t *req)
 {
-    const char* html = "<!DOCTYPE html>\n"
-                      "<html>\n"
-                      "<head>\n"
-                      "    <title>Animal Feeder Control</title>\n"
-                      "    <meta name='viewport' content='width=device-width, initial-scale=1'>\n"
-                      "    <style>\n"
-                      "        body { font-family: Arial, sans-serif; text-align: center; margin-top: 50px; }\n"
-                      "        .button { background-color: #4CAF50; border: none; color: white; padding: 15px 32px;\n"
-                      "                 text-align: center; display: inline-block; font-size: 16px; margin: 4px 2px;\n"
-                      "                 cursor: pointer; border-radius: 8px; }\n"
-                      "        .status { margin-top: 20px; }\n"
-                      "        .timer-section { margin-top: 40px; padding: 20px; border: 1px solid #ddd; border-radius: 8px; }\n"
-                      "        select, button { padding: 10px; margin: 10px; }\n"
-                      "    </style>\n"
-                      "</head>\n"
-                      "<body>\n"
-                      "    <h1>Automatic Animal Feeder</h1>\n"
-                      "    <button class='button' id='feedButton'>Feed Now</button>\n"
-                      "    <div class='status' id='status'>Ready</div>\n"
-                      "\n"
-                      "    <div class='timer-section'>\n"
-                      "        <h2>Auto Feeding Timer</h2>\n"
-                      "        <select id='timerSelect'>\n"
-                      "            <option value='0'>Disabled</option>\n"
-                      "            <option value='30'>30 minutes</option>\n"
-                      "            <option value='60'>1 hour</option>\n"
-                      "            <option value='120'>2 hours</option>\n"
-                      "            <option value='180'>3 hours</option>\n"
-                      "            <option value='240'>4 hours</option>\n"
-                      "            <option value='360'>6 hours</option>\n"
-                      "            <option value='720'>12 hours</option>\n"
-                      "            <option value='1440'>24 hours</option>\n"
-                      "        </select>\n"
-                      "        <button id='setTimerButton'>Set Timer</button>\n"
-                      "        <div id='timerStatus'>Timer not set</div>\n"
-                      "    </div>\n"
-                      "\n"
-                      "    <script>\n"
-                      "        // Manual feed button\n"
-                      "        document.getElementById('feedButton').addEventListener('click', function() {\n"
-                      "            document.getElementById('status').innerHTML = 'Feeding...';\n"
-                      "            fetch('/feed')\n"
-                      "                .then(response => response.text())\n"
-                      "                .then(data => {\n"
-                      "                    document.getElementById('status').innerHTML = data;\n"
-                      "                    setTimeout(function() {\n"
-                      "                        document.getElementById('status').innerHTML = 'Ready';\n"
-                      "                    }, 3000);\n"
-                      "                })\n"
-                      "                .catch(error => {\n"
-                      "                    document.getElementById('status').innerHTML = 'Error: ' + error;\n"
-                      "                });\n"
-                      "        });\n"
-                      "\n"
-                      "        // Get current timer status on page load\n"
-                      "        window.addEventListener('load', function() {\n"
-                      "            fetch('/get_timer')\n"
-                      "                .then(response => response.text())\n"
-                      "                .then(data => {\n"
-                      "                    const minutes = parseInt(data);\n"
-                      "                    document.getElementById('timerSelect').value = minutes;\n"
-                      "                    updateTimerStatus(minutes);\n"
-                      "                })\n"
-                      "                .catch(error => {\n"
-                      "                    console.error('Error fetching timer status:', error);\n"
-                      "                });\n"
-                      "        });\n"
-                      "\n"
-                      "        // Set timer button\n"
-                      "        document.getElementById('setTimerButton').addEventListener('click', function() {\n"
-                      "            const minutes = document.getElementById('timerSelect').value;\n"
-                      "            fetch('/set_timer?minutes=' + minutes)\n"
-                      "                .then(response => response.text())\n"
-                      "                .then(data => {\n"
-                      "                    document.getElementById('status').innerHTML = data;\n"
-                      "                    updateTimerStatus(minutes);\n"
-                      "                    setTimeout(function() {\n"
-                      "                        document.getElementById('status').innerHTML = 'Ready';\n"
-                      "                    }, 3000);\n"
-                      "                })\n"
-                      "                .catch(error => {\n"
-                      "                    document.getElementById('status').innerHTML = 'Error: ' + error;\n"
-                      "                });\n"
-                      "        });\n"
-                      "\n"
-                      "        function updateTimerStatus(minutes) {\n"
-                      "            if (minutes > 0) {\n"
-                      "                let timeText = minutes + ' minutes';\n"
-                      "                if (minutes == 60) timeText = '1 hour';\n"
-                      "                else if (minutes > 60) {\n"
-                      "                    const hours = minutes / 60;\n"
-                      "                    if (hours === Math.floor(hours)) {\n"
-                      "                        timeText = hours + ' hours';\n"
-                      "                    }\n"
-                      "                }\n"
-                      "                document.getElementById('timerStatus').innerHTML = 'Auto feeding every ' + timeText;\n"
-                      "            } else {\n"
-                      "                document.getElementById('timerStatus').innerHTML = 'Auto feeding disabled';\n"
-                      "            }\n"
-                      "        }\n"
-                      "    </script>\n"
-                      "</body>\n"
-                      "</html>";
-
-    httpd_resp_send(req, html, HTTPD_RESP_USE_STRLEN);
-    return ESP_OK;
+    return web_asset_send(req, &web_asset_index);
 }
 
 // Start HTTP server
 static httpd_handle_t start_webserver(void)
 {
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.max_uri_handlers = 24;
+    config.stack_size = CONFIG_FEEDER_HTTPD_STACK;
+    config.max_open_sockets = FEEDER_HTTPD_SOCKETS;
+    config.lru_purge_enable = true;
+#ifdef CONFIG_FEEDER_HTTPD_CORE
+    config.core_id = CONFIG_FEEDER_HTTPD_CORE;
+#endif
+#if CONFIG_FEEDER_HTTPD_KEEP_ALIVE
+    config.keep_alive_enable = true;
+    config.keep_alive_idle = CONFIG_FEEDER_HTTPD_KEEP_ALIVE_IDLE_S;
+    config.keep_alive_interval = 5;
+    config.keep_alive_count = 3;
+#endif
 
     // Feed endpoint URI handler
     httpd_uri_t feed = {
@@ -365,6 +771,23 @@ static httpd_handle_t start_webserver(void)
         .user_ctx   = NULL
     };
 
+#if CONFIG_FEEDER_SCHEDULER
+    // Feeding schedule URI handlers
+    httpd_uri_t get_schedule = {
+        .uri        = "/schedule",
+        .method     = HTTP_GET,
+        .handler    = get_schedule_handler,
+        .user_ctx   = NULL
+    };
+
+    httpd_uri_t set_schedule = {
+        .uri        = "/schedule",
+        .method     = HTTP_POST,
+        .handler    = set_schedule_handler,
+        .user_ctx   = NULL
+    };
+#endif
+
     // Main page URI handler
     httpd_uri_t index = {
         .uri        = "/",
@@ -373,11 +796,51 @@ static httpd_handle_t start_webserver(void)
         .user_ctx   = NULL
     };
 
+#if CONFIG_FEEDER_HTTPD_ASYNC
+    if (http_async_start(CONFIG_FEEDER_HTTPD_ASYNC_WORKERS, config.stack_size, config.core_id) != ESP_OK) {
+        ESP_LOGW(TAG, "No async workers, slow handlers run on the httpd task");
+    }
+#endif
+
     if (httpd_start(&server, &config) == ESP_OK) {
-        httpd_register_uri_handler(server, &index);
-        httpd_register_uri_handler(server, &feed);
-        httpd_register_uri_handler(server, &set_timer);
-        httpd_register_uri_handler(server, &get_timer);
+        ESP_LOGI(TAG, "Web server: %d connections, %u byte stack", config.max_open_sockets,
+                 (unsigned)config.stack_size);
+        feeder_register_slow_uri(server, &index);
+        feeder_register_uri(server, &feed);
+        feeder_register_uri(server, &set_timer);
+        feeder_register_uri(server, &get_timer);
+#if CONFIG_FEEDER_SCHEDULER
+        feeder_register_slow_uri(server, &get_schedule);
+        feeder_register_uri(server, &set_schedule);
+#endif
+#if CONFIG_FEEDER_PWM_TUNING
+        pwm_tuning_register(server);
+#endif
+#if CONFIG_FEEDER_SCALE
+        portion_register(server);
+#endif
+#if CONFIG_FEEDER_EVENT_LOG
+        feed_log_register(server);
+#endif
+#if CONFIG_FEEDER_FLEET
+        fleet_register(server);
+#endif
+#if CONFIG_FEEDER_OTA
+        ota_register(server);
+#endif
+        // Commands over /ws get the same arena, PM lock and metrics
+        httpd_uri_t ws;
+        ws_push_init(server, ws_command_handler, &ws);
+        feeder_register_uri(server, &ws);
+#if CONFIG_FEEDER_METRICS
+        metrics_register(server);
+#endif
+#if CONFIG_FEEDER_TASK_STATS
+        task_stats_register(server);
+#endif
+#if CONFIG_FEEDER_TRACE
+        trace_log_register(server);
+#endif
         return server;
     }
 
@@ -387,6 +850,23 @@ static httpd_handle_t start_webserver(void)
 
 void app_main(void)
 {
+    bool woke_to_feed = false;
+
+#if CONFIG_FEEDER_TRACE
+    // From here on the feed path only queues its log lines
+    ESP_ERROR_CHECK(trace_start(FEEDER_TRACE_CORE));
+#endif
+    parse_servo_gpios();
+    feed_lock = xSemaphoreCreateMutexStatic(&feed_lock_buffer);
+
+#if CONFIG_FEEDER_DEEP_SLEEP
+    for (int i = 0; i < hopper_count; i++) {
+        next_source[i] = FEED_SOURCE_WAKE;
+    }
+    // A scheduled wake-up feeds straight from RTC memory, before NVS and WiFi
+    woke_to_feed = deep_sleep_wake_feed(actuator_event_handler);
+#endif
+
     // Initialize NVS (needed for WiFi)
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
@@ -397,22 +877,188 @@ void app_main(void)
 
     ESP_LOGI(TAG, "Automatic Animal Feeder starting...");
 
-    // Initialize servo
-    servo_init();
+#if CONFIG_FEEDER_OTA
+    // An update has CONFIG_FEEDER_OTA_VERIFY_S to reach the web server
+    if (ota_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Rollback deadline not armed");
+    }
+#endif
+
+#if CONFIG_FEEDER_EVENT_LOG
+    // Feed history; a wake-up feed is logged once it has finished
+    if (feed_log_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Feed log unavailable");
+    }
+#endif
 
-    // Create timer for resetting servo position
-    servo_reset_timer = xTimerCreate("servo_reset_timer", pdMS_TO_TICKS(5000),
-                                     pdFALSE, 0, servo_reset_timer_callback);
+#if CONFIG_FEEDER_POWER_SAVE
+    // Light sleep between feeds; the servo and HTTP handlers keep it awake
+    ESP_ERROR_CHECK(power_init());
+#endif
+
+    // Load the servo calibration and the persisted configuration
+    ESP_ERROR_CHECK(servo_cal_init());
+    feeder_config_t defaults = { .auto_feed_interval = 0 };
+    for (int i = 0; i < CONFIG_STORE_MAX_HOPPERS; i++) {
+        defaults.hoppers[i] = (hopper_config_t) {
+            .default_pwm    = servo_angle_to_duty(CONFIG_FEEDER_REST_ANGLE),
+            .feed_pwm       = servo_angle_to_duty(CONFIG_FEEDER_FEED_ANGLE),
+            .reset_delay_ms = CONFIG_FEEDER_FEED_HOLD_MS,
+            .ramp_ms        = ACTUATOR_RAMP_MS,
+            .profile        = "dispense",
+        };
+    }
+    ESP_ERROR_CHECK(config_store_init(&defaults));
+    const feeder_config_t *cfg = config_store_get();
+
+#if CONFIG_FEEDER_SCALE
+    // Load cell under the bowl for weighed portions
+    ESP_ERROR_CHECK(portion_init());
+#endif
+#if CONFIG_FEEDER_FILL_LEVEL
+    // Distance sensors over the hoppers, sampled in the background
+    if (fill_monitor_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Fill levels unavailable");
+    }
+#endif
+#if CONFIG_FEEDER_CURRENT_SENSE
+    // Servo supply current, sampled continuously while a feed runs
+    if (jam_detect_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Jam detection unavailable");
+    }
+#endif
+#if CONFIG_FEEDER_FILL_LEVEL || CONFIG_FEEDER_CURRENT_SENSE
+    if (adc_stream_start(FEEDER_ADC_RATE_HZ, FEEDER_ADC_PERIOD_MS, FEEDER_ADC_BURST_MS,
+                         FEEDER_CONTROL_CORE) != ESP_OK) {
+        ESP_LOGW(TAG, "Analog inputs unavailable");
+    }
+#endif
+
+#if CONFIG_FEEDER_FEED_LIMIT
+    feed_guard_init();
+#endif
+
+    // Initialize the servos and the actuator task that drives them
+    if (!woke_to_feed) {
+        actuator_config_t hoppers[ACTUATOR_MAX_HOPPERS];
+        int count = feeder_actuator_config(hoppers);
+        ESP_ERROR_CHECK(actuator_init(hoppers, count, actuator_event_handler, FEEDER_CONTROL_CORE));
+    }
+#if CONFIG_FEEDER_DEEP_SLEEP
+    // The wake-up feed's events waited for the configuration, the feed log
+    // and the guard above
+    deep_sleep_app_ready();
+#endif
 
     // Create auto feeding timer (initially stopped)
-    auto_feed_timer = xTimerCreate("auto_feed_timer", pdMS_TO_TICKS(60 * 60 * 1000), // Default to 1 hour
-                                  pdTRUE, 0, auto_feed_timer_callback);
+    auto_feed_timer = xTimerCreateStatic("auto_feed_timer", pdMS_TO_TICKS(60 * 60 * 1000), // Default to 1 hour
+                                         pdTRUE, 0, auto_feed_timer_callback, &auto_feed_timer_buffer);
+    update_auto_feed_timer(cfg->auto_feed_interval);
+
+#if CONFIG_FEEDER_DEEP_SLEEP
+    // Don't feed the deadline that woke us up a second time
+    scheduler_skip_until(deep_sleep_wake_due());
+#endif
+#if CONFIG_FEEDER_SCHEDULER
+    // Calendar schedule, armed once SNTP has set the clock. Deadlines are
+    // local times, so the zone comes first; the RTC may have kept the clock.
+    scheduler_set_timezone(CONFIG_FEEDER_TIMEZONE);
+    ESP_ERROR_CHECK(scheduler_init(schedule_fire_callback));
+#endif
+
+#if CONFIG_FEEDER_DEEP_SLEEP
+    // The RTC kept the clock; WiFi only comes up when it needs resyncing
+    if (!deep_sleep_needs_network()) {
+        ESP_ERROR_CHECK(deep_sleep_start_countdown(0));
+        return;
+    }
+#endif
 
     // Initialize WiFi
-    wifi_init_sta();
+#if CONFIG_FEEDER_POWER_SAVE
+    network_set_power_save(CONFIG_FEEDER_WIFI_LISTEN_INTERVAL);
+#endif
+#if CONFIG_FEEDER_PROVISIONING
+    char ssid[NETWORK_SSID_LEN];
+    char password[NETWORK_PASSWORD_LEN];
+    if (!provision_load(ssid, password)) {
+        // Nothing else runs until the owner has picked a network
+        ESP_ERROR_CHECK(provision_start_portal());
+#if CONFIG_FEEDER_OTA
+        ota_confirm();
+#endif
+        return;
+    }
+    ESP_ERROR_CHECK(network_start_sta(ssid, password));
+#else
+    ESP_ERROR_CHECK(network_start_sta(CONFIG_FEEDER_WIFI_SSID, CONFIG_FEEDER_WIFI_PASSWORD));
+#endif
+#if CONFIG_FEEDER_SCHEDULER
+    ESP_ERROR_CHECK(scheduler_start_time_sync(CONFIG_FEEDER_TIMEZONE));
+#endif
+#if CONFIG_FEEDER_FLEET
+    // Controllers find the fleet by service type instead of DHCP addresses
+    ESP_ERROR_CHECK(fleet_init());
+    if (fleet_start_mdns() != ESP_OK) {
+        ESP_LOGW(TAG, "Not discoverable over mDNS");
+    }
+#endif
+#if CONFIG_FEEDER_MQTT
+    // Telemetry and commands through the broker; connects once WiFi is up
+    if (mqtt_link_start() != ESP_OK) {
+        ESP_LOGW(TAG, "MQTT unavailable");
+    }
+#endif
+
+#if CONFIG_FEEDER_METRICS
+    // Stack usage of the busiest tasks and the servo queue on /metrics
+    metrics_watch_task("actuator");
+    metrics_watch_task("config_writer");
+    metrics_watch_task("Tmr Svc");
+#if CONFIG_FEEDER_TRACE
+    metrics_watch_task("trace");
+    metrics_add_gauge("feeder_trace_dropped", "Trace records lost to a full ring", trace_get_dropped);
+#endif
+#if CONFIG_FEEDER_MQTT
+    metrics_watch_task("mqtt_link");
+#endif
+    metrics_add_gauge("feeder_actuator_queue_depth", "Servo commands waiting", actuator_get_queue_depth);
+    metrics_add_gauge("feeder_actuator_queue_peak", "Most servo commands ever waiting", actuator_get_queue_peak);
+    metrics_add_gauge("feeder_wifi_boot_to_ip_ms", "Milliseconds from boot to the first IP", network_get_boot_to_ip_ms);
+    metrics_add_gauge("feeder_wifi_last_outage_ms", "Milliseconds offline during the last outage", network_get_last_outage_ms);
+    metrics_add_gauge("feeder_wifi_reconnects", "WiFi reconnects since boot", network_get_reconnects);
+    metrics_add_gauge("feeder_http_arena_peak_bytes", "Most response arena one request has used",
+                      http_arena_get_peak);
+#if CONFIG_FEEDER_EVENT_LOG
+    metrics_add_gauge("feeder_log_records", "Feeds logged since the log partition was first used", event_log_total);
+#endif
+#if CONFIG_FEEDER_FEED_LIMIT
+    metrics_add_gauge("feeder_feed_merged", "Feed requests merged into a running feed", feed_guard_get_merged);
+    metrics_add_gauge("feeder_feed_limited", "Feed requests refused with 429", feed_guard_get_limited);
+#endif
+#if CONFIG_FEEDER_FILL_LEVEL || CONFIG_FEEDER_CURRENT_SENSE
+    metrics_watch_task("adc_stream");
+#endif
+#if CONFIG_FEEDER_SCALE
+    metrics_watch_task("scale");
+    metrics_add_gauge("feeder_scale_readings", "Load cell readings since boot", scale_get_sample_count);
+#endif
+#if CONFIG_FEEDER_DEEP_SLEEP
+    metrics_add_gauge("feeder_wake_to_feed_ms", "Milliseconds from the wake-up deadline to servo movement",
+                      deep_sleep_wake_to_feed_ms);
+#endif
+#endif
 
     // Start webserver
-    start_webserver();
+    if (start_webserver() != NULL) {
+#if CONFIG_FEEDER_OTA
+        ota_confirm();
+#endif
+    }
+
+#if CONFIG_FEEDER_DEEP_SLEEP
+    ESP_ERROR_CHECK(deep_sleep_start_countdown(CONFIG_FEEDER_AWAKE_S * 1000));
+#endif
 
     ESP_LOGI(TAG, "System ready - connect to IP address displayed above");
 }
@@ -0,0 +1,153 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include "config_store.h"
+
+#define CONFIG_NAMESPACE        "feeder_cfg"
+#define CONFIG_KEY              "config"
+#define CONFIG_WRITER_STACK     2560
+#define CONFIG_WRITER_PRIORITY  1
+
+// Single-hopper layout of earlier firmware, migrated into hopper 0
+typedef struct {
+    uint32_t auto_feed_interval;
+    hopper_config_t hopper;
+} config_v1_t;
+
+static const char *TAG = "config_store";
+static feeder_config_t config;
+static SemaphoreHandle_t lock = NULL;
+static StaticSemaphore_t lock_buffer;
+static TaskHandle_t writer_task = NULL;
+static StaticTask_t writer_buffer;
+static StackType_t writer_stack[CONFIG_WRITER_STACK];
+static bool dirty = false;
+
+static esp_err_t write_config(void)
+{
+    feeder_config_t snapshot;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (!dirty) {
+        xSemaphoreGive(lock);
+        return ESP_OK;
+    }
+    snapshot = config;
+    dirty = false;
+    xSemaphoreGive(lock);
+
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(CONFIG_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(nvs, CONFIG_KEY, &snapshot, sizeof(snapshot));
+        if (err == ESP_OK) {
+            err = nvs_commit(nvs);
+        }
+        nvs_close(nvs);
+    }
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save configuration: %s", esp_err_to_name(err));
+        xSemaphoreTake(lock, portMAX_DELAY);
+        dirty = true;
+        xSemaphoreGive(lock);
+        // Nothing else may change soon; the writer has to try again by itself
+        if (writer_task != NULL) {
+            xTaskNotifyGive(writer_task);
+        }
+    } else {
+        ESP_LOGI(TAG, "Configuration saved");
+    }
+    return err;
+}
+
+// Coalesce bursts of changes into one NVS commit
+static void config_writer_task(void *arg)
+{
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        TickType_t first = xTaskGetTickCount();
+        while (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CONFIG_STORE_QUIET_MS)) != 0) {
+            if (xTaskGetTickCount() - first >= pdMS_TO_TICKS(CONFIG_STORE_MAX_DEFER_MS)) {
+                break;
+            }
+        }
+
+        if (write_config() != ESP_OK) {
+            // Retried once notified again, but not in a tight loop
+            vTaskDelay(pdMS_TO_TICKS(CONFIG_STORE_RETRY_MS));
+        }
+    }
+}
+
+const feeder_config_t *config_store_get(void)
+{
+    return &config;
+}
+
+void config_store_set(const feeder_config_t *new_config)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool changed = memcmp(&config, new_config, sizeof(config)) != 0;
+    if (changed) {
+        config = *new_config;
+        dirty = true;
+    }
+    xSemaphoreGive(lock);
+
+    if (changed) {
+        xTaskNotifyGive(writer_task);
+    }
+}
+
+esp_err_t config_store_flush(void)
+{
+    return write_config();
+}
+
+esp_err_t config_store_init(const feeder_config_t *defaults)
+{
+    nvs_handle_t nvs;
+    size_t len = sizeof(config);
+
+    config = *defaults;
+    lock = xSemaphoreCreateMutexStatic(&lock_buffer);
+
+    esp_err_t err = nvs_open(CONFIG_NAMESPACE, NVS_READONLY, &nvs);
+    if (err == ESP_OK) {
+        feeder_config_t stored;
+        err = nvs_get_blob(nvs, CONFIG_KEY, &stored, &len);
+        nvs_close(nvs);
+
+        // Any other layout change invalidates the blob; start over from defaults
+        if (err == ESP_OK && len == sizeof(stored)) {
+            config = stored;
+            ESP_LOGI(TAG, "Configuration loaded");
+        } else if (err == ESP_OK && len == sizeof(config_v1_t)) {
+            config_v1_t v1;
+            memcpy(&v1, &stored, sizeof(v1));
+            config.auto_feed_interval = v1.auto_feed_interval;
+            config.hoppers[0] = v1.hopper;
+            dirty = true;
+            ESP_LOGI(TAG, "Configuration migrated to the multi-hopper layout");
+        } else {
+            ESP_LOGI(TAG, "No usable stored configuration, using defaults");
+        }
+    } else if (err != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGW(TAG, "Cannot open configuration: %s", esp_err_to_name(err));
+    }
+    for (int i = 0; i < CONFIG_STORE_MAX_HOPPERS; i++) {
+        config.hoppers[i].profile[CONFIG_STORE_PROFILE_LEN - 1] = '\0';
+    }
+
+    writer_task = xTaskCreateStatic(config_writer_task, "config_writer", CONFIG_WRITER_STACK, NULL,
+                                    CONFIG_WRITER_PRIORITY, writer_stack, &writer_buffer);
+    if (dirty) {
+        xTaskNotifyGive(writer_task);
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#define CONFIG_STORE_QUIET_MS       3000    // Commit once settings stop changing for this long
+#define CONFIG_STORE_MAX_DEFER_MS   30000   // ...or at the latest this long after the first change
+#define CONFIG_STORE_RETRY_MS       10000   // Pause before retrying a failed commit
+#define CONFIG_STORE_PROFILE_LEN    16
+#define CONFIG_STORE_MAX_HOPPERS    8       // Stored whether used or not, so the layout is fixed
+
+// Settings of one hopper's servo
+typedef struct {
+    uint32_t default_pwm;           // Rest position
+    uint32_t feed_pwm;              // Feed position
+    uint32_t reset_delay_ms;        // Time held in the feed position
+    uint32_t ramp_ms;               // Motion ramp time
+    char profile[CONFIG_STORE_PROFILE_LEN];     // Feed motion profile name
+} hopper_config_t;
+
+// Everything the feeder remembers across reboots
+typedef struct {
+    uint32_t auto_feed_interval;    // Minutes, 0 means disabled; feeds every hopper
+    hopper_config_t hoppers[CONFIG_STORE_MAX_HOPPERS];
+} feeder_config_t;
+
+// Load the stored configuration once at boot, or start from defaults, and
+// start the background writer
+esp_err_t config_store_init(const feeder_config_t *defaults);
+
+// Live configuration. Fields can be read from any task.
+const feeder_config_t *config_store_get(void);
+
+// Replace the configuration. Returns immediately; the NVS write happens on
+// the writer task after a quiet period, so rapid updates cost one commit.
+void config_store_set(const feeder_config_t *config);
+
+// Write any pending change now (e.g. before a restart)
+esp_err_t config_store_flush(void);
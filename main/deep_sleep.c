@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+#include "esp_log.h"
+#include "esp_sleep.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "trace.h"
+#include "sdkconfig.h"
+#include "config_store.h"
+#include "scheduler.h"
+#include "feeder.h"
+#include "deep_sleep.h"
+
+#define SLEEP_STATE_MAGIC   0x46656564
+#define WAKE_EVENTS_MAX     (2 * ACTUATOR_MAX_HOPPERS)     // A feed and a reset per hopper
+
+// Everything the wake-up feed needs, in RTC slow memory
+typedef struct {
+    uint32_t magic;
+    int hopper_count;
+    actuator_config_t actuators[ACTUATOR_MAX_HOPPERS];     // profile is not kept
+    char profiles[ACTUATOR_MAX_HOPPERS][CONFIG_STORE_PROFILE_LEN];
+    uint32_t feed_duty[ACTUATOR_MAX_HOPPERS];
+    uint32_t hold_ms[ACTUATOR_MAX_HOPPERS];                // 0 = not due at this wake-up
+    time_t due;                     // Schedule deadline of the wake-up
+    time_t last_sync;               // Last SNTP sync over all wake-ups
+} sleep_state_t;
+
+static const char *TAG = "deep_sleep";
+static RTC_DATA_ATTR sleep_state_t state;
+static bool woke_to_feed = false;
+static uint32_t wake_to_feed_ms = 0;
+static actuator_event_cb_t app_event_cb = NULL;
+
+// Events of the wake-up feed that arrive before app_main has set up what
+// the application callback uses
+typedef struct {
+    int hopper;
+    actuator_event_t event;
+    uint32_t duty;
+} wake_event_t;
+
+static portMUX_TYPE wake_lock = portMUX_INITIALIZER_UNLOCKED;
+static wake_event_t wake_events[WAKE_EVENTS_MAX];
+static int wake_event_count = 0;
+static int wake_event_next = 0;
+static bool app_ready = false;
+static TimerHandle_t sleep_timer = NULL;
+static StaticTimer_t sleep_timer_buffer;
+static int64_t awake_until_us = 0;
+
+static int64_t wall_clock_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+// Measures the first feed, then hands every event to the application,
+// holding them back until deep_sleep_app_ready()
+static void wake_event_handler(int hopper, actuator_event_t event, uint32_t duty)
+{
+    if (event == ACTUATOR_EVENT_FEED && wake_to_feed_ms == 0) {
+        // The RTC kept the wall clock, so this includes ROM and bootloader time
+        int64_t late_us = wall_clock_us() - (int64_t)state.due * 1000000;
+        wake_to_feed_ms = late_us > 0 ? late_us / 1000 : 1;
+        TRACE_LOGI(TAG, "Servo moving %lu ms after the wake-up deadline, %lu ms after app start",
+                   (unsigned long)wake_to_feed_ms, (unsigned long)(esp_timer_get_time() / 1000));
+    }
+
+    bool held = false;
+    bool lost = false;
+    portENTER_CRITICAL(&wake_lock);
+    if (!app_ready) {
+        held = true;
+        if (wake_event_count < WAKE_EVENTS_MAX) {
+            wake_events[wake_event_count++] = (wake_event_t) { hopper, event, duty };
+        } else {
+            lost = true;
+        }
+    }
+    portEXIT_CRITICAL(&wake_lock);
+    if (lost) {
+        TRACE_LOGW(TAG, "Wake-up event %d of hopper %d dropped before setup finished", event, hopper);
+    }
+    if (!held) {
+        app_event_cb(hopper, event, duty);
+    }
+}
+
+void deep_sleep_app_ready(void)
+{
+    // Events still arriving are queued behind those being handed on, so
+    // the application sees them in order
+    while (true) {
+        wake_event_t e;
+        portENTER_CRITICAL(&wake_lock);
+        bool more = wake_event_next < wake_event_count;
+        if (more) {
+            e = wake_events[wake_event_next++];
+        } else {
+            app_ready = true;
+        }
+        portEXIT_CRITICAL(&wake_lock);
+        if (!more) {
+            return;
+        }
+        app_event_cb(e.hopper, e.event, e.duty);
+    }
+}
+
+bool deep_sleep_wake_feed(actuator_event_cb_t event_cb)
+{
+    app_event_cb = event_cb;
+    if (esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_TIMER || state.magic != SLEEP_STATE_MAGIC) {
+        return false;
+    }
+
+    for (int i = 0; i < state.hopper_count; i++) {
+        state.actuators[i].profile = motion_find_profile(state.profiles[i]);
+    }
+    ESP_ERROR_CHECK(actuator_init(state.actuators, state.hopper_count, wake_event_handler, FEEDER_CONTROL_CORE));
+
+    // Every hopper due at this deadline feeds in parallel
+    for (int i = 0; i < state.hopper_count; i++) {
+        if (state.hold_ms[i] == 0) {
+            continue;
+        }
+        esp_err_t err = actuator_feed(i, state.feed_duty[i], state.hold_ms[i]);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Wake-up feed of hopper %d failed: %s", i, esp_err_to_name(err));
+        }
+    }
+    woke_to_feed = true;
+    return true;
+}
+
+time_t deep_sleep_wake_due(void)
+{
+    return woke_to_feed ? state.due : 0;
+}
+
+bool deep_sleep_needs_network(void)
+{
+    if (!woke_to_feed || !scheduler_time_valid() || state.last_sync == 0) {
+        return true;
+    }
+    return time(NULL) - state.last_sync >= (time_t)CONFIG_FEEDER_RESYNC_HOURS * 3600;
+}
+
+uint32_t deep_sleep_wake_to_feed_ms(void)
+{
+    return wake_to_feed_ms;
+}
+
+// Save what the next wake-up needs and power down until due
+static void enter_deep_sleep(int id, const schedule_entry_t *entry, time_t due)
+{
+    const feeder_config_t *cfg = config_store_get();
+    int ids[SCHEDULER_MAX_ENTRIES];
+    int due_count = scheduler_due_at(due, ids, SCHEDULER_MAX_ENTRIES);
+
+    state.hopper_count = feeder_actuator_config(state.actuators);
+    for (int i = 0; i < state.hopper_count; i++) {
+        state.actuators[i].profile = NULL;
+        snprintf(state.profiles[i], sizeof(state.profiles[i]), "%s", cfg->hoppers[i].profile);
+        state.feed_duty[i] = cfg->hoppers[i].feed_pwm;
+        state.hold_ms[i] = 0;
+    }
+    for (int i = 0; i < due_count; i++) {
+        schedule_entry_t e;
+        if (scheduler_get(ids[i], &e) && e.hopper < state.hopper_count) {
+            uint32_t hold = e.portion_ms > 0 ? e.portion_ms : cfg->hoppers[e.hopper].reset_delay_ms;
+            if (hold > state.hold_ms[e.hopper]) {
+                state.hold_ms[e.hopper] = hold;
+            }
+        }
+    }
+    state.due = due;
+    if (scheduler_last_sync() > state.last_sync) {
+        state.last_sync = scheduler_last_sync();
+    }
+    state.magic = SLEEP_STATE_MAGIC;
+
+    config_store_flush();
+
+    int64_t sleep_us = (int64_t)due * 1000000 - wall_clock_us();
+    if (sleep_us < 1000) {
+        sleep_us = 1000;
+    }
+    ESP_LOGI(TAG, "Sleeping %lld s until schedule %d (%02u:%02u)", (long long)(sleep_us / 1000000), id,
+             entry->hour, entry->minute);
+    esp_sleep_enable_timer_wakeup(sleep_us);
+    esp_deep_sleep_start();
+}
+
+static void sleep_timer_callback(TimerHandle_t t)
+{
+    int id;
+    schedule_entry_t entry;
+
+    // A wake-up that only needed the clock resynced can leave once it is
+    bool synced = woke_to_feed && scheduler_last_sync() != 0;
+    if (!actuator_all_idle() || trace_pending() || (esp_timer_get_time() < awake_until_us && !synced)) {
+        return;
+    }
+
+    time_t due = scheduler_next_due(&id);
+    if (due == 0 || !scheduler_get(id, &entry)) {
+        ESP_LOGI(TAG, "Nothing scheduled, staying awake");
+        awake_until_us = esp_timer_get_time() + (int64_t)CONFIG_FEEDER_AWAKE_S * 1000000;
+        return;
+    }
+
+    enter_deep_sleep(id, &entry, due);
+}
+
+esp_err_t deep_sleep_start_countdown(uint32_t awake_ms)
+{
+    awake_until_us = esp_timer_get_time() + (int64_t)awake_ms * 1000;
+    sleep_timer = xTimerCreateStatic("deep_sleep", pdMS_TO_TICKS(DEEP_SLEEP_POLL_MS), pdTRUE, NULL,
+                                     sleep_timer_callback, &sleep_timer_buffer);
+    if (xTimerStart(sleep_timer, 0) != pdPASS) {
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
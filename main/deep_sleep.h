@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include "esp_err.h"
+#include "actuator.h"
+
+// Scheduled feeding from deep sleep. Between feeds only the RTC timer runs;
+// the wake-up drives the servo from RTC memory before NVS, WiFi or httpd.
+
+#define DEEP_SLEEP_POLL_MS      1000    // How often the countdown re-checks
+
+// First thing in app_main. After a timer wake-up, initializes the actuator
+// from RTC memory and starts the feed that was due; returns true in that case.
+// event_cb sees none of the feed's events before deep_sleep_app_ready().
+bool deep_sleep_wake_feed(actuator_event_cb_t event_cb);
+
+// What event_cb uses is set up: hand it the events of the wake-up feed so
+// far, in order, and every later one straight away
+void deep_sleep_app_ready(void);
+
+// Deadline the current wake-up was armed for, 0 after a cold boot
+time_t deep_sleep_wake_due(void);
+
+// WiFi is needed on a cold boot, when the clock was never set, or when the
+// last SNTP sync is older than CONFIG_FEEDER_RESYNC_HOURS
+bool deep_sleep_needs_network(void);
+
+// Sleep until the next schedule deadline once awake_ms has passed, or, on a
+// wake-up that only needed the clock resynced, as soon as SNTP has run. Never
+// sleeps during a feed or with nothing scheduled.
+esp_err_t deep_sleep_start_countdown(uint32_t awake_ms);
+
+// Time from the wake-up deadline to the servo starting to move, 0 if this
+// boot was not a wake-up feed
+uint32_t deep_sleep_wake_to_feed_ms(void);
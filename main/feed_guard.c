@@ -0,0 +1,100 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_http_server.h"
+#include "rate_limit.h"
+#include "actuator.h"
+#include "feeder.h"
+
+static const char *TAG = "feed_guard";
+
+// Limits on every interactive feed: /feed, the dashboard, /batch and MQTT.
+// The commands arrive on the httpd and MQTT tasks, so the buckets and the
+// counters are only touched with the lock held.
+static SemaphoreHandle_t lock = NULL;
+static StaticSemaphore_t lock_buffer;
+static rate_limit_t client_limit = {
+    .burst       = CONFIG_FEEDER_FEED_LIMIT_CLIENT_BURST,
+    .interval_ms = CONFIG_FEEDER_FEED_LIMIT_CLIENT_INTERVAL_S * 1000,
+};
+static rate_bucket_t device_limit = {
+    .burst       = CONFIG_FEEDER_FEED_LIMIT_DEVICE_BURST,
+    .interval_ms = CONFIG_FEEDER_FEED_LIMIT_DEVICE_INTERVAL_S * 1000,
+};
+
+// Per hopper, written on the actuator task: a feed is queued or running,
+// and when the last one ended
+static volatile bool dispensing[ACTUATOR_MAX_HOPPERS];
+static volatile int64_t ended_us[ACTUATOR_MAX_HOPPERS];
+static uint32_t merged = 0;
+static uint32_t limited = 0;
+
+void feed_guard_init(void)
+{
+    lock = xSemaphoreCreateMutexStatic(&lock_buffer);
+}
+
+feed_guard_result_t feed_guard_check(httpd_req_t *req, int hopper, uint32_t *retry_ms)
+{
+    feed_guard_result_t result = FEED_GUARD_ALLOW;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    // Nothing is spent here; the feed may still be refused further on
+    int64_t since_ms = (esp_timer_get_time() - ended_us[hopper]) / 1000;
+    if (dispensing[hopper]) {
+        // A repeat while the hopper is dispensing joins that feed, for free
+        merged++;
+        result = FEED_GUARD_MERGED;
+    } else if (ended_us[hopper] != 0 && since_ms < CONFIG_FEEDER_FEED_MIN_INTERVAL_S * 1000) {
+        *retry_ms = CONFIG_FEEDER_FEED_MIN_INTERVAL_S * 1000 - since_ms;
+        result = FEED_GUARD_LIMITED;
+    } else if ((req != NULL && (*retry_ms = rate_limit_wait(&client_limit, req)) > 0) ||
+               (*retry_ms = rate_bucket_wait(&device_limit)) > 0) {
+        result = FEED_GUARD_LIMITED;
+    }
+    if (result == FEED_GUARD_LIMITED) {
+        limited++;
+    }
+    xSemaphoreGive(lock);
+
+    if (result == FEED_GUARD_LIMITED) {
+        ESP_LOGD(TAG, "Feed of hopper %d refused, retry in %lu ms", hopper, (unsigned long)*retry_ms);
+    }
+    return result;
+}
+
+void feed_guard_started(httpd_req_t *req, int hopper)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    // Both had a token when the feed was checked; a feed from the other task
+    // in between may have taken the last one, and then this one goes free
+    if (req != NULL) {
+        rate_limit_take(&client_limit, req);
+    }
+    rate_bucket_take(&device_limit);
+    dispensing[hopper] = true;
+    xSemaphoreGive(lock);
+}
+
+void feed_guard_actuator_event(int hopper, actuator_event_t event)
+{
+    if (event == ACTUATOR_EVENT_FEED) {
+        dispensing[hopper] = true;
+    } else if (event == ACTUATOR_EVENT_RESET) {
+        ended_us[hopper] = esp_timer_get_time();
+        dispensing[hopper] = false;
+    }
+}
+
+uint32_t feed_guard_get_merged(void)
+{
+    return merged;
+}
+
+uint32_t feed_guard_get_limited(void)
+{
+    return limited;
+}
@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_http_server.h"
+#include "event_log.h"
+#include "http_arena.h"
+#include "actuator.h"
+#include "feeder.h"
+
+#define FEED_LOG_BATCH      8       // Records read from flash per chunk
+#define FEED_LOG_LINE_LEN   96      // Longest CSV line
+#define FEED_LOG_MIN_TIME   1600000000  // Earlier clock readings mean SNTP has not set it
+
+static const char *TAG = "feed_log";
+
+// Feed in progress, per hopper
+static event_record_t running[ACTUATOR_MAX_HOPPERS];
+static int64_t started_us[ACTUATOR_MAX_HOPPERS];
+
+void feed_log_set_portion(int hopper, int32_t portion_mg)
+{
+    running[hopper].portion_mg = portion_mg;
+    running[hopper].flags |= EVENT_LOG_FLAG_WEIGHED;
+}
+
+void feed_log_set_current(int hopper, uint16_t peak_ma, uint16_t avg_ma, bool jammed)
+{
+    running[hopper].peak_ma = peak_ma;
+    running[hopper].avg_ma = avg_ma;
+    running[hopper].flags |= EVENT_LOG_FLAG_CURRENT | (jammed ? EVENT_LOG_FLAG_JAMMED : 0);
+}
+
+void feed_log_actuator_event(int hopper, actuator_event_t event, uint32_t duty, feed_source_t source)
+{
+    event_record_t *r = &running[hopper];
+
+    if (event == ACTUATOR_EVENT_FEED) {
+        time_t now = time(NULL);
+        memset(r, 0, sizeof(*r));
+        started_us[hopper] = esp_timer_get_time();
+        r->time = now >= FEED_LOG_MIN_TIME ? now : started_us[hopper] / 1000000;
+        r->flags = now >= FEED_LOG_MIN_TIME ? EVENT_LOG_FLAG_TIME_VALID : 0;
+        r->source = source;
+        r->hopper = hopper;
+        r->duty = duty;
+    } else if (event == ACTUATOR_EVENT_RESET) {
+        r->duration_ms = (esp_timer_get_time() - started_us[hopper]) / 1000;
+        if (event_log_append(r) != ESP_OK) {
+            ESP_LOGW(TAG, "Feed of hopper %d not logged", hopper);
+        }
+    }
+}
+
+// Stream the log as CSV, oldest first, a few records per chunk straight from
+// flash. ?since=N skips records before sequence number N.
+static esp_err_t log_handler(httpd_req_t *req)
+{
+    uint32_t since = 0;
+    if (feeder_query_uint(req, "since", &since) == ESP_ERR_INVALID_ARG) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid since");
+        return ESP_FAIL;
+    }
+
+    // Built in the request arena, the worker stack stays small
+    event_record_t *records = http_arena_alloc(FEED_LOG_BATCH * sizeof(event_record_t));
+    size_t size = FEED_LOG_BATCH * FEED_LOG_LINE_LEN;
+    char *chunk = http_arena_alloc(size);
+    if (records == NULL || chunk == NULL) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "No room for the response");
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "text/csv");
+    esp_err_t err = httpd_resp_send_chunk(req, "seq,time,time_valid,source,hopper,pwm,duration_ms,portion_mg,"
+                                          "peak_ma,avg_ma,jammed\n", HTTPD_RESP_USE_STRLEN);
+
+    event_log_iter_t it;
+    int count;
+
+    event_log_iter_begin(&it);
+    while (err == ESP_OK && (count = event_log_iter_next(&it, records, FEED_LOG_BATCH)) > 0) {
+        size_t len = 0;
+        for (int i = 0; i < count; i++) {
+            const event_record_t *r = &records[i];
+            if (r->seq < since) {
+                continue;
+            }
+            const char *source = feeder_source_name(r->source);
+            len += snprintf(chunk + len, size - len, "%lu,%lu,%d,%s,%u,%u,%lu,",
+                            (unsigned long)r->seq, (unsigned long)r->time,
+                            (r->flags & EVENT_LOG_FLAG_TIME_VALID) != 0, source, r->hopper, r->duty,
+                            (unsigned long)r->duration_ms);
+            if (r->flags & EVENT_LOG_FLAG_WEIGHED) {
+                len += snprintf(chunk + len, size - len, "%ld", (long)r->portion_mg);
+            }
+            if (r->flags & EVENT_LOG_FLAG_CURRENT) {
+                len += snprintf(chunk + len, size - len, ",%u,%u,%d", r->peak_ma, r->avg_ma,
+                                (r->flags & EVENT_LOG_FLAG_JAMMED) != 0);
+            } else {
+                len += snprintf(chunk + len, size - len, ",,,");
+            }
+            chunk[len++] = '\n';
+        }
+        if (len > 0) {
+            err = httpd_resp_send_chunk(req, chunk, len);
+        }
+    }
+
+    if (err != ESP_OK) {
+        return err;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+esp_err_t feed_log_init(void)
+{
+    return event_log_init();
+}
+
+void feed_log_register(httpd_handle_t server)
+{
+    // Feed history URI handler
+    httpd_uri_t log = {
+        .uri        = "/log",
+        .method     = HTTP_GET,
+        .handler    = log_handler,
+        .user_ctx   = NULL
+    };
+
+    feeder_register_slow_uri(server, &log);
+}
@@ -0,0 +1,280 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "sdkconfig.h"
+#include "web_assets.h"
+#include "json_writer.h"
+#include "actuator.h"
+
+// Shared between the feeder core and its optional feature modules
+
+#define FEEDER_STATE_LEN    256     // Largest state push message
+#define FEEDER_MAX_HOLD_MS  60000   // Longest hold a request may ask for, as CONFIG_FEEDER_FEED_HOLD_MS
+#define FEEDER_MAX_TIMER_MIN (7 * 24 * 60)  // Longest auto-feed interval
+
+// Core of the actuator and scale tasks, away from WiFi and httpd
+#ifdef CONFIG_FEEDER_CONTROL_CORE
+#define FEEDER_CONTROL_CORE CONFIG_FEEDER_CONTROL_CORE
+#else
+#define FEEDER_CONTROL_CORE tskNO_AFFINITY
+#endif
+
+// Core of the trace task, which prints what the control core logged
+#ifdef CONFIG_FEEDER_HTTPD_CORE
+#define FEEDER_TRACE_CORE   CONFIG_FEEDER_HTTPD_CORE
+#else
+#define FEEDER_TRACE_CORE   tskNO_AFFINITY
+#endif
+
+// Who asked for a feed, as recorded in the feed log
+typedef enum {
+    FEED_SOURCE_HTTP,
+    FEED_SOURCE_WS,
+    FEED_SOURCE_TIMER,
+    FEED_SOURCE_SCHEDULE,
+    FEED_SOURCE_WAKE,           // Deep-sleep wake-up
+    FEED_SOURCE_BATCH,          // Fleet /batch request
+    FEED_SOURCE_MQTT,           // Command over MQTT
+} feed_source_t;
+
+// Generated from main/web at build time
+extern const web_asset_t web_asset_index;
+#if CONFIG_FEEDER_PWM_TUNING
+extern const web_asset_t web_asset_pwm_tuning;
+#endif
+#if CONFIG_FEEDER_PROVISIONING
+extern const web_asset_t web_asset_provision;
+#endif
+
+// Name of a feed source for logs and telemetry, "unknown" if out of range
+const char *feeder_source_name(feed_source_t source);
+
+// State of one hopper as a JSON object
+void feeder_format_state(char *buf, size_t size, int hopper, const char *event);
+
+// Push the state of a hopper to every connected dashboard, and to MQTT when
+// that is enabled
+void feeder_push_state(int hopper, const char *event);
+
+// Execute feeding action - only queues the move, never blocks. A hold of 0
+// uses the hopper's configured reset delay.
+esp_err_t feeder_feed(int hopper, uint32_t hold_ms, feed_source_t source);
+
+// Rearm the interval timer for a new interval in minutes, 0 stops it, at
+// most FEEDER_MAX_TIMER_MIN. The caller stores the interval.
+void feeder_restart_auto_feed_timer(uint32_t minutes);
+
+// Actuator configuration of every hopper for the current settings; returns
+// the hopper count. hoppers must hold ACTUATOR_MAX_HOPPERS entries.
+int feeder_actuator_config(actuator_config_t *hoppers);
+
+// Unsigned integer query parameter: ESP_ERR_NOT_FOUND when absent,
+// ESP_ERR_INVALID_ARG when not a number
+esp_err_t feeder_query_uint(httpd_req_t *req, const char *key, uint32_t *value);
+
+// Hopper selected by a "?hopper=N" query, 0 when absent. False if N is not
+// a configured hopper.
+bool feeder_request_hopper(httpd_req_t *req, int *hopper);
+
+// Add a hopper's servo settings fields to an open JSON object
+void feeder_write_settings(json_writer_t *w, int hopper);
+
+// Register a URI handler, timed on /metrics when that feature is enabled
+esp_err_t feeder_register_uri(httpd_handle_t server, const httpd_uri_t *uri);
+
+// Same for a handler that streams a large response; it runs on an async
+// worker when CONFIG_FEEDER_HTTPD_ASYNC is set, so a slow client cannot
+// hold up /feed
+esp_err_t feeder_register_slow_uri(httpd_handle_t server, const httpd_uri_t *uri);
+
+#if CONFIG_FEEDER_SCALE
+// Start the load cell; needs NVS
+esp_err_t portion_init(void);
+
+// Weight readout and calibration at /weight
+void portion_register(httpd_handle_t server);
+
+// Feed until grams have landed on the scale, or CONFIG_FEEDER_SCALE_MAX_FEED_MS
+// at most. ESP_ERR_NOT_FOUND while the scale has no readings yet,
+// ESP_ERR_INVALID_STATE while another portion or feed is running.
+esp_err_t portion_feed(int hopper, uint32_t grams, feed_source_t source);
+
+// portion_feed() by milligrams, e.g. for the rest of a portion cut short
+esp_err_t portion_feed_mg(int hopper, int32_t mg, feed_source_t source);
+
+// How far short of its target the hopper's last feed stopped, 0 if it got
+// there; -1 if that feed was not weighed. Actuator task only.
+int32_t portion_short_mg(int hopper);
+
+// Actuator events, to close a running portion once its hopper is at rest
+void portion_actuator_event(int hopper, actuator_event_t event);
+#endif
+
+#if CONFIG_FEEDER_FILL_LEVEL
+// Add the fill-level sensors to the ADC stream; levels are pushed as they
+// change, with "low_food" and "empty" events when a hopper runs low
+esp_err_t fill_monitor_init(void);
+
+// The hopper's level is known and at most CONFIG_FEEDER_FILL_EMPTY_PCT
+bool fill_monitor_empty(int hopper);
+#endif
+
+#if CONFIG_FEEDER_CURRENT_SENSE
+// Add the servo current sensors to the ADC stream; a stalled feed backs off
+// and is retried up to CONFIG_FEEDER_JAM_RETRIES times, then sends "jam"
+esp_err_t jam_detect_init(void);
+
+// Actuator events, to measure each feed from start to rest; a retry keeps
+// the source and hold of the feed that jammed, and a weighed portion is
+// retried for what is still missing
+void jam_detect_actuator_event(int hopper, actuator_event_t event, feed_source_t source, uint32_t hold_ms);
+#endif
+
+#if CONFIG_FEEDER_FILL_LEVEL || CONFIG_FEEDER_CURRENT_SENSE
+// Both share one ADC converter, started once their channels are added
+#define FEEDER_ADC_RATE_HZ      20000   // The slowest the ESP32's ADC DMA runs
+#if CONFIG_FEEDER_FILL_LEVEL
+#define FEEDER_ADC_PERIOD_MS    (CONFIG_FEEDER_FILL_PERIOD_S * 1000)
+#define FEEDER_ADC_BURST_MS     50      // About 1000 samples per burst, split over the sensors
+#else
+#define FEEDER_ADC_PERIOD_MS    0
+#define FEEDER_ADC_BURST_MS     0       // Only while a feed is measured
+#endif
+#endif
+
+#if CONFIG_FEEDER_EVENT_LOG
+// Open the feed log partition
+esp_err_t feed_log_init(void);
+
+// Feed history as CSV at /log
+void feed_log_register(httpd_handle_t server);
+
+// Weight dispensed by the running feed of a hopper, if it was weighed
+void feed_log_set_portion(int hopper, int32_t portion_mg);
+
+// Servo current of the running feed of a hopper, if it was measured
+void feed_log_set_current(int hopper, uint16_t peak_ma, uint16_t avg_ma, bool jammed);
+
+// Actuator events; a finished feed is written to flash, labelled with who
+// started it
+void feed_log_actuator_event(int hopper, actuator_event_t event, uint32_t duty, feed_source_t source);
+#endif
+
+#if CONFIG_FEEDER_FEED_LIMIT
+typedef enum {
+    FEED_GUARD_ALLOW,
+    FEED_GUARD_MERGED,          // The hopper is dispensing; the request joins that feed
+    FEED_GUARD_LIMITED,         // Too soon or too many; retry_ms says when to come back
+} feed_guard_result_t;
+
+// Create the lock; call before the web server and MQTT start
+void feed_guard_init(void);
+
+// Admit an interactive feed before it reaches the actuator: refuses it for
+// CONFIG_FEEDER_FEED_MIN_INTERVAL_S after the hopper's last feed, and
+// applies a token bucket per client address and one for the whole device.
+// req is NULL for a feed that did not come over HTTP, e.g. from MQTT; it
+// skips the per-client bucket.
+feed_guard_result_t feed_guard_check(httpd_req_t *req, int hopper, uint32_t *retry_ms);
+
+// An admitted feed was queued: spend its tokens. Repeats are merged from
+// now on.
+void feed_guard_started(httpd_req_t *req, int hopper);
+
+// Actuator events, to know when each hopper is dispensing
+void feed_guard_actuator_event(int hopper, actuator_event_t event);
+
+// Requests merged into a running feed and refused, since boot
+uint32_t feed_guard_get_merged(void);
+uint32_t feed_guard_get_limited(void);
+#endif
+
+#if CONFIG_FEEDER_FLEET
+// Outcome of a command batch
+typedef struct {
+    const char *error;          // NULL when the batch was applied
+    int index;                  // Command the error is about, -1 for the whole batch
+    int applied;
+    int feeds_failed;           // Feeds refused after the batch had been checked
+    uint32_t retry_ms;          // Refused by the feed guard: when to send it again
+} fleet_result_t;
+
+// Derive the device id from the MAC address; call before anything else here
+esp_err_t fleet_init(void);
+
+// Unit name shared by mDNS and MQTT, e.g. "feeder-a1b2c3"
+const char *fleet_device_id(void);
+
+// Advertise the feeder over mDNS/DNS-SD; call once WiFi is started
+esp_err_t fleet_start_mdns(void);
+
+// Parse and apply a JSON array of commands, all or nothing, as POST /batch
+// does; feeds pass the feed guard without a client address, and one it
+// refuses rejects the batch. ESP_ERR_INVALID_ARG if it was rejected; result
+// says why.
+esp_err_t fleet_run_batch(const char *json, size_t len, feed_source_t source, fleet_result_t *result);
+
+// Result of a batch as a JSON object
+void fleet_write_result(json_writer_t *w, const fleet_result_t *result);
+
+// Batch of feed, set_timer and set_pwm commands at /batch
+void fleet_register(httpd_handle_t server);
+#endif
+
+#if CONFIG_FEEDER_OTA
+// Log the running image; on the first boot of an update, arm the rollback
+// deadline. Call early in app_main.
+esp_err_t ota_init(void);
+
+// The new image came up; keep it
+void ota_confirm(void);
+
+// Firmware upload at POST /ota and status at GET /ota
+void ota_register(httpd_handle_t server);
+#endif
+
+#if CONFIG_FEEDER_PROVISIONING
+// Credentials to join with: the provisioned ones, else the build's
+// CONFIG_FEEDER_WIFI_SSID if set. False when there are none or the setup
+// button is held at boot; then run the setup portal instead.
+bool provision_load(char *ssid, char *password);
+
+// Setup access point, captive DNS and the setup page; restarts the feeder
+// once it has joined the chosen network
+esp_err_t provision_start_portal(void);
+#endif
+
+#if CONFIG_FEEDER_MQTT
+// Connect to CONFIG_FEEDER_MQTT_BROKER_URI and start publishing; needs
+// fleet_init(). Reconnects on its own.
+esp_err_t mqtt_link_start(void);
+
+// Actuator events, queued and published as batched feed events
+void mqtt_link_actuator_event(int hopper, actuator_event_t event, uint32_t duty, feed_source_t source);
+
+// Republish a hopper's state with the next batch
+void mqtt_link_state_changed(int hopper);
+#endif
+
+#if CONFIG_FEEDER_TASK_STATS
+// Per-task CPU load and per-core load at /tasks
+void task_stats_register(httpd_handle_t server);
+#endif
+
+#if CONFIG_FEEDER_TRACE
+// The trace records printed last at /trace
+void trace_log_register(httpd_handle_t server);
+#endif
+
+#if CONFIG_FEEDER_PWM_TUNING
+// Servo tuning page at /tuning with /set_pwm and /settings
+void pwm_tuning_register(httpd_handle_t server);
+
+// Handle a tuning command received over the WebSocket; false if cmd is not one
+bool pwm_tuning_ws_command(httpd_req_t *req, const char *cmd, const char *payload, size_t len);
+#endif
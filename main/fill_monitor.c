@@ -0,0 +1,64 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include "esp_log.h"
+#include "fill_level.h"
+#include "actuator.h"
+#include "feeder.h"
+
+static const char *TAG = "fill_monitor";
+
+// Alert state per hopper, sampling task only
+static bool low[ACTUATOR_MAX_HOPPERS];
+static bool empty[ACTUATOR_MAX_HOPPERS];
+
+// Sampling task: a level moved by a step; alert once when a hopper runs low
+// or empty, and again after it was refilled
+static void level_changed(int hopper, int percent)
+{
+    const char *event = "level";
+
+    if (percent <= CONFIG_FEEDER_FILL_EMPTY_PCT && !empty[hopper]) {
+        ESP_LOGW(TAG, "Hopper %d is empty, timed feeds skipped", hopper);
+        event = "empty";
+    } else if (percent <= CONFIG_FEEDER_FILL_LOW_PCT && !low[hopper]) {
+        ESP_LOGW(TAG, "Hopper %d is low on food: %d%%", hopper, percent);
+        event = "low_food";
+    }
+    empty[hopper] = percent <= CONFIG_FEEDER_FILL_EMPTY_PCT;
+    low[hopper] = percent <= CONFIG_FEEDER_FILL_LOW_PCT;
+    feeder_push_state(hopper, event);
+}
+
+bool fill_monitor_empty(int hopper)
+{
+    int level = fill_level_get(hopper);
+    return level != FILL_LEVEL_UNKNOWN && level <= CONFIG_FEEDER_FILL_EMPTY_PCT;
+}
+
+// One sensor per ADC1 channel in CONFIG_FEEDER_FILL_ADC_CHANNELS, hopper i
+// on the i-th, e.g. "6,7"
+esp_err_t fill_monitor_init(void)
+{
+    fill_sensor_config_t sensors[ACTUATOR_MAX_HOPPERS];
+    const char *p = CONFIG_FEEDER_FILL_ADC_CHANNELS;
+    int count = 0;
+
+    while (*p != '\0' && count < ACTUATOR_MAX_HOPPERS) {
+        char *end;
+        long channel = strtol(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        sensors[count++] = (fill_sensor_config_t) {
+            .channel   = channel,
+            .empty_raw = CONFIG_FEEDER_FILL_EMPTY_RAW,
+            .full_raw  = CONFIG_FEEDER_FILL_FULL_RAW,
+        };
+        p = end;
+        while (*p == ',' || *p == ' ') {
+            p++;
+        }
+    }
+
+    return fill_level_init(sensors, count, CONFIG_FEEDER_FILL_STEP_PCT, level_changed);
+}
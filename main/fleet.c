@@ -0,0 +1,437 @@
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_app_desc.h"
+#include "esp_http_server.h"
+#include "mdns.h"
+#include "json_writer.h"
+#include "json_reader.h"
+#include "actuator.h"
+#include "servo_cal.h"
+#include "config_store.h"
+#include "feeder.h"
+
+#define FLEET_MAX_COMMANDS  16      // Per /batch request
+#define FLEET_SERVICE       "_feeder"
+
+static const char *TAG = "fleet";
+
+typedef struct {
+    char cmd[12];
+    int hopper;                     // -1 when out of range
+    bool negative;                  // Some number was below zero
+    bool has_minutes, has_default, has_feed, has_delay, has_ramp;
+    uint32_t minutes;
+    uint32_t default_pwm;
+    uint32_t feed_pwm;
+    uint32_t reset_delay_ms;
+    uint32_t ramp_ms;
+    uint32_t hold_ms;               // feed: 0 uses the reset delay
+    uint32_t grams;                 // feed: weighed portion when non-zero
+    char profile[CONFIG_STORE_PROFILE_LEN];
+} batch_command_t;
+
+typedef struct {
+    batch_command_t commands[FLEET_MAX_COMMANDS];
+    int count;
+    bool is_array;
+    bool overflow;
+} batch_t;
+
+// One batch at a time, from /batch or MQTT; keeps a full batch off the
+// stacks of both tasks
+static batch_t batch;
+static SemaphoreHandle_t batch_lock = NULL;
+static StaticSemaphore_t batch_lock_buffer;
+static char device_id[32];
+
+static esp_err_t batch_event(const json_event_t *ev, void *ctx)
+{
+    batch_t *b = ctx;
+
+    if (ev->depth == 0 && ev->type == JSON_EVENT_ARRAY_START) {
+        b->is_array = true;
+        return ESP_OK;
+    }
+    if (!b->is_array) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (ev->depth == 1 && ev->type == JSON_EVENT_OBJECT_START) {
+        if (b->count == FLEET_MAX_COMMANDS) {
+            b->overflow = true;
+            return ESP_ERR_INVALID_SIZE;
+        }
+        memset(&b->commands[b->count], 0, sizeof(b->commands[0]));
+    } else if (ev->depth == 1 && ev->type == JSON_EVENT_OBJECT_END) {
+        b->count++;
+    } else if (ev->depth == 2 && ev->key != NULL) {
+        batch_command_t *c = &b->commands[b->count];
+        uint32_t value = ev->number <= 0 ? 0 : ev->number >= UINT32_MAX ? UINT32_MAX : (uint32_t)ev->number;
+
+        if (ev->type == JSON_EVENT_NUMBER && ev->number < 0) {
+            c->negative = true;
+        }
+        if (ev->type == JSON_EVENT_STRING && strcmp(ev->key, "cmd") == 0) {
+            snprintf(c->cmd, sizeof(c->cmd), "%s", ev->str);
+        } else if (ev->type == JSON_EVENT_STRING && strcmp(ev->key, "profile") == 0) {
+            snprintf(c->profile, sizeof(c->profile), "%s", ev->str);
+        } else if (ev->type != JSON_EVENT_NUMBER) {
+            // Not a field of any command
+        } else if (strcmp(ev->key, "hopper") == 0) {
+            c->hopper = value < ACTUATOR_MAX_HOPPERS ? (int)value : -1;
+        } else if (strcmp(ev->key, "minutes") == 0) {
+            c->has_minutes = true;
+            c->minutes = value;
+        } else if (strcmp(ev->key, "default_pwm") == 0) {
+            c->has_default = true;
+            c->default_pwm = value;
+        } else if (strcmp(ev->key, "feed_pwm") == 0) {
+            c->has_feed = true;
+            c->feed_pwm = value;
+        } else if (strcmp(ev->key, "reset_delay_ms") == 0) {
+            c->has_delay = true;
+            c->reset_delay_ms = value;
+        } else if (strcmp(ev->key, "ramp_ms") == 0) {
+            c->has_ramp = true;
+            c->ramp_ms = value;
+        } else if (strcmp(ev->key, "hold_ms") == 0) {
+            c->hold_ms = value;
+        } else if (strcmp(ev->key, "grams") == 0) {
+            c->grams = value;
+        }
+    }
+    return ESP_OK;
+}
+
+// Check one command against the feeder as it is, and as the earlier
+// commands of the batch leave it. Returns the problem, or NULL.
+static const char *validate_command(const batch_command_t *c, uint32_t *feeding, bool *weighing)
+{
+    uint32_t min_duty = servo_angle_to_duty(0);
+    uint32_t max_duty = servo_angle_to_duty(SERVO_MAX_ANGLE);
+
+    if (c->negative) {
+        return "Negative value";
+    }
+    if (c->hopper < 0 || c->hopper >= actuator_hopper_count()) {
+        return "Unknown hopper";
+    }
+
+    if (strcmp(c->cmd, "feed") == 0) {
+        if (actuator_is_busy(c->hopper) || (*feeding & (1UL << c->hopper))) {
+            return "Hopper busy";
+        }
+#if CONFIG_FEEDER_SCALE
+        if (c->grams > 0 && *weighing) {
+            return "One weighed portion at a time";
+        }
+        *weighing |= c->grams > 0;
+#else
+        if (c->grams > 0) {
+            return "No scale";
+        }
+#endif
+        *feeding |= 1UL << c->hopper;
+    } else if (strcmp(c->cmd, "set_timer") == 0) {
+        if (!c->has_minutes) {
+            return "Missing minutes";
+        }
+        if (c->minutes > FEEDER_MAX_TIMER_MIN) {
+            return "Minutes out of range";
+        }
+    } else if (strcmp(c->cmd, "set_pwm") == 0) {
+        if ((c->has_default && (c->default_pwm < min_duty || c->default_pwm > max_duty)) ||
+            (c->has_feed && (c->feed_pwm < min_duty || c->feed_pwm > max_duty))) {
+            return "PWM out of range";
+        }
+        if (c->profile[0] != '\0' && motion_find_profile(c->profile) == NULL) {
+            return "Unknown motion profile";
+        }
+        if (!c->has_default && !c->has_feed && !c->has_delay && !c->has_ramp && c->profile[0] == '\0') {
+            return "No settings";
+        }
+    } else {
+        return "Unknown command";
+    }
+    return NULL;
+}
+
+// Check every command, then store all settings in one update and start
+// the feeds last. Called with the batch lock held; req is NULL for MQTT.
+static void run_batch(feed_source_t source, httpd_req_t *req, fleet_result_t *result)
+{
+    uint32_t feeding = 0;
+    bool weighing = false;
+
+    for (int i = 0; i < batch.count; i++) {
+        const char *problem = validate_command(&batch.commands[i], &feeding, &weighing);
+        if (problem != NULL) {
+            result->error = problem;
+            result->index = i;
+            return;
+        }
+    }
+#if CONFIG_FEEDER_FEED_LIMIT
+    // Scripts loop over /batch and MQTT just as well as over /feed. A feed
+    // refused here must not leave the settings before it applied.
+    for (int i = 0; i < batch.count; i++) {
+        const batch_command_t *c = &batch.commands[i];
+        if (strcmp(c->cmd, "feed") != 0) {
+            continue;
+        }
+        uint32_t retry_ms = 0;
+        feed_guard_result_t admit = feed_guard_check(req, c->hopper, &retry_ms);
+        if (admit != FEED_GUARD_ALLOW) {
+            // A merge means a feed started since validation
+            result->error = admit == FEED_GUARD_MERGED ? "Hopper busy" : "Feed limit reached";
+            result->index = i;
+            result->retry_ms = retry_ms;
+            return;
+        }
+    }
+#endif
+
+    // Settings first, in one config update
+    feeder_config_t cfg = *config_store_get();
+    uint32_t changed = 0;
+    uint32_t rest_changed = 0;
+    bool timer_changed = false;
+    for (int i = 0; i < batch.count; i++) {
+        const batch_command_t *c = &batch.commands[i];
+        hopper_config_t *hc = &cfg.hoppers[c->hopper];
+
+        if (strcmp(c->cmd, "set_timer") == 0) {
+            cfg.auto_feed_interval = c->minutes;
+            timer_changed = true;
+        } else if (strcmp(c->cmd, "set_pwm") == 0) {
+            if (c->has_default) {
+                hc->default_pwm = c->default_pwm;
+                rest_changed |= 1UL << c->hopper;
+            }
+            if (c->has_feed) {
+                hc->feed_pwm = c->feed_pwm;
+            }
+            if (c->has_delay) {
+                hc->reset_delay_ms = c->reset_delay_ms;
+            }
+            if (c->has_ramp) {
+                hc->ramp_ms = c->ramp_ms;
+            }
+            if (c->profile[0] != '\0') {
+                snprintf(hc->profile, sizeof(hc->profile), "%s", c->profile);
+            }
+            changed |= 1UL << c->hopper;
+        }
+    }
+    config_store_set(&cfg);
+
+    for (int i = 0; i < actuator_hopper_count(); i++) {
+        if (changed & (1UL << i)) {
+            const hopper_config_t *hc = &cfg.hoppers[i];
+            actuator_set_rest_duty(i, hc->default_pwm);
+            actuator_set_motion(i, motion_find_profile(hc->profile), hc->ramp_ms, MOTION_EASE_IN_OUT);
+            if (rest_changed & (1UL << i)) {
+                // Idle servos go to the new rest position now, feeding ones on their way back
+                actuator_move(i, hc->default_pwm);
+            }
+            feeder_push_state(i, "settings");
+        }
+    }
+    if (timer_changed) {
+        feeder_restart_auto_feed_timer(cfg.auto_feed_interval);
+        feeder_push_state(0, "timer");
+    }
+
+    // Then the feeds. Validation saw them idle, so a failure here means a
+    // feed from elsewhere got in first.
+    for (int i = 0; i < batch.count; i++) {
+        const batch_command_t *c = &batch.commands[i];
+        if (strcmp(c->cmd, "feed") != 0) {
+            continue;
+        }
+#if CONFIG_FEEDER_SCALE
+        esp_err_t err = c->grams > 0 ? portion_feed(c->hopper, c->grams, source)
+                                     : feeder_feed(c->hopper, c->hold_ms, source);
+#else
+        esp_err_t err = feeder_feed(c->hopper, c->hold_ms, source);
+#endif
+        if (err != ESP_OK) {
+            result->feeds_failed++;
+        }
+#if CONFIG_FEEDER_FEED_LIMIT
+        if (err == ESP_OK) {
+            feed_guard_started(req, c->hopper);
+        }
+#endif
+    }
+
+    ESP_LOGI(TAG, "Batch of %d commands applied, %d feeds failed", batch.count, result->feeds_failed);
+    result->applied = batch.count;
+}
+
+static void check_parse(esp_err_t err, fleet_result_t *result)
+{
+    if (batch.overflow) {
+        result->error = "Too many commands";
+    } else if (err != ESP_OK || batch.count == 0) {
+        result->error = "Expected a JSON array of commands";
+    }
+}
+
+static void begin_batch(json_reader_t *reader, fleet_result_t *result)
+{
+    *result = (fleet_result_t) { .index = -1 };
+    memset(&batch, 0, sizeof(batch));
+    json_reader_init(reader, batch_event, &batch);
+}
+
+esp_err_t fleet_run_batch(const char *json, size_t len, feed_source_t source, fleet_result_t *result)
+{
+    json_reader_t reader;
+
+    xSemaphoreTake(batch_lock, portMAX_DELAY);
+    begin_batch(&reader, result);
+    esp_err_t err = json_reader_feed(&reader, json, len);
+    if (err == ESP_OK) {
+        err = json_reader_finish(&reader);
+    }
+    check_parse(err, result);
+    if (result->error == NULL) {
+        run_batch(source, NULL, result);
+    }
+    xSemaphoreGive(batch_lock);
+    return result->error == NULL ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+void fleet_write_result(json_writer_t *w, const fleet_result_t *result)
+{
+    json_begin_object(w, NULL);
+    if (result->error != NULL) {
+        json_add_string(w, "error", result->error);
+        if (result->index >= 0) {
+            json_add_int(w, "index", result->index);
+        }
+        if (result->retry_ms > 0) {
+            json_add_int(w, "retry_ms", result->retry_ms);
+        }
+    }
+    json_add_int(w, "applied", result->applied);
+    if (result->error == NULL) {
+        json_add_int(w, "feeds_failed", result->feeds_failed);
+    }
+    json_end_object(w);
+}
+
+// Apply a batch of commands all or nothing:
+// [{"cmd":"set_pwm","hopper":1,"feed_pwm":540},{"cmd":"set_timer","minutes":240},{"cmd":"feed","hopper":1}]
+// Every command is checked first, feeds against the feed guard too;
+// settings are stored in one update, then the feeds start.
+static esp_err_t batch_handler(httpd_req_t *req)
+{
+    json_reader_t reader;
+    fleet_result_t result;
+
+    xSemaphoreTake(batch_lock, portMAX_DELAY);
+    begin_batch(&reader, &result);
+    esp_err_t err = json_reader_parse_request(&reader, req);
+    if (err != ESP_ERR_TIMEOUT && err != ESP_FAIL) {
+        check_parse(err, &result);
+        if (result.error == NULL) {
+            run_batch(FEED_SOURCE_BATCH, req, &result);
+        }
+    }
+    xSemaphoreGive(batch_lock);
+
+    if (err == ESP_ERR_TIMEOUT) {
+        httpd_resp_send_408(req);
+        return ESP_FAIL;
+    } else if (err == ESP_FAIL) {
+        return ESP_FAIL;                // Connection lost
+    } else if (result.error != NULL && result.index < 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, result.error);
+        return ESP_FAIL;
+    }
+
+    char buf[128];
+    char retry[12];
+    json_writer_t w;
+    if (result.retry_ms > 0) {
+        snprintf(retry, sizeof(retry), "%lu", (unsigned long)((result.retry_ms + 999) / 1000));
+        httpd_resp_set_status(req, "429 Too Many Requests");
+        httpd_resp_set_hdr(req, "Retry-After", retry);
+    } else if (result.error != NULL) {
+        httpd_resp_set_status(req, HTTPD_400);
+    }
+    json_writer_init(&w, req, buf, sizeof(buf));
+    fleet_write_result(&w, &result);
+    err = json_writer_finish(&w);
+    return result.error != NULL ? ESP_FAIL : err;
+}
+
+esp_err_t fleet_init(void)
+{
+    uint8_t mac[6];
+
+    // The MAC suffix keeps a fleet of identical units apart
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    snprintf(device_id, sizeof(device_id), "%s-%02x%02x%02x", CONFIG_FEEDER_MDNS_HOSTNAME, mac[3], mac[4], mac[5]);
+
+    batch_lock = xSemaphoreCreateMutexStatic(&batch_lock_buffer);
+    return ESP_OK;
+}
+
+const char *fleet_device_id(void)
+{
+    return device_id;
+}
+
+esp_err_t fleet_start_mdns(void)
+{
+    const char *hostname = device_id;
+    char hoppers[4];
+
+    snprintf(hoppers, sizeof(hoppers), "%d", actuator_hopper_count());
+
+    esp_err_t err = mdns_init();
+    if (err == ESP_OK) {
+        err = mdns_hostname_set(hostname);
+    }
+    if (err == ESP_OK) {
+        err = mdns_instance_name_set(hostname);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "mDNS failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    mdns_txt_item_t txt[] = {
+        { "version", esp_app_get_description()->version },
+        { "hoppers", hoppers },
+        { "batch",   "/batch" },
+    };
+    err = mdns_service_add(NULL, FLEET_SERVICE, "_tcp", 80, txt, sizeof(txt) / sizeof(txt[0]));
+    if (err == ESP_OK) {
+        err = mdns_service_add(NULL, "_http", "_tcp", 80, NULL, 0);
+    }
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Advertised as %s.local (%s._tcp)", hostname, FLEET_SERVICE);
+    }
+    return err;
+}
+
+void fleet_register(httpd_handle_t server)
+{
+    // Batch command URI handler
+    httpd_uri_t batch_uri = {
+        .uri        = "/batch",
+        .method     = HTTP_POST,
+        .handler    = batch_handler,
+        .user_ctx   = NULL
+    };
+
+    feeder_register_uri(server, &batch_uri);
+}
@@ -0,0 +1,107 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include "esp_log.h"
+#include "trace.h"
+#include "current_sense.h"
+#include "actuator.h"
+#include "feeder.h"
+
+static const char *TAG = "jam_detect";
+
+// Per hopper, actuator task only
+static int attempts[ACTUATOR_MAX_HOPPERS];
+static bool retrying[ACTUATOR_MAX_HOPPERS];
+
+// Sampling task: back off at once; the servo returns to rest and the
+// feed is retried from there
+static void stalled(int hopper, uint16_t ma)
+{
+    TRACE_LOGW(TAG, "Hopper %d stalled at %u mA, backing off", hopper, ma);
+    actuator_end_hold(hopper);
+}
+
+void jam_detect_actuator_event(int hopper, actuator_event_t event, feed_source_t source, uint32_t hold_ms)
+{
+    if (event == ACTUATOR_EVENT_FEED) {
+        if (!retrying[hopper]) {
+            attempts[hopper] = 0;
+        }
+        retrying[hopper] = false;
+        current_sense_begin(hopper);
+        return;
+    }
+    if (event != ACTUATOR_EVENT_RESET) {
+        return;
+    }
+
+    current_result_t result;
+    if (!current_sense_end(hopper, &result)) {
+        return;
+    }
+    TRACE_LOGI(TAG, "Hopper %d: peak %u mA, average %u mA", hopper, result.peak_ma, result.avg_ma);
+#if CONFIG_FEEDER_EVENT_LOG
+    feed_log_set_current(hopper, result.peak_ma, result.avg_ma, result.stalled);
+#endif
+    if (!result.stalled) {
+        return;
+    }
+#if CONFIG_FEEDER_SCALE
+    // A weighed portion only needs what is still missing
+    int32_t short_mg = portion_short_mg(hopper);
+    if (short_mg == 0) {
+        TRACE_LOGI(TAG, "Hopper %d stalled with its portion complete", hopper);
+        return;
+    }
+#endif
+
+    if (attempts[hopper] < CONFIG_FEEDER_JAM_RETRIES) {
+        attempts[hopper]++;
+        TRACE_LOGW(TAG, "Hopper %d jammed, retry %d of %d", hopper, attempts[hopper], CONFIG_FEEDER_JAM_RETRIES);
+        retrying[hopper] = true;
+        esp_err_t err;
+#if CONFIG_FEEDER_SCALE
+        if (short_mg > 0) {
+            err = portion_feed_mg(hopper, short_mg, source);
+        } else
+#endif
+        {
+            err = feeder_feed(hopper, hold_ms, source);
+        }
+        if (err != ESP_OK) {
+            retrying[hopper] = false;
+        }
+    } else {
+        ESP_LOGE(TAG, "Hopper %d still jammed after %d retries", hopper, attempts[hopper]);
+        feeder_push_state(hopper, "jam");
+    }
+}
+
+// One sensor per ADC1 channel in CONFIG_FEEDER_CURRENT_ADC_CHANNELS, hopper
+// i on the i-th, e.g. "4,5"
+esp_err_t jam_detect_init(void)
+{
+    current_sensor_config_t sensors[CURRENT_SENSE_MAX_SENSORS];
+    const char *p = CONFIG_FEEDER_CURRENT_ADC_CHANNELS;
+    int count = 0;
+
+    while (*p != '\0' && count < CURRENT_SENSE_MAX_SENSORS && count < ACTUATOR_MAX_HOPPERS) {
+        char *end;
+        long channel = strtol(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        sensors[count++] = (current_sensor_config_t) {
+            .channel      = channel,
+            .zero_raw     = CONFIG_FEEDER_CURRENT_ZERO_RAW,
+            .ua_per_count = CONFIG_FEEDER_CURRENT_UA_PER_COUNT,
+            .stall_ma     = CONFIG_FEEDER_JAM_STALL_MA,
+            .stall_ms     = CONFIG_FEEDER_JAM_STALL_MS,
+        };
+        p = end;
+        while (*p == ',' || *p == ' ') {
+            p++;
+        }
+    }
+
+    return current_sense_init(sensors, count, stalled);
+}
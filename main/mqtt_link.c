@@ -0,0 +1,361 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_app_desc.h"
+#include "mqtt_client.h"
+#include "json_writer.h"
+#include "network.h"
+#include "actuator.h"
+#include "feeder.h"
+
+#define MQTT_LINK_EVENTS        32      // Feed events waiting for the next batch
+#define MQTT_LINK_BATCH_MAX     12      // Events per message
+#define MQTT_LINK_MSG_LEN       1536
+#define MQTT_LINK_TOPIC_LEN     96
+#define MQTT_LINK_BUFFER        2048    // Largest command accepted, in one piece
+#define MQTT_LINK_STACK         3584
+#define MQTT_LINK_PRIORITY      2
+#define MQTT_LINK_HEARTBEAT_S   600     // Health is republished at least this often
+#define MQTT_LINK_HEAP_STEP     1024    // Free heap change worth a health message
+#define MQTT_LINK_RSSI_STEP     3       // dBm
+#define MQTT_LINK_MIN_TIME      1600000000  // Earlier clock readings mean SNTP has not set it
+
+// One feed start or end, as reported by the actuator task
+typedef struct {
+    actuator_event_t event;
+    feed_source_t source;
+    uint8_t hopper;
+    uint32_t duty;
+    uint32_t duration_ms;           // Of the finished feed
+    int64_t at_us;
+    time_t time;
+} link_event_t;
+
+typedef struct {
+    uint32_t heap_free;
+    uint32_t heap_min;
+    int rssi;
+    uint32_t reconnects;
+    uint32_t queue_peak;
+} health_t;
+
+static const char *TAG = "mqtt_link";
+static esp_mqtt_client_handle_t client = NULL;
+static TaskHandle_t link_task = NULL;
+static StaticTask_t link_task_buffer;
+static StackType_t link_task_stack[MQTT_LINK_STACK];
+static volatile bool connected = false;
+static volatile bool resend = false;        // Republish state and health after a reconnect
+
+// Written by the actuator task and feature modules, drained by link_task
+static portMUX_TYPE pending_lock = portMUX_INITIALIZER_UNLOCKED;
+static link_event_t events[MQTT_LINK_EVENTS];
+static int event_head = 0;                  // Next slot to write
+static int event_count = 0;
+static uint32_t events_dropped = 0;
+static uint32_t state_dirty = 0;            // Bit n: hopper n changed
+static int64_t feed_start_us[ACTUATOR_MAX_HOPPERS];     // Actuator task only
+
+static char base_topic[MQTT_LINK_TOPIC_LEN];
+static char status_topic[MQTT_LINK_TOPIC_LEN];
+static char cmd_topic[MQTT_LINK_TOPIC_LEN];
+static char fleet_cmd_topic[MQTT_LINK_TOPIC_LEN];
+static char msg[MQTT_LINK_MSG_LEN];         // Only used by link_task
+
+void mqtt_link_actuator_event(int hopper, actuator_event_t event, uint32_t duty, feed_source_t source)
+{
+    if (event == ACTUATOR_EVENT_MOVE || link_task == NULL) {
+        return;                             // Moves only change the state
+    }
+
+    link_event_t e = {
+        .event = event,
+        .source = source,
+        .hopper = hopper,
+        .duty = duty,
+        .at_us = esp_timer_get_time(),
+        .time = time(NULL),
+    };
+    if (event == ACTUATOR_EVENT_FEED) {
+        feed_start_us[hopper] = e.at_us;
+    } else {
+        e.duration_ms = (e.at_us - feed_start_us[hopper]) / 1000;
+    }
+
+    // Oldest events go first when the broker is out of reach for long
+    portENTER_CRITICAL(&pending_lock);
+    events[event_head] = e;
+    event_head = (event_head + 1) % MQTT_LINK_EVENTS;
+    if (event_count < MQTT_LINK_EVENTS) {
+        event_count++;
+    } else {
+        events_dropped++;
+    }
+    portEXIT_CRITICAL(&pending_lock);
+    xTaskNotifyGive(link_task);
+}
+
+void mqtt_link_state_changed(int hopper)
+{
+    if (link_task == NULL || hopper < 0 || hopper >= ACTUATOR_MAX_HOPPERS) {
+        return;
+    }
+
+    portENTER_CRITICAL(&pending_lock);
+    state_dirty |= 1UL << hopper;
+    portEXIT_CRITICAL(&pending_lock);
+    xTaskNotifyGive(link_task);
+}
+
+static void publish(const char *topic, const char *data, bool retain)
+{
+    if (esp_mqtt_client_publish(client, topic, data, 0, 0, retain) < 0) {
+        ESP_LOGW(TAG, "Publish to %s failed", topic);
+    }
+}
+
+static void add_event(json_writer_t *w, const link_event_t *e)
+{
+    json_begin_object(w, NULL);
+    json_add_string(w, "event", e->event == ACTUATOR_EVENT_FEED ? "feed" : "done");
+    json_add_int(w, "hopper", e->hopper);
+    json_add_string(w, "source", feeder_source_name(e->source));
+    json_add_int(w, "uptime_ms", e->at_us / 1000);
+    if (e->time >= MQTT_LINK_MIN_TIME) {
+        json_add_int(w, "time", e->time);
+    }
+    if (e->event == ACTUATOR_EVENT_FEED) {
+        json_add_int(w, "pwm", e->duty);
+    } else {
+        json_add_int(w, "duration_ms", e->duration_ms);
+    }
+    json_end_object(w);
+}
+
+// Events go out as JSON arrays of up to MQTT_LINK_BATCH_MAX, QoS 0
+static void flush_events(void)
+{
+    char topic[MQTT_LINK_TOPIC_LEN];
+    snprintf(topic, sizeof(topic), "%s/events", base_topic);
+
+    while (true) {
+        link_event_t batch[MQTT_LINK_BATCH_MAX];
+        int count = 0;
+        uint32_t dropped;
+
+        portENTER_CRITICAL(&pending_lock);
+        int tail = (event_head - event_count + MQTT_LINK_EVENTS) % MQTT_LINK_EVENTS;
+        while (count < MQTT_LINK_BATCH_MAX && count < event_count) {
+            batch[count] = events[(tail + count) % MQTT_LINK_EVENTS];
+            count++;
+        }
+        event_count -= count;
+        dropped = events_dropped;
+        events_dropped = 0;
+        portEXIT_CRITICAL(&pending_lock);
+
+        if (count == 0) {
+            return;
+        }
+        if (dropped > 0) {
+            ESP_LOGW(TAG, "%lu feed events lost while offline", (unsigned long)dropped);
+        }
+
+        json_writer_t w;
+        json_writer_init(&w, NULL, msg, sizeof(msg));
+        json_begin_array(&w, NULL);
+        for (int i = 0; i < count; i++) {
+            add_event(&w, &batch[i]);
+        }
+        json_end_array(&w);
+        if (json_writer_finish(&w) == ESP_OK) {
+            publish(topic, msg, false);
+        }
+    }
+}
+
+// The latest state of every changed hopper, retained so a new subscriber
+// sees it at once
+static void flush_state(void)
+{
+    char topic[MQTT_LINK_TOPIC_LEN];
+
+    portENTER_CRITICAL(&pending_lock);
+    uint32_t dirty = state_dirty;
+    state_dirty = 0;
+    portEXIT_CRITICAL(&pending_lock);
+
+    for (int i = 0; i < actuator_hopper_count(); i++) {
+        if (dirty & (1UL << i)) {
+            snprintf(topic, sizeof(topic), "%s/state/%d", base_topic, i);
+            feeder_format_state(msg, FEEDER_STATE_LEN, i, "state");
+            publish(topic, msg, true);
+        }
+    }
+}
+
+static int delta(int a, int b)
+{
+    return a > b ? a - b : b - a;
+}
+
+// Health is only sent when it moved noticeably, and as a heartbeat
+static void check_health(bool force)
+{
+    static health_t last;
+    static int64_t last_us = 0;
+    int64_t now = esp_timer_get_time();
+    health_t h = {
+        .heap_free = esp_get_free_heap_size(),
+        .heap_min = esp_get_minimum_free_heap_size(),
+        .rssi = network_get_rssi(),
+        .reconnects = network_get_reconnects(),
+        .queue_peak = actuator_get_queue_peak(),
+    };
+
+    bool changed = force || now - last_us >= (int64_t)MQTT_LINK_HEARTBEAT_S * 1000000 ||
+                   delta(h.heap_free, last.heap_free) >= MQTT_LINK_HEAP_STEP ||
+                   h.heap_min != last.heap_min || delta(h.rssi, last.rssi) >= MQTT_LINK_RSSI_STEP ||
+                   h.reconnects != last.reconnects || h.queue_peak != last.queue_peak;
+    if (!changed) {
+        return;
+    }
+
+    char topic[MQTT_LINK_TOPIC_LEN];
+    json_writer_t w;
+    snprintf(topic, sizeof(topic), "%s/health", base_topic);
+    json_writer_init(&w, NULL, msg, sizeof(msg));
+    json_begin_object(&w, NULL);
+    json_add_int(&w, "uptime_s", now / 1000000);
+    json_add_int(&w, "heap_free", h.heap_free);
+    json_add_int(&w, "heap_min", h.heap_min);
+    json_add_int(&w, "rssi", h.rssi);
+    json_add_int(&w, "wifi_reconnects", h.reconnects);
+    json_add_int(&w, "queue_peak", h.queue_peak);
+    json_add_string(&w, "version", esp_app_get_description()->version);
+    json_end_object(&w);
+    if (json_writer_finish(&w) == ESP_OK) {
+        publish(topic, msg, true);
+        last = h;
+        last_us = now;
+    }
+}
+
+// Wakes on the first event and waits CONFIG_FEEDER_MQTT_BATCH_MS for more,
+// so a burst (a batch feeding every hopper) costs one message
+static void link_task_fn(void *arg)
+{
+    while (true) {
+        bool woken = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CONFIG_FEEDER_MQTT_HEALTH_S * 1000)) != 0;
+        if (woken && CONFIG_FEEDER_MQTT_BATCH_MS > 0) {
+            vTaskDelay(pdMS_TO_TICKS(CONFIG_FEEDER_MQTT_BATCH_MS));
+            ulTaskNotifyTake(pdTRUE, 0);
+        }
+        if (!connected) {
+            continue;                       // Events stay queued until the broker is back
+        }
+
+        bool force = resend;
+        resend = false;
+        if (force) {
+            portENTER_CRITICAL(&pending_lock);
+            state_dirty = (1UL << actuator_hopper_count()) - 1;
+            portEXIT_CRITICAL(&pending_lock);
+        }
+        flush_events();
+        flush_state();
+        check_health(force);
+    }
+}
+
+// Commands are the /batch format, applied all or nothing; the outcome goes
+// to <base>/result
+static void handle_command(esp_mqtt_event_handle_t event)
+{
+    fleet_result_t result = { .error = "Command too long", .index = -1 };
+    char topic[MQTT_LINK_TOPIC_LEN];
+    char buf[128];
+    json_writer_t w;
+
+    if (event->data_len == event->total_data_len) {
+        fleet_run_batch(event->data, event->data_len, FEED_SOURCE_MQTT, &result);
+    } else if (event->current_data_offset > 0) {
+        return;                             // Rest of a command already refused
+    }
+    if (result.error != NULL) {
+        ESP_LOGW(TAG, "Command rejected: %s", result.error);
+    }
+
+    snprintf(topic, sizeof(topic), "%s/result", base_topic);
+    json_writer_init(&w, NULL, buf, sizeof(buf));
+    fleet_write_result(&w, &result);
+    if (json_writer_finish(&w) == ESP_OK) {
+        publish(topic, buf, false);
+    }
+}
+
+static void mqtt_event_handler(void *arg, esp_event_base_t base, int32_t event_id, void *event_data)
+{
+    esp_mqtt_event_handle_t event = event_data;
+
+    switch ((esp_mqtt_event_id_t)event_id) {
+    case MQTT_EVENT_CONNECTED:
+        ESP_LOGI(TAG, "Connected, publishing under %s", base_topic);
+        publish(status_topic, "online", true);
+        // At most once, so a redelivered command can never feed twice
+        esp_mqtt_client_subscribe(client, cmd_topic, 0);
+        esp_mqtt_client_subscribe(client, fleet_cmd_topic, 0);
+        connected = true;
+        resend = true;
+        xTaskNotifyGive(link_task);
+        break;
+    case MQTT_EVENT_DISCONNECTED:
+        ESP_LOGW(TAG, "Disconnected from broker");
+        connected = false;
+        break;
+    case MQTT_EVENT_DATA:
+        handle_command(event);
+        break;
+    default:
+        break;
+    }
+}
+
+esp_err_t mqtt_link_start(void)
+{
+    snprintf(base_topic, sizeof(base_topic), "%s/%s", CONFIG_FEEDER_MQTT_TOPIC_PREFIX, fleet_device_id());
+    snprintf(status_topic, sizeof(status_topic), "%s/status", base_topic);
+    snprintf(cmd_topic, sizeof(cmd_topic), "%s/cmd", base_topic);
+    snprintf(fleet_cmd_topic, sizeof(fleet_cmd_topic), "%s/all/cmd", CONFIG_FEEDER_MQTT_TOPIC_PREFIX);
+
+    const esp_mqtt_client_config_t config = {
+        .broker.address.uri = CONFIG_FEEDER_MQTT_BROKER_URI,
+        .credentials = {
+            .client_id = fleet_device_id(),
+            .username = CONFIG_FEEDER_MQTT_USERNAME[0] != '\0' ? CONFIG_FEEDER_MQTT_USERNAME : NULL,
+            .authentication.password = CONFIG_FEEDER_MQTT_PASSWORD[0] != '\0' ? CONFIG_FEEDER_MQTT_PASSWORD : NULL,
+        },
+        .session.last_will = {
+            .topic = status_topic,
+            .msg = "offline",
+            .qos = 0,
+            .retain = true,
+        },
+        .buffer.size = MQTT_LINK_BUFFER,
+    };
+
+    link_task = xTaskCreateStatic(link_task_fn, "mqtt_link", MQTT_LINK_STACK, NULL, MQTT_LINK_PRIORITY,
+                                  link_task_stack, &link_task_buffer);
+
+    client = esp_mqtt_client_init(&config);
+    if (client == NULL) {
+        return ESP_FAIL;
+    }
+    esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
+    return esp_mqtt_client_start(client);
+}
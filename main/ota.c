@@ -0,0 +1,363 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_ota_ops.h"
+#include "esp_app_desc.h"
+#include "esp_system.h"
+#include "esp_http_server.h"
+#include "esp32/rom/miniz.h"
+#include "json_writer.h"
+#include "config_store.h"
+#include "feeder.h"
+
+#define OTA_CHUNK           4096    // Bytes received per socket read
+#define OTA_RESTART_MS      500     // Lets the response reach the client first
+
+// Gzip header flags (RFC 1952)
+#define GZIP_FHCRC          0x02
+#define GZIP_FEXTRA         0x04
+#define GZIP_FNAME          0x08
+#define GZIP_FCOMMENT       0x10
+
+typedef enum {
+    OTA_IMAGE_RAW,
+    OTA_IMAGE_GZIP,
+    OTA_IMAGE_ZLIB,
+} ota_image_format_t;
+
+// One upload in progress. The inflater and its 32 KB window are only
+// allocated for compressed images.
+typedef struct {
+    esp_ota_handle_t handle;
+    ota_image_format_t format;
+    tinfl_decompressor *inflator;
+    uint8_t *window;
+    size_t window_pos;
+    bool inflate_done;
+    size_t written;
+} ota_upload_t;
+
+static const char *TAG = "ota";
+static esp_timer_handle_t verify_timer = NULL;
+static atomic_bool updating = false;
+static uint8_t chunk[OTA_CHUNK];            // Only used with updating set
+
+static void verify_timeout(void *arg)
+{
+    ESP_LOGE(TAG, "New firmware did not come up within %d s, rolling back", CONFIG_FEEDER_OTA_VERIFY_S);
+    esp_ota_mark_app_invalid_rollback_and_reboot();
+}
+
+esp_err_t ota_init(void)
+{
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    esp_ota_img_states_t state;
+
+    ESP_LOGI(TAG, "Running %s from %s", esp_app_get_description()->version, running->label);
+    if (esp_ota_get_state_partition(running, &state) != ESP_OK || state != ESP_OTA_IMG_PENDING_VERIFY) {
+        return ESP_OK;
+    }
+
+    // First boot of an update: the bootloader falls back to the previous
+    // image if this one is not confirmed in time or resets before that
+    const esp_timer_create_args_t args = {
+        .callback = verify_timeout,
+        .name = "ota_verify",
+    };
+    esp_err_t err = esp_timer_create(&args, &verify_timer);
+    if (err == ESP_OK) {
+        err = esp_timer_start_once(verify_timer, (uint64_t)CONFIG_FEEDER_OTA_VERIFY_S * 1000000);
+    }
+    ESP_LOGW(TAG, "Unconfirmed update, rollback in %d s unless the web server starts",
+             CONFIG_FEEDER_OTA_VERIFY_S);
+    return err;
+}
+
+void ota_confirm(void)
+{
+    if (verify_timer == NULL) {
+        return;
+    }
+
+    esp_timer_stop(verify_timer);
+    esp_timer_delete(verify_timer);
+    verify_timer = NULL;
+    if (esp_ota_mark_app_valid_cancel_rollback() == ESP_OK) {
+        ESP_LOGI(TAG, "Update confirmed");
+    }
+}
+
+// Length of the gzip header at the start of data, 0 if it is not complete
+static size_t gzip_header_len(const uint8_t *data, size_t len)
+{
+    if (len < 10 || data[2] != 8) {         // Deflate is the only method
+        return 0;
+    }
+
+    uint8_t flags = data[3];
+    size_t pos = 10;
+    if (flags & GZIP_FEXTRA) {
+        if (pos + 2 > len) {
+            return 0;
+        }
+        pos += 2 + (data[pos] | data[pos + 1] << 8);
+    }
+    for (uint8_t field = GZIP_FNAME; field <= GZIP_FCOMMENT; field <<= 1) {
+        if (flags & field) {
+            while (pos < len && data[pos] != 0) {
+                pos++;
+            }
+            pos++;
+        }
+    }
+    if (flags & GZIP_FHCRC) {
+        pos += 2;
+    }
+    return pos <= len ? pos : 0;
+}
+
+static esp_err_t write_image(ota_upload_t *u, const uint8_t *data, size_t len)
+{
+    esp_err_t err = esp_ota_write(u->handle, data, len);
+    if (err == ESP_OK) {
+        u->written += len;
+    }
+    return err;
+}
+
+// Decompress a piece of the upload into the window and write out whatever
+// it produced. The window wraps, so tinfl keeps the last 32 KB as history.
+static esp_err_t inflate_chunk(ota_upload_t *u, const uint8_t *data, size_t len, bool more)
+{
+    int flags = (u->format == OTA_IMAGE_ZLIB ? TINFL_FLAG_PARSE_ZLIB_HEADER : 0) |
+                (more ? TINFL_FLAG_HAS_MORE_INPUT : 0);
+
+    while (!u->inflate_done) {
+        size_t in_size = len;
+        size_t out_size = TINFL_LZ_DICT_SIZE - u->window_pos;
+        tinfl_status status = tinfl_decompress(u->inflator, data, &in_size, u->window,
+                                               u->window + u->window_pos, &out_size, flags);
+        data += in_size;
+        len -= in_size;
+
+        if (out_size > 0) {
+            esp_err_t err = write_image(u, u->window + u->window_pos, out_size);
+            if (err != ESP_OK) {
+                return err;
+            }
+            u->window_pos = (u->window_pos + out_size) & (TINFL_LZ_DICT_SIZE - 1);
+        }
+
+        if (status == TINFL_STATUS_DONE) {
+            u->inflate_done = true;
+        } else if (status < TINFL_STATUS_DONE) {
+            ESP_LOGE(TAG, "Corrupt compressed image (%d)", status);
+            return ESP_ERR_INVALID_RESPONSE;
+        } else if (status == TINFL_STATUS_NEEDS_MORE_INPUT && len == 0) {
+            break;
+        }
+    }
+    return ESP_OK;
+}
+
+// The first bytes tell the format: an app image starts with its magic byte,
+// gzip and zlib streams with their own headers
+static esp_err_t start_upload(ota_upload_t *u, const uint8_t **data, size_t *len)
+{
+    const uint8_t *p = *data;
+
+    if (p[0] == ESP_IMAGE_HEADER_MAGIC) {
+        u->format = OTA_IMAGE_RAW;
+        return ESP_OK;
+    } else if (*len >= 2 && p[0] == 0x1f && p[1] == 0x8b) {
+        size_t header = gzip_header_len(p, *len);
+        if (header == 0) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        u->format = OTA_IMAGE_GZIP;
+        *data += header;
+        *len -= header;
+    } else if (*len >= 2 && (p[0] & 0x0f) == 8 && ((p[0] << 8) | p[1]) % 31 == 0) {
+        u->format = OTA_IMAGE_ZLIB;
+    } else {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    u->inflator = malloc(sizeof(tinfl_decompressor));
+    u->window = malloc(TINFL_LZ_DICT_SIZE);
+    if (u->inflator == NULL || u->window == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    tinfl_init(u->inflator);
+    return ESP_OK;
+}
+
+// An image built for another project would boot, fail to confirm and roll
+// back; refuse it up front instead
+static esp_err_t check_image(const esp_partition_t *update)
+{
+    esp_app_desc_t desc;
+
+    esp_err_t err = esp_ota_get_partition_description(update, &desc);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (strncmp(desc.project_name, esp_app_get_description()->project_name, sizeof(desc.project_name)) != 0) {
+        ESP_LOGE(TAG, "Image is for project %.32s", desc.project_name);
+        return ESP_ERR_INVALID_VERSION;
+    }
+    ESP_LOGI(TAG, "Received %.32s", desc.version);
+    return ESP_OK;
+}
+
+static esp_err_t receive_image(httpd_req_t *req, ota_upload_t *u, const esp_partition_t *update)
+{
+    size_t remaining = req->content_len;
+    bool started = false;
+
+    while (remaining > 0) {
+        int ret = httpd_req_recv(req, (char *)chunk, MIN(remaining, sizeof(chunk)));
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+            continue;
+        } else if (ret <= 0) {
+            return ESP_FAIL;
+        }
+        remaining -= ret;
+
+        const uint8_t *data = chunk;
+        size_t len = ret;
+        esp_err_t err = ESP_OK;
+        if (!started) {
+            err = start_upload(u, &data, &len);
+            if (err == ESP_OK) {
+                err = esp_ota_begin(update, OTA_WITH_SEQUENTIAL_WRITES, &u->handle);
+            }
+            started = err == ESP_OK;
+        }
+        if (err == ESP_OK) {
+            err = u->format == OTA_IMAGE_RAW ? write_image(u, data, len)
+                                              : inflate_chunk(u, data, len, remaining > 0);
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    if (u->format != OTA_IMAGE_RAW && !u->inflate_done) {
+        ESP_LOGE(TAG, "Compressed image is truncated");
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_OK;
+}
+
+// Stream a firmware image into the inactive slot and boot it:
+// curl --data-binary @build/automatic_animal_feeder.bin.gz http://<feeder>/ota
+static esp_err_t ota_upload_handler(httpd_req_t *req)
+{
+    if (req->content_len == 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Expected a firmware image");
+        return ESP_FAIL;
+    }
+    if (atomic_exchange(&updating, true)) {
+        httpd_resp_set_status(req, "409 Conflict");
+        return httpd_resp_sendstr(req, "An update is already running");
+    }
+
+    const esp_partition_t *update = esp_ota_get_next_update_partition(NULL);
+    ota_upload_t u = { 0 };
+    int64_t start = esp_timer_get_time();
+
+    ESP_LOGI(TAG, "Receiving %u bytes into %s", (unsigned)req->content_len, update->label);
+    esp_err_t err = receive_image(req, &u, update);
+    free(u.inflator);
+    free(u.window);
+    if (u.handle != 0) {
+        if (err == ESP_OK) {
+            err = esp_ota_end(u.handle);
+        } else {
+            esp_ota_abort(u.handle);
+        }
+    }
+    if (err == ESP_OK) {
+        err = check_image(update);
+    }
+    if (err == ESP_OK) {
+        err = esp_ota_set_boot_partition(update);
+    }
+    atomic_store(&updating, false);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Update failed: %s", esp_err_to_name(err));
+        if (err == ESP_ERR_INVALID_ARG) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Not an app image, gzip or zlib stream");
+        } else if (err != ESP_FAIL) {   // ESP_FAIL: the connection is gone
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, esp_err_to_name(err));
+        }
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "%u bytes written in %d ms, restarting", (unsigned)u.written,
+             (int)((esp_timer_get_time() - start) / 1000));
+
+    char buf[96];
+    json_writer_t w;
+    json_writer_init(&w, req, buf, sizeof(buf));
+    json_begin_object(&w, NULL);
+    json_add_string(&w, "status", "restarting");
+    json_add_string(&w, "partition", update->label);
+    json_add_int(&w, "image_bytes", u.written);
+    json_add_int(&w, "upload_bytes", req->content_len);
+    json_end_object(&w);
+    json_writer_finish(&w);
+
+    config_store_flush();
+    vTaskDelay(pdMS_TO_TICKS(OTA_RESTART_MS));
+    esp_restart();
+    return ESP_OK;
+}
+
+// Running firmware and whether it still has to be confirmed
+static esp_err_t ota_status_handler(httpd_req_t *req)
+{
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    esp_ota_img_states_t state = ESP_OTA_IMG_UNDEFINED;
+    char buf[160];
+    json_writer_t w;
+
+    esp_ota_get_state_partition(running, &state);
+    json_writer_init(&w, req, buf, sizeof(buf));
+    json_begin_object(&w, NULL);
+    json_add_string(&w, "version", esp_app_get_description()->version);
+    json_add_string(&w, "partition", running->label);
+    json_add_bool(&w, "pending_verify", state == ESP_OTA_IMG_PENDING_VERIFY && verify_timer != NULL);
+    json_add_bool(&w, "updating", atomic_load(&updating));
+    json_end_object(&w);
+    return json_writer_finish(&w);
+}
+
+void ota_register(httpd_handle_t server)
+{
+    // Firmware upload URI handler
+    httpd_uri_t upload = {
+        .uri        = "/ota",
+        .method     = HTTP_POST,
+        .handler    = ota_upload_handler,
+        .user_ctx   = NULL
+    };
+
+    // Firmware status URI handler
+    httpd_uri_t status = {
+        .uri        = "/ota",
+        .method     = HTTP_GET,
+        .handler    = ota_status_handler,
+        .user_ctx   = NULL
+    };
+
+    feeder_register_slow_uri(server, &upload);
+    feeder_register_uri(server, &status);
+}
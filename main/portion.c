@@ -0,0 +1,225 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "trace.h"
+#include "esp_http_server.h"
+#include "json_writer.h"
+#include "actuator.h"
+#include "scale.h"
+#include "feeder.h"
+
+#define PORTION_RECENT_SAMPLES  16      // Newest readings listed on /weight
+
+static const char *TAG = "portion";
+
+// One weighed portion at a time - there is one scale under the bowl
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+static int active_hopper = -1;
+static int last_hopper = -1;
+static int32_t last_target_mg = 0;
+static int32_t last_mg = 0;
+
+// Per hopper, actuator task only: whether its last feed was weighed, and
+// how far short of the target it stopped
+static bool weighed[ACTUATOR_MAX_HOPPERS];
+static int32_t short_mg[ACTUATOR_MAX_HOPPERS];
+
+// Scale task: the target is on the scale, close the hopper now
+static void target_reached(int32_t gained_mg, void *arg)
+{
+    int hopper = (intptr_t)arg;
+
+    TRACE_LOGI(TAG, "Hopper %d reached %ld mg, closing", hopper, (long)gained_mg);
+    actuator_end_hold(hopper);
+}
+
+esp_err_t portion_feed(int hopper, uint32_t grams, feed_source_t source)
+{
+    if (grams == 0 || grams > INT32_MAX / 1000) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return portion_feed_mg(hopper, grams * 1000, source);
+}
+
+esp_err_t portion_feed_mg(int hopper, int32_t mg, feed_source_t source)
+{
+    if (mg <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!scale_ready()) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    bool busy;
+    portENTER_CRITICAL(&lock);
+    busy = active_hopper >= 0;
+    if (!busy) {
+        active_hopper = hopper;
+        last_target_mg = mg;
+    }
+    portEXIT_CRITICAL(&lock);
+    if (busy) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // The hold time is only a limit; the scale ends it at the target
+    esp_err_t err = scale_watch(mg, target_reached, (void *)(intptr_t)hopper);
+    if (err == ESP_OK) {
+        err = feeder_feed(hopper, CONFIG_FEEDER_SCALE_MAX_FEED_MS, source);
+        if (err != ESP_OK) {
+            scale_watch_stop();
+        }
+    }
+
+    if (err != ESP_OK) {
+        portENTER_CRITICAL(&lock);
+        active_hopper = -1;
+        portEXIT_CRITICAL(&lock);
+    }
+    return err;
+}
+
+int32_t portion_short_mg(int hopper)
+{
+    return weighed[hopper] ? short_mg[hopper] : -1;
+}
+
+void portion_actuator_event(int hopper, actuator_event_t event)
+{
+    if (event != ACTUATOR_EVENT_FEED && event != ACTUATOR_EVENT_RESET) {
+        return;
+    }
+
+    bool mine;
+    portENTER_CRITICAL(&lock);
+    mine = active_hopper == hopper;
+    portEXIT_CRITICAL(&lock);
+    if (event == ACTUATOR_EVENT_FEED) {
+        weighed[hopper] = mine;
+        return;
+    }
+    if (!mine) {
+        return;
+    }
+
+    int32_t mg = scale_watch_stop();
+    if (mg < last_target_mg) {
+        TRACE_LOGW(TAG, "Hopper %d gave %ld of %ld mg before the time limit - empty or jammed?", hopper,
+                   (long)mg, (long)last_target_mg);
+    } else {
+        TRACE_LOGI(TAG, "Hopper %d portion: %ld mg for a %ld mg target", hopper, (long)mg, (long)last_target_mg);
+    }
+
+    short_mg[hopper] = mg < last_target_mg ? last_target_mg - mg : 0;
+    portENTER_CRITICAL(&lock);
+    last_hopper = hopper;
+    last_mg = mg;
+    active_hopper = -1;
+    portEXIT_CRITICAL(&lock);
+
+#if CONFIG_FEEDER_EVENT_LOG
+    feed_log_set_portion(hopper, mg);
+#endif
+}
+
+// Current weight, calibration, the last portion and the newest readings
+static esp_err_t get_weight_handler(httpd_req_t *req)
+{
+    scale_sample_t recent[PORTION_RECENT_SAMPLES];
+    int count = scale_get_samples(recent, PORTION_RECENT_SAMPLES);
+
+    char buf[256];
+    json_writer_t w;
+    json_writer_init(&w, req, buf, sizeof(buf));
+    json_begin_object(&w, NULL);
+    json_add_bool(&w, "ready", scale_ready());
+    json_add_int(&w, "mg", scale_get_mg());
+    json_add_int(&w, "raw", scale_get_raw());
+    json_add_int(&w, "counts_per_kg", scale_get_counts_per_kg());
+    json_add_int(&w, "readings", scale_get_sample_count());
+
+    json_begin_object(&w, "portion");
+    json_add_bool(&w, "active", active_hopper >= 0);
+    json_add_int(&w, "hopper", active_hopper >= 0 ? active_hopper : last_hopper);
+    json_add_int(&w, "target_mg", last_target_mg);
+    json_add_int(&w, "mg", last_mg);
+    json_end_object(&w);
+
+    json_begin_array(&w, "recent_mg");
+    for (int i = 0; i < count; i++) {
+        json_add_int(&w, NULL, recent[i].mg);
+    }
+    json_end_array(&w);
+    json_end_object(&w);
+
+    return json_writer_finish(&w);
+}
+
+static esp_err_t send_result(httpd_req_t *req, esp_err_t err)
+{
+    if (err == ESP_ERR_INVALID_STATE) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_sendstr(req, "Scale not ready or reading unusable");
+        return ESP_OK;
+    }
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to save calibration");
+        return ESP_FAIL;
+    }
+    return get_weight_handler(req);
+}
+
+// Zero the scale with the empty bowl on it
+static esp_err_t tare_handler(httpd_req_t *req)
+{
+    return send_result(req, scale_tare());
+}
+
+// Calibrate with a known load placed after taring: /weight/calibrate?grams=500
+static esp_err_t calibrate_handler(httpd_req_t *req)
+{
+    uint32_t grams;
+    if (feeder_query_uint(req, "grams", &grams) != ESP_OK || grams == 0 || grams > INT32_MAX / 1000) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing or invalid grams");
+        return ESP_FAIL;
+    }
+    return send_result(req, scale_calibrate(grams * 1000));
+}
+
+esp_err_t portion_init(void)
+{
+    return scale_init(CONFIG_FEEDER_SCALE_DOUT_GPIO, CONFIG_FEEDER_SCALE_SCK_GPIO, FEEDER_CONTROL_CORE);
+}
+
+void portion_register(httpd_handle_t server)
+{
+    // Weight endpoint URI handlers
+    httpd_uri_t get_weight = {
+        .uri        = "/weight",
+        .method     = HTTP_GET,
+        .handler    = get_weight_handler,
+        .user_ctx   = NULL
+    };
+
+    httpd_uri_t tare = {
+        .uri        = "/weight/tare",
+        .method     = HTTP_POST,
+        .handler    = tare_handler,
+        .user_ctx   = NULL
+    };
+
+    httpd_uri_t calibrate = {
+        .uri        = "/weight/calibrate",
+        .method     = HTTP_POST,
+        .handler    = calibrate_handler,
+        .user_ctx   = NULL
+    };
+
+    feeder_register_uri(server, &get_weight);
+    feeder_register_uri(server, &tare);
+    feeder_register_uri(server, &calibrate);
+}
@@ -0,0 +1,58 @@
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "sdkconfig.h"
+#include "power.h"
+
+// Original handler of a wrapped URI
+typedef struct {
+    esp_err_t (*handler)(httpd_req_t *req);
+    void *user_ctx;
+} wrapped_uri_t;
+
+static const char *TAG = "power";
+static esp_pm_lock_handle_t http_lock = NULL;
+static wrapped_uri_t uris[POWER_MAX_URIS];
+static int uri_count = 0;
+
+static esp_err_t locked_handler(httpd_req_t *req)
+{
+    wrapped_uri_t *w = req->user_ctx;
+
+    esp_pm_lock_acquire(http_lock);
+    req->user_ctx = w->user_ctx;
+    esp_err_t err = w->handler(req);
+    esp_pm_lock_release(http_lock);
+    return err;
+}
+
+void power_wrap_uri(httpd_uri_t *uri)
+{
+    if (uri_count >= POWER_MAX_URIS) {
+        ESP_LOGW(TAG, "No slot left for %s, handled without a PM lock", uri->uri);
+        return;
+    }
+
+    wrapped_uri_t *w = &uris[uri_count++];
+    w->handler = uri->handler;
+    w->user_ctx = uri->user_ctx;
+    uri->handler = locked_handler;
+    uri->user_ctx = w;
+}
+
+esp_err_t power_init(void)
+{
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = CONFIG_XTAL_FREQ,
+        .light_sleep_enable = true,
+    };
+
+    esp_err_t err = esp_pm_configure(&pm_config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure power management: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    ESP_LOGI(TAG, "CPU %d-%d MHz, light sleep when idle", pm_config.min_freq_mhz, pm_config.max_freq_mhz);
+    return esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "http", &http_lock);
+}
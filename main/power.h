@@ -0,0 +1,14 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#define POWER_MAX_URIS      24
+
+// Turn on dynamic frequency scaling and automatic light sleep. Drivers that
+// need the chip awake take their own PM locks.
+esp_err_t power_init(void);
+
+// Route a URI handler through a lock that keeps the CPU at full speed while
+// a request is handled. Rewrites handler and user_ctx in place.
+void power_wrap_uri(httpd_uri_t *uri);
@@ -0,0 +1,297 @@
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_system.h"
+#include "esp_wifi_types.h"
+#include "esp_http_server.h"
+#include "driver/gpio.h"
+#include "network.h"
+#include "json_writer.h"
+#include "json_reader.h"
+#include "feeder.h"
+
+#define PROVISION_TRY_MS        20000   // Time allowed to join the chosen network
+#define PROVISION_RESTART_MS    3000    // Lets the page show success before the AP goes away
+#define PROVISION_STACK         4096
+#define PROVISION_PRIORITY      4
+#define PROVISION_MIN_PASSWORD  8       // WPA2 passphrase limits
+#define PROVISION_MAX_PASSWORD  63
+
+static const char *TAG = "provision";
+
+typedef enum {
+    PROVISION_IDLE,
+    PROVISION_CONNECTING,
+    PROVISION_FAILED,
+    PROVISION_CONNECTED,
+} provision_state_t;
+
+// The handlers only touch ssid/password while no attempt is running
+static volatile provision_state_t state = PROVISION_IDLE;
+static const char *failure = "";
+static char ssid[NETWORK_SSID_LEN];
+static char password[NETWORK_PASSWORD_LEN];
+static TaskHandle_t worker = NULL;
+
+typedef struct {
+    char ssid[NETWORK_SSID_LEN];
+    char password[NETWORK_PASSWORD_LEN];
+    bool has_ssid;
+    const char *error;
+} provision_request_t;
+
+static const char *failure_text(esp_err_t err, uint8_t reason)
+{
+    if (err == ESP_ERR_TIMEOUT) {
+        return "No IP address from the network";
+    }
+    switch (reason) {
+    case WIFI_REASON_NO_AP_FOUND:
+        return "Network not found";
+    case WIFI_REASON_AUTH_EXPIRE:
+    case WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT:
+    case WIFI_REASON_AUTH_FAIL:
+    case WIFI_REASON_HANDSHAKE_TIMEOUT:
+        return "Wrong password";
+    default:
+        return "Connection failed";
+    }
+}
+
+static void provision_task(void *arg)
+{
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        uint8_t reason = 0;
+        esp_err_t err = network_try_credentials(ssid, password, PROVISION_TRY_MS, &reason);
+        if (err == ESP_OK) {
+            state = PROVISION_CONNECTED;
+            ESP_LOGI(TAG, "Joined \"%s\", restarting into station mode", ssid);
+            vTaskDelay(pdMS_TO_TICKS(PROVISION_RESTART_MS));
+            esp_restart();
+        }
+        failure = failure_text(err, reason);
+        ESP_LOGW(TAG, "Cannot join \"%s\": %s (reason %d)", ssid, failure, reason);
+        state = PROVISION_FAILED;
+    }
+}
+
+static esp_err_t page_handler(httpd_req_t *req)
+{
+    return web_asset_send(req, &web_asset_provision);
+}
+
+static esp_err_t scan_handler(httpd_req_t *req)
+{
+    network_ap_info_t aps[NETWORK_SCAN_MAX];
+    int count = network_scan(aps, NETWORK_SCAN_MAX);
+
+    char buf[128];
+    json_writer_t w;
+    json_writer_init(&w, req, buf, sizeof(buf));
+    json_begin_array(&w, NULL);
+    for (int i = 0; i < count; i++) {
+        json_begin_object(&w, NULL);
+        json_add_string(&w, "ssid", aps[i].ssid);
+        json_add_int(&w, "rssi", aps[i].rssi);
+        json_add_bool(&w, "secure", aps[i].secure);
+        json_end_object(&w);
+    }
+    json_end_array(&w);
+    return json_writer_finish(&w);
+}
+
+// {"ssid":"home","password":"secret"}
+static esp_err_t request_event(const json_event_t *event, void *ctx)
+{
+    provision_request_t *request = ctx;
+
+    if (event->depth != 1 || event->key == NULL) {
+        return ESP_OK;
+    }
+    if (strcmp(event->key, "ssid") == 0 || strcmp(event->key, "password") == 0) {
+        if (event->type != JSON_EVENT_STRING) {
+            request->error = "ssid and password must be strings";
+            return ESP_ERR_INVALID_ARG;
+        }
+        bool is_ssid = event->key[0] == 's';
+        size_t len = strlen(event->str);
+        if (is_ssid && (len == 0 || len >= NETWORK_SSID_LEN)) {
+            request->error = "ssid must be 1 to 32 characters";
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (!is_ssid && len != 0 && (len < PROVISION_MIN_PASSWORD || len > PROVISION_MAX_PASSWORD)) {
+            request->error = "password must be empty or 8 to 63 characters";
+            return ESP_ERR_INVALID_ARG;
+        }
+        strcpy(is_ssid ? request->ssid : request->password, event->str);
+        request->has_ssid |= is_ssid;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t provision_handler(httpd_req_t *req)
+{
+    provision_request_t request = { 0 };
+    json_reader_t reader;
+
+    json_reader_init(&reader, request_event, &request);
+    esp_err_t err = json_reader_parse_request(&reader, req);
+    if (err == ESP_ERR_TIMEOUT) {
+        httpd_resp_send_408(req);
+        return ESP_FAIL;
+    } else if (err == ESP_FAIL) {
+        return ESP_FAIL;                // Connection lost
+    } else if (err != ESP_OK || !request.has_ssid) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST,
+                            request.error != NULL ? request.error : "Expected {\"ssid\":...,\"password\":...}");
+        return ESP_FAIL;
+    }
+
+    if (state == PROVISION_CONNECTING || state == PROVISION_CONNECTED) {
+        httpd_resp_set_status(req, "409 Conflict");
+        httpd_resp_send(req, "Already connecting", HTTPD_RESP_USE_STRLEN);
+        return ESP_OK;
+    }
+    strcpy(ssid, request.ssid);
+    strcpy(password, request.password);
+    state = PROVISION_CONNECTING;
+    xTaskNotifyGive(worker);
+
+    httpd_resp_set_status(req, "202 Accepted");
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, "{\"state\":\"connecting\"}", HTTPD_RESP_USE_STRLEN);
+}
+
+static esp_err_t status_handler(httpd_req_t *req)
+{
+    static const char *names[] = { "idle", "connecting", "failed", "connected" };
+    provision_state_t now = state;
+
+    char buf[128];
+    json_writer_t w;
+    json_writer_init(&w, req, buf, sizeof(buf));
+    json_begin_object(&w, NULL);
+    json_add_string(&w, "state", names[now]);
+    if (now == PROVISION_FAILED) {
+        json_add_string(&w, "error", failure);
+    }
+    if (now != PROVISION_IDLE) {
+        json_add_string(&w, "ssid", ssid);
+    }
+    json_end_object(&w);
+    return json_writer_finish(&w);
+}
+
+// Every unknown URL, including the phones' connectivity checks, leads to the
+// setup page; that is what makes them offer to open it
+static esp_err_t redirect_handler(httpd_req_t *req, httpd_err_code_t error)
+{
+    httpd_resp_set_status(req, "302 Found");
+    httpd_resp_set_hdr(req, "Location", "/");
+    return httpd_resp_send(req, NULL, 0);
+}
+
+static bool button_held(void)
+{
+#if CONFIG_FEEDER_PROVISION_BUTTON_GPIO >= 0
+    gpio_config_t io = {
+        .pin_bit_mask = 1ULL << CONFIG_FEEDER_PROVISION_BUTTON_GPIO,
+        .mode         = GPIO_MODE_INPUT,
+        .pull_up_en   = GPIO_PULLUP_ENABLE,
+    };
+    gpio_config(&io);
+    vTaskDelay(pdMS_TO_TICKS(10));
+    bool held = gpio_get_level(CONFIG_FEEDER_PROVISION_BUTTON_GPIO) == 0;
+    gpio_reset_pin(CONFIG_FEEDER_PROVISION_BUTTON_GPIO);
+    return held;
+#else
+    return false;
+#endif
+}
+
+bool provision_load(char *ssid_out, char *password_out)
+{
+    if (button_held()) {
+        ESP_LOGI(TAG, "Setup button held, starting the setup portal");
+        return false;
+    }
+    if (network_load_credentials(ssid_out, password_out) == ESP_OK) {
+        return true;
+    }
+    // Images built with credentials keep working, e.g. after an OTA update
+    // onto a unit that was never provisioned
+    if (strlen(CONFIG_FEEDER_WIFI_SSID) > 0) {
+        strlcpy(ssid_out, CONFIG_FEEDER_WIFI_SSID, NETWORK_SSID_LEN);
+        strlcpy(password_out, CONFIG_FEEDER_WIFI_PASSWORD, NETWORK_PASSWORD_LEN);
+        return true;
+    }
+    return false;
+}
+
+esp_err_t provision_start_portal(void)
+{
+    uint8_t mac[6];
+    char ap_ssid[NETWORK_SSID_LEN];
+
+    esp_read_mac(mac, ESP_MAC_WIFI_SOFTAP);
+    snprintf(ap_ssid, sizeof(ap_ssid), "%s-%02x%02x%02x", CONFIG_FEEDER_PROVISION_AP_SSID, mac[3], mac[4], mac[5]);
+    esp_err_t err = network_start_provisioning(ap_ssid, CONFIG_FEEDER_PROVISION_AP_PASSWORD);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (xTaskCreate(provision_task, "provision", PROVISION_STACK, NULL, PROVISION_PRIORITY, &worker) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    // A server of its own: the dashboard's handlers need a joined network
+    httpd_handle_t server = NULL;
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.max_uri_handlers = 4;
+    config.lru_purge_enable = true;
+    err = httpd_start(&server, &config);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    httpd_uri_t page_uri = {
+        .uri       = "/",
+        .method    = HTTP_GET,
+        .handler   = page_handler,
+        .user_ctx  = NULL
+    };
+    httpd_register_uri_handler(server, &page_uri);
+
+    httpd_uri_t scan_uri = {
+        .uri       = "/scan",
+        .method    = HTTP_GET,
+        .handler   = scan_handler,
+        .user_ctx  = NULL
+    };
+    httpd_register_uri_handler(server, &scan_uri);
+
+    httpd_uri_t provision_uri = {
+        .uri       = "/provision",
+        .method    = HTTP_POST,
+        .handler   = provision_handler,
+        .user_ctx  = NULL
+    };
+    httpd_register_uri_handler(server, &provision_uri);
+
+    httpd_uri_t status_uri = {
+        .uri       = "/provision/status",
+        .method    = HTTP_GET,
+        .handler   = status_handler,
+        .user_ctx  = NULL
+    };
+    httpd_register_uri_handler(server, &status_uri);
+
+    httpd_register_err_handler(server, HTTPD_404_NOT_FOUND, redirect_handler);
+
+    ESP_LOGI(TAG, "Join \"%s\" to set up WiFi", ap_ssid);
+    return ESP_OK;
+}
@@ -0,0 +1,373 @@
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_http_server.h"
+#include "web_assets.h"
+#include "ws_push.h"
+#include "json_writer.h"
+#include "json_reader.h"
+#include "actuator.h"
+#include "servo_cal.h"
+#include "config_store.h"
+#include "feeder.h"
+
+// Slider range of the tuning page, exact for SERVO_RESOLUTION
+#define PWM_MIN_VALUE           SERVO_US_TO_DUTY(500)   // Min PWM value (~0 degrees)
+#define PWM_MAX_VALUE           SERVO_US_TO_DUTY(2500)  // Max PWM value (~180 degrees)
+
+static const char *TAG = "pwm_tuning";
+
+// Set servo position - queued on the actuator task, refused during a feed
+static esp_err_t set_servo_position(int hopper, uint32_t duty)
+{
+    esp_err_t err = actuator_move(hopper, duty);
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Hopper %d position set to PWM value: %lu", hopper, (unsigned long)duty);
+    }
+    return err;
+}
+
+// One settings update, collected from the JSON body without building a tree
+typedef struct {
+    int hopper;
+    char position[12];
+    char profile[CONFIG_STORE_PROFILE_LEN];
+    bool has_pwm, has_angle, has_delay, has_ramp, has_trim;
+    uint32_t pwm;
+    uint32_t angle;
+    uint32_t delay;
+    uint32_t ramp;
+    servo_trim_t trim;                  // Starts from the stored trim
+} pwm_update_t;
+
+static uint32_t to_u32(double v)
+{
+    return v <= 0 ? 0 : v >= UINT32_MAX ? UINT32_MAX : (uint32_t)v;
+}
+
+static void pwm_update_init(pwm_update_t *u)
+{
+    memset(u, 0, sizeof(*u));
+    u->trim = *servo_cal_get_trim();
+}
+
+// Pick the known keys out of an update object that starts at base_depth
+static void pwm_update_add(pwm_update_t *u, const json_event_t *ev, int base_depth)
+{
+    if (ev->key == NULL) {
+        return;
+    }
+
+    if (ev->depth == base_depth + 1) {
+        if (ev->type == JSON_EVENT_NUMBER) {
+            if (strcmp(ev->key, "hopper") == 0) {
+                u->hopper = ev->number >= 0 && ev->number < ACTUATOR_MAX_HOPPERS ? (int)ev->number : -1;
+            } else if (strcmp(ev->key, "pwm") == 0) {
+                u->has_pwm = true;
+                u->pwm = to_u32(ev->number);
+            } else if (strcmp(ev->key, "angle") == 0) {
+                u->has_angle = true;
+                u->angle = to_u32(ev->number);
+            } else if (strcmp(ev->key, "delay") == 0) {
+                u->has_delay = true;
+                u->delay = to_u32(ev->number);
+            } else if (strcmp(ev->key, "ramp") == 0) {
+                u->has_ramp = true;
+                u->ramp = to_u32(ev->number);
+            }
+        } else if (ev->type == JSON_EVENT_STRING) {
+            if (strcmp(ev->key, "position") == 0) {
+                snprintf(u->position, sizeof(u->position), "%s", ev->str);
+            } else if (strcmp(ev->key, "profile") == 0) {
+                snprintf(u->profile, sizeof(u->profile), "%s", ev->str);
+            }
+        } else if (ev->type == JSON_EVENT_OBJECT_START && strcmp(ev->key, "trim") == 0) {
+            u->has_trim = true;
+        }
+    } else if (ev->depth == base_depth + 2 && ev->type == JSON_EVENT_NUMBER &&
+               ev->parent != NULL && strcmp(ev->parent, "trim") == 0) {
+        // Per-device trim: {"trim": {"offset": -6, "span": 980, ...}}
+        if (strcmp(ev->key, "offset") == 0) {
+            u->trim.offset = (int16_t)ev->number;
+        } else if (strcmp(ev->key, "span") == 0) {
+            u->trim.span_permille = (uint16_t)ev->number;
+        } else if (strcmp(ev->key, "min_angle") == 0) {
+            u->trim.min_angle = (uint8_t)ev->number;
+        } else if (strcmp(ev->key, "max_angle") == 0) {
+            u->trim.max_angle = (uint8_t)ev->number;
+        }
+    }
+}
+
+// Apply a pwm/position/delay/motion update shared by /set_pwm and the /ws channel
+static esp_err_t apply_pwm_settings(const pwm_update_t *u, char *resp, size_t resp_size)
+{
+    feeder_config_t cfg = *config_store_get();
+    esp_err_t err = ESP_OK;
+
+    if (u->hopper < 0 || u->hopper >= actuator_hopper_count()) {
+        snprintf(resp, resp_size, "Unknown hopper");
+        return ESP_FAIL;
+    }
+    hopper_config_t *hc = &cfg.hoppers[u->hopper];
+
+    if (!u->has_pwm && !u->has_angle && (u->has_ramp || u->profile[0] != '\0' || u->has_trim)) {
+        // Motion or calibration only update
+        snprintf(resp, resp_size, "Settings updated");
+    } else if (u->has_pwm || u->has_angle) {
+        // A raw duty wins over an angle, which goes through the calibration table
+        uint32_t pwm_value = u->has_pwm ? u->pwm : servo_angle_to_duty(u->angle);
+
+        // Check if this is for default or feed position
+        if (u->position[0] != '\0') {
+            if (strcmp(u->position, "default") == 0) {
+                hc->default_pwm = pwm_value;
+                actuator_set_rest_duty(u->hopper, hc->default_pwm);
+                // During a feed the servo picks up the new default on its way back
+                set_servo_position(u->hopper, hc->default_pwm);
+                snprintf(resp, resp_size, "Default position set to PWM: %lu", (unsigned long)hc->default_pwm);
+            } else if (strcmp(u->position, "feed") == 0) {
+                hc->feed_pwm = pwm_value;
+                snprintf(resp, resp_size, "Feed position set to PWM: %lu", (unsigned long)hc->feed_pwm);
+            } else if (strcmp(u->position, "current") == 0) {
+                err = set_servo_position(u->hopper, pwm_value);
+                snprintf(resp, resp_size, err == ESP_OK ? "Current position set to PWM: %lu"
+                                                        : "Busy: feed in progress, PWM %lu not applied",
+                         (unsigned long)pwm_value);
+            } else {
+                snprintf(resp, resp_size, "Unknown position type: %s", u->position);
+                err = ESP_FAIL;
+            }
+        } else {
+            // If no position type specified, update current position
+            err = set_servo_position(u->hopper, pwm_value);
+            snprintf(resp, resp_size, err == ESP_OK ? "Current position set to PWM: %lu"
+                                                    : "Busy: feed in progress, PWM %lu not applied",
+                     (unsigned long)pwm_value);
+        }
+    } else {
+        snprintf(resp, resp_size, "Missing or invalid PWM value");
+        err = ESP_FAIL;
+    }
+
+    // Check if delay value was provided
+    if (u->has_delay) {
+        hc->reset_delay_ms = u->delay;
+        char delay_msg[50];
+        snprintf(delay_msg, sizeof(delay_msg), ", reset delay set to %lu ms", (unsigned long)hc->reset_delay_ms);
+        strncat(resp, delay_msg, resp_size - strlen(resp) - 1);
+    }
+
+    // Ramp time and feed profile for the motion engine
+    if (u->has_ramp || u->profile[0] != '\0') {
+        const motion_profile_t *profile = NULL;
+        uint32_t ramp_ms = u->has_ramp ? u->ramp : hc->ramp_ms;
+
+        if (u->profile[0] != '\0') {
+            profile = motion_find_profile(u->profile);
+            if (profile == NULL) {
+                snprintf(resp, resp_size, "Unknown motion profile: %s", u->profile);
+                return ESP_FAIL;
+            }
+        }
+        actuator_set_motion(u->hopper, profile, ramp_ms, MOTION_EASE_IN_OUT);
+        hc->ramp_ms = ramp_ms;
+        snprintf(hc->profile, sizeof(hc->profile), "%s", actuator_get_profile(u->hopper)->name);
+
+        char motion_msg[50];
+        snprintf(motion_msg, sizeof(motion_msg), ", %s profile with %lu ms ramp",
+                 actuator_get_profile(u->hopper)->name, (unsigned long)ramp_ms);
+        strncat(resp, motion_msg, resp_size - strlen(resp) - 1);
+    }
+
+    // Per-device trim, stored in NVS
+    if (u->has_trim) {
+        if (servo_cal_set_trim(&u->trim) != ESP_OK) {
+            snprintf(resp, resp_size, "Invalid servo trim");
+            return ESP_FAIL;
+        }
+        strncat(resp, ", trim saved", resp_size - strlen(resp) - 1);
+    }
+
+    // Saved in the background once the sliders stop moving
+    config_store_set(&cfg);
+    return err;
+}
+
+// A /set_pwm body: one update object, or an array of them applied in order
+typedef struct {
+    pwm_update_t update;
+    int base_depth;                     // Depth of the update objects
+    int applied;
+    int failed;
+    int hopper;                         // Of the last update, reported back
+    char resp[160];                     // Message of the last update
+    char first_error[160];
+} pwm_batch_t;
+
+static esp_err_t pwm_batch_event(const json_event_t *ev, void *ctx)
+{
+    pwm_batch_t *b = ctx;
+
+    if (ev->depth == 0 && ev->type == JSON_EVENT_ARRAY_START) {
+        b->base_depth = 1;
+    } else if (ev->depth == b->base_depth && ev->type == JSON_EVENT_OBJECT_START) {
+        pwm_update_init(&b->update);
+    } else if (ev->depth == b->base_depth && ev->type == JSON_EVENT_OBJECT_END) {
+        // Applied as soon as it is complete, while the rest is still arriving
+        if (b->update.hopper >= 0) {
+            b->hopper = b->update.hopper;
+        }
+        if (apply_pwm_settings(&b->update, b->resp, sizeof(b->resp)) == ESP_OK) {
+            b->applied++;
+        } else if (b->failed++ == 0) {
+            snprintf(b->first_error, sizeof(b->first_error), "Update %d: %s", b->applied + b->failed, b->resp);
+        }
+    } else if (ev->depth > b->base_depth) {
+        pwm_update_add(&b->update, ev, b->base_depth);
+    }
+    return ESP_OK;
+}
+
+// Set PWM value handler
+static esp_err_t set_pwm_handler(httpd_req_t *req)
+{
+    pwm_batch_t batch = { 0 };
+    json_reader_t reader;
+
+    json_reader_init(&reader, pwm_batch_event, &batch);
+    esp_err_t err = json_reader_parse_request(&reader, req);
+    if (batch.applied + batch.failed > 0) {
+        feeder_push_state(batch.hopper, "settings");
+    }
+
+    if (err == ESP_ERR_TIMEOUT) {
+        httpd_resp_send_408(req);
+        return ESP_FAIL;
+    } else if (err == ESP_FAIL) {
+        return ESP_FAIL;                // Connection lost
+    } else if (err != ESP_OK || batch.applied + batch.failed == 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
+        return ESP_FAIL;
+    }
+
+    const char *message = batch.resp;
+    char summary[200];
+    if (batch.base_depth > 0) {
+        snprintf(summary, sizeof(summary), "%d of %d updates applied%s%s", batch.applied,
+                 batch.applied + batch.failed, batch.failed > 0 ? "; " : "", batch.first_error);
+        message = summary;
+    }
+
+    char buf[256];
+    json_writer_t w;
+    json_writer_init(&w, req, buf, sizeof(buf));
+    json_begin_object(&w, NULL);
+    json_add_string(&w, "message", message);
+    if (batch.base_depth > 0) {
+        json_add_int(&w, "applied", batch.applied);
+        json_add_int(&w, "failed", batch.failed);
+    }
+    feeder_write_settings(&w, batch.hopper);
+    json_end_object(&w);
+    json_writer_finish(&w);
+
+    return batch.failed == 0 ? ESP_OK : ESP_FAIL;
+}
+
+// Get current settings handler
+static esp_err_t get_settings_handler(httpd_req_t *req)
+{
+    int hopper;
+    if (!feeder_request_hopper(req, &hopper)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown hopper");
+        return ESP_FAIL;
+    }
+
+    char buf[256];
+    json_writer_t w;
+    json_writer_init(&w, req, buf, sizeof(buf));
+    json_begin_object(&w, NULL);
+    json_add_int(&w, "hopper", hopper);
+    json_add_int(&w, "hoppers", actuator_hopper_count());
+    feeder_write_settings(&w, hopper);
+    json_add_int(&w, "trim_offset", servo_cal_get_trim()->offset);
+    json_add_int(&w, "trim_span", servo_cal_get_trim()->span_permille);
+    json_add_int(&w, "min_pwm", PWM_MIN_VALUE);
+    json_add_int(&w, "max_pwm", PWM_MAX_VALUE);
+    json_end_object(&w);
+
+    return json_writer_finish(&w);
+}
+
+static esp_err_t ws_update_event(const json_event_t *ev, void *ctx)
+{
+    pwm_update_add(ctx, ev, 0);
+    return ESP_OK;
+}
+
+// WebSocket commands of the tuning page
+bool pwm_tuning_ws_command(httpd_req_t *req, const char *cmd, const char *payload, size_t len)
+{
+    if (strcmp(cmd, "set_pwm") != 0) {
+        return false;
+    }
+
+    pwm_update_t update;
+    json_reader_t reader;
+    char msg[192];
+
+    pwm_update_init(&update);
+    json_reader_init(&reader, ws_update_event, &update);
+    json_reader_feed(&reader, payload, len);    // Already validated by the caller
+
+    if (apply_pwm_settings(&update, msg, sizeof(msg)) != ESP_OK) {
+        char resp[256];
+        json_writer_t w;
+        json_writer_init(&w, NULL, resp, sizeof(resp));
+        json_begin_object(&w, NULL);
+        json_add_string(&w, "error", msg);
+        json_end_object(&w);
+        json_writer_finish(&w);
+        ws_push_reply(req, resp);
+    }
+    feeder_push_state(update.hopper >= 0 ? update.hopper : 0, "settings");
+    return true;
+}
+
+// HTTP GET handler serving the tuning page
+static esp_err_t tuning_page_handler(httpd_req_t *req)
+{
+    return web_asset_send(req, &web_asset_pwm_tuning);
+}
+
+void pwm_tuning_register(httpd_handle_t server)
+{
+    httpd_uri_t tuning_page = {
+        .uri        = "/tuning",
+        .method     = HTTP_GET,
+        .handler    = tuning_page_handler,
+        .user_ctx   = NULL
+    };
+
+    // Set PWM endpoint URI handler
+    httpd_uri_t set_pwm = {
+        .uri        = "/set_pwm",
+        .method     = HTTP_POST,
+        .handler    = set_pwm_handler,
+        .user_ctx   = NULL
+    };
+
+    // Get settings endpoint URI handler
+    httpd_uri_t get_settings = {
+        .uri        = "/settings",
+        .method     = HTTP_GET,
+        .handler    = get_settings_handler,
+        .user_ctx   = NULL
+    };
+
+    feeder_register_slow_uri(server, &tuning_page);
+    feeder_register_uri(server, &set_pwm);
+    feeder_register_uri(server, &get_settings);
+    ESP_LOGI(TAG, "PWM tuning enabled at /tuning");
+}
@@ -0,0 +1,182 @@
+#include <string.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_http_server.h"
+#include "json_writer.h"
+#include "http_arena.h"
+#include "feeder.h"
+
+#define TASK_STATS_MAX_TASKS    32      // Counters remembered between requests
+#define TASK_STATS_SPARE        4       // Room for tasks created while the list is taken
+#define TASK_STATS_TEXT_LINE    40      // Per task in the vTaskGetRunTimeStats table
+
+typedef struct {
+    UBaseType_t number;
+    configRUN_TIME_COUNTER_TYPE runtime;
+} task_sample_t;
+
+typedef struct {
+    const TaskStatus_t *task;
+    uint32_t runtime_us;        // Spent running in the window
+} task_row_t;
+
+// Counters at the previous request; each request reports the time since
+// then, the first one the time since boot. The 32-bit counters wrap after
+// 71 minutes, so windows longer than that come out wrong.
+static task_sample_t previous[TASK_STATS_MAX_TASKS];
+static int previous_count = 0;
+static configRUN_TIME_COUNTER_TYPE previous_total = 0;
+static SemaphoreHandle_t sample_lock = NULL;
+static StaticSemaphore_t sample_lock_buffer;
+
+static const char *state_name(eTaskState state)
+{
+    switch (state) {
+    case eRunning:
+        return "running";
+    case eReady:
+        return "ready";
+    case eBlocked:
+        return "blocked";
+    case eSuspended:
+        return "suspended";
+    default:
+        return "deleted";
+    }
+}
+
+static configRUN_TIME_COUNTER_TYPE previous_runtime(UBaseType_t number)
+{
+    for (int i = 0; i < previous_count; i++) {
+        if (previous[i].number == number) {
+            return previous[i].runtime;
+        }
+    }
+    return 0;                   // Created during the window, its counter started at zero
+}
+
+// Turn the counters of a fresh task list into time spent since the previous
+// request, busiest task first, and remember them for the next one
+static uint32_t sample(const TaskStatus_t *status, int count, configRUN_TIME_COUNTER_TYPE total,
+                       task_row_t *rows)
+{
+    xSemaphoreTake(sample_lock, portMAX_DELAY);
+    for (int i = 0; i < count; i++) {
+        task_row_t row = { &status[i], status[i].ulRunTimeCounter - previous_runtime(status[i].xTaskNumber) };
+        int j = i;
+        for (; j > 0 && rows[j - 1].runtime_us < row.runtime_us; j--) {
+            rows[j] = rows[j - 1];
+        }
+        rows[j] = row;
+    }
+
+    previous_count = MIN(count, TASK_STATS_MAX_TASKS);
+    for (int i = 0; i < previous_count; i++) {
+        previous[i] = (task_sample_t) { status[i].xTaskNumber, status[i].ulRunTimeCounter };
+    }
+    uint32_t window = total - previous_total;
+    previous_total = total;
+    xSemaphoreGive(sample_lock);
+    return window;
+}
+
+static int percent(uint32_t part, uint32_t whole)
+{
+    return whole > 0 ? (int)(((uint64_t)part * 100 + whole / 2) / whole) : 0;
+}
+
+// FreeRTOS' own table of run time since boot, for ?format=text
+static esp_err_t send_text(httpd_req_t *req)
+{
+    size_t size = (uxTaskGetNumberOfTasks() + TASK_STATS_SPARE) * TASK_STATS_TEXT_LINE;
+    char *table = http_arena_alloc(size);
+    if (table == NULL) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Too many tasks");
+        return ESP_FAIL;
+    }
+    vTaskGetRunTimeStats(table);
+    httpd_resp_set_type(req, "text/plain");
+    return httpd_resp_send(req, table, HTTPD_RESP_USE_STRLEN);
+}
+
+// Every task with its core (-1 when not pinned), priority, free stack in
+// bytes and share of CPU time since the previous request, and the load of
+// each core, which is whatever its idle task did not get
+static esp_err_t tasks_handler(httpd_req_t *req)
+{
+    char query[32];
+    char format[8];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "format", format, sizeof(format)) == ESP_OK &&
+        strcmp(format, "text") == 0) {
+        return send_text(req);
+    }
+
+    int capacity = uxTaskGetNumberOfTasks() + TASK_STATS_SPARE;
+    TaskStatus_t *status = http_arena_alloc(capacity * sizeof(TaskStatus_t));
+    task_row_t *rows = http_arena_alloc(capacity * sizeof(task_row_t));
+    if (status == NULL || rows == NULL) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Too many tasks");
+        return ESP_FAIL;
+    }
+    configRUN_TIME_COUNTER_TYPE total;
+    int count = uxTaskGetSystemState(status, capacity, &total);
+    uint32_t window = sample(status, count, total, rows);
+
+    char buf[256];
+    json_writer_t w;
+    json_writer_init(&w, req, buf, sizeof(buf));
+    json_begin_object(&w, NULL);
+    json_add_int(&w, "window_ms", window / 1000);
+
+    json_begin_array(&w, "cores");
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        TaskHandle_t idle = xTaskGetIdleTaskHandleForCPU(core);
+        uint32_t idle_us = 0;
+        for (int i = 0; i < count; i++) {
+            if (rows[i].task->xHandle == idle) {
+                idle_us = rows[i].runtime_us;
+            }
+        }
+        json_begin_object(&w, NULL);
+        json_add_int(&w, "core", core);
+        json_add_int(&w, "load_pct", window > 0 ? 100 - percent(MIN(idle_us, window), window) : 0);
+        json_end_object(&w);
+    }
+    json_end_array(&w);
+
+    json_begin_array(&w, "tasks");
+    for (int i = 0; i < count; i++) {
+        const TaskStatus_t *t = rows[i].task;
+        json_begin_object(&w, NULL);
+        json_add_string(&w, "name", t->pcTaskName);
+        json_add_int(&w, "core", t->xCoreID == tskNO_AFFINITY ? -1 : t->xCoreID);
+        json_add_int(&w, "priority", t->uxCurrentPriority);
+        json_add_string(&w, "state", state_name(t->eCurrentState));
+        json_add_int(&w, "stack_free", t->usStackHighWaterMark);
+        json_add_int(&w, "runtime_us", rows[i].runtime_us);
+        json_add_int(&w, "cpu_pct", percent(rows[i].runtime_us, window));
+        json_end_object(&w);
+    }
+    json_end_array(&w);
+    json_end_object(&w);
+
+    return json_writer_finish(&w);
+}
+
+void task_stats_register(httpd_handle_t server)
+{
+    sample_lock = xSemaphoreCreateMutexStatic(&sample_lock_buffer);
+
+    // Per-task CPU load URI handler
+    httpd_uri_t tasks = {
+        .uri        = "/tasks",
+        .method     = HTTP_GET,
+        .handler    = tasks_handler,
+        .user_ctx   = NULL
+    };
+
+    feeder_register_slow_uri(server, &tasks);
+}
@@ -0,0 +1,68 @@
+#include <stdio.h>
+#include <sys/param.h>
+#include "esp_http_server.h"
+#include "http_arena.h"
+#include "trace.h"
+#include "feeder.h"
+
+#define TRACE_LOG_BATCH     8       // Records formatted per chunk
+#define TRACE_LOG_LINE_LEN  (TRACE_LINE_LEN + 48)
+
+// Trace records the task has printed, one line each: seq, milliseconds
+// since boot, level, tag and message. ?since=N leaves out the older ones,
+// so a client polling with the seq after its last line sees each once.
+static esp_err_t trace_handler(httpd_req_t *req)
+{
+    uint32_t since = 0;
+    if (feeder_query_uint(req, "since", &since) == ESP_ERR_INVALID_ARG) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid since");
+        return ESP_FAIL;
+    }
+
+    trace_record_t *records = http_arena_alloc(TRACE_LOG_BATCH * sizeof(trace_record_t));
+    size_t size = TRACE_LOG_BATCH * TRACE_LOG_LINE_LEN;
+    char *chunk = http_arena_alloc(size);
+    if (records == NULL || chunk == NULL) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "No room for the response");
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "text/plain");
+    esp_err_t err = ESP_OK;
+    int count;
+    while (err == ESP_OK && (count = trace_read(since, records, TRACE_LOG_BATCH)) > 0) {
+        size_t len = 0;
+        for (int i = 0; i < count; i++) {
+            const trace_record_t *r = &records[i];
+            char *line = chunk + len;
+            int n = snprintf(line, TRACE_LOG_LINE_LEN, "%lu %lu %c %s: ", (unsigned long)r->seq,
+                             (unsigned long)(r->time_us / 1000), trace_level_char(r->event->level), r->tag);
+            if (n < TRACE_LOG_LINE_LEN - 1) {
+                n += trace_format(r, line + n, TRACE_LOG_LINE_LEN - n);
+            }
+            n = MIN(n, TRACE_LOG_LINE_LEN - 1);     // Cut short, still one line
+            line[n] = '\n';
+            len += n + 1;
+        }
+        since = records[count - 1].seq + 1;
+        err = httpd_resp_send_chunk(req, chunk, len);
+    }
+
+    if (err != ESP_OK) {
+        return err;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+void trace_log_register(httpd_handle_t server)
+{
+    // Deferred log URI handler
+    httpd_uri_t trace = {
+        .uri        = "/trace",
+        .method     = HTTP_GET,
+        .handler    = trace_handler,
+        .user_ctx   = NULL
+    };
+
+    feeder_register_slow_uri(server, &trace);
+}
@@ -0,0 +1,51 @@
+#!/usr/bin/env python3
+# Compress a static web asset at build time and emit it as a C source file.
+#
+# The output defines a `web_asset_t` (see web_assets.h) holding the gzip
+# bytes, their exact length and a strong ETag derived from the content, so
+# the firmware never has to strlen() or compress anything at runtime.
+#
+# Usage: gen_asset.py <symbol> <content-type> <input> <output.c>
+
+import gzip
+import hashlib
+import sys
+
+
+def main():
+    if len(sys.argv) != 5:
+        sys.stderr.write('usage: gen_asset.py <symbol> <content-type> <input> <output.c>\n')
+        return 1
+
+    symbol, content_type, src, dst = sys.argv[1:]
+
+    with open(src, 'rb') as f:
+        raw = f.read()
+
+    # mtime=0 keeps the output (and therefore the ETag) reproducible
+    packed = gzip.compress(raw, compresslevel=9, mtime=0)
+    etag = '"' + hashlib.sha1(packed).hexdigest()[:16] + '"'
+
+    lines = []
+    for i in range(0, len(packed), 16):
+        lines.append('    ' + ', '.join('0x%02x' % b for b in packed[i:i + 16]) + ',')
+
+    with open(dst, 'w') as f:
+        f.write('// Generated by gen_asset.py from %s - do not edit\n' % src.replace('\\', '/').split('/')[-1])
+        f.write('// %d bytes raw, %d bytes gzip\n' % (len(raw), len(packed)))
+        f.write('#include "web_assets.h"\n\n')
+        f.write('static const uint8_t %s_data[] = {\n' % symbol)
+        f.write('\n'.join(lines))
+        f.write('\n};\n\n')
+        f.write('const web_asset_t %s = {\n' % symbol)
+        f.write('    .data         = %s_data,\n' % symbol)
+        f.write('    .len          = sizeof(%s_data),\n' % symbol)
+        f.write('    .etag         = "%s",\n' % etag.replace('"', '\\"'))
+        f.write('    .content_type = "%s",\n' % content_type)
+        f.write('};\n')
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
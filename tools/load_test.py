@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+# Load test for the feeder's web server.
+#
+# Opens N keep-alive clients that request PATH in a loop, plus optional
+# slow clients that download the dashboard page a few bytes at a time, and
+# reports latency percentiles and errors per client kind. With the async
+# workers enabled the fast clients should see no latency change when slow
+# clients are added.
+#
+# Usage: load_test.py [--clients N] [--slow M] [--seconds S] [--path PATH] <host>
+#
+# The default path is /get_timer. Pointing it at /feed dispenses food.
+
+import argparse
+import http.client
+import threading
+import time
+
+
+class Stats:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.latencies = []
+        self.errors = {}
+
+    def ok(self, seconds):
+        with self.lock:
+            self.latencies.append(seconds)
+
+    def error(self, what):
+        with self.lock:
+            self.errors[what] = self.errors.get(what, 0) + 1
+
+    def report(self, name):
+        lat = sorted(self.latencies)
+        errors = sum(self.errors.values())
+        if not lat:
+            print(f'{name}: no successful requests, {errors} errors {self.errors}')
+            return
+
+        def pct(p):
+            return lat[min(len(lat) - 1, int(len(lat) * p / 100))] * 1000
+
+        print(f'{name}: {len(lat)} ok, {errors} errors, '
+              f'p50 {pct(50):.1f} ms, p90 {pct(90):.1f} ms, p99 {pct(99):.1f} ms, '
+              f'max {lat[-1] * 1000:.1f} ms')
+        for what, count in sorted(self.errors.items()):
+            print(f'  {what}: {count}')
+
+
+def fast_client(host, path, deadline, stats):
+    conn = None
+    while time.monotonic() < deadline:
+        try:
+            if conn is None:
+                conn = http.client.HTTPConnection(host, timeout=10)
+            start = time.monotonic()
+            conn.request('GET', path)
+            resp = conn.getresponse()
+            resp.read()
+            if resp.status == 200:
+                stats.ok(time.monotonic() - start)
+            else:
+                stats.error(f'HTTP {resp.status}')
+            if resp.will_close:
+                conn.close()
+                conn = None
+        except (OSError, http.client.HTTPException) as e:
+            stats.error(type(e).__name__)
+            if conn is not None:
+                conn.close()
+            conn = None
+            time.sleep(0.1)
+    if conn is not None:
+        conn.close()
+
+
+def slow_client(host, deadline, stats):
+    while time.monotonic() < deadline:
+        try:
+            conn = http.client.HTTPConnection(host, timeout=10)
+            start = time.monotonic()
+            conn.request('GET', '/', headers={'Accept-Encoding': 'gzip'})
+            resp = conn.getresponse()
+            while resp.read(64):
+                time.sleep(0.05)
+            conn.close()
+            if resp.status == 200:
+                stats.ok(time.monotonic() - start)
+            else:
+                stats.error(f'HTTP {resp.status}')
+        except (OSError, http.client.HTTPException) as e:
+            stats.error(type(e).__name__)
+            time.sleep(0.1)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Concurrent client load test')
+    parser.add_argument('host', help='feeder address, e.g. feeder-a1b2c3.local')
+    parser.add_argument('--clients', type=int, default=4, help='fast keep-alive clients')
+    parser.add_argument('--slow', type=int, default=0, help='clients reading / slowly')
+    parser.add_argument('--seconds', type=float, default=10, help='test duration')
+    parser.add_argument('--path', default='/get_timer', help='path the fast clients request')
+    args = parser.parse_args()
+
+    deadline = time.monotonic() + args.seconds
+    fast, slow = Stats(), Stats()
+    threads = [threading.Thread(target=fast_client, args=(args.host, args.path, deadline, fast))
+               for _ in range(args.clients)]
+    threads += [threading.Thread(target=slow_client, args=(args.host, deadline, slow))
+                for _ in range(args.slow)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+
+    fast.report(f'{args.clients} x {args.path}')
+    if args.slow:
+        slow.report(f'{args.slow} x slow /')
+    return 0
+
+
+if __name__ == '__main__':
+    raise SystemExit(main())
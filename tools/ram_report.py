@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+# Static RAM per component, from the linker map of a firmware build.
+#
+# Adds up the .data and .bss input sections placed in DRAM by the archive
+# they came from, so the static task stacks, queues and pools show up under
+# the component that owns them. The build runs this after every link; run
+# it by hand for the biggest symbols of one component.
+#
+# Usage: ram_report.py [--symbols COMPONENT] [--top N] <build/automatic_animal_feeder.map>
+
+import argparse
+import collections
+import re
+import sys
+
+# Output sections holding initialised and zeroed DRAM
+DRAM_SECTIONS = {
+    '.dram0.data': 'data',
+    '.dram0.bss': 'bss',
+    '.noinit': 'bss',
+}
+
+OUTPUT_RE = re.compile(r'^(\.\S+)\s')
+INPUT_RE = re.compile(r'^ (\.\S+|COMMON)(?:\s+(0x[0-9a-f]+)\s+(0x[0-9a-f]+)\s+(\S.*))?$')
+PLACED_RE = re.compile(r'^\s+(0x[0-9a-f]+)\s+(0x[0-9a-f]+)\s+(\S.*)$')
+ARCHIVE_RE = re.compile(r'(?:^|/)lib([^/]+)\.a\((.+)\)$')
+
+
+def component(source):
+    m = ARCHIVE_RE.search(source)
+    if m is None:
+        return source.rsplit('/', 1)[-1], source
+    return m.group(1), m.group(2)
+
+
+def parse(path):
+    """Yield (kind, component, object, symbol, size) per DRAM input section."""
+    kind = None
+    pending = None
+    with open(path, encoding='utf-8', errors='replace') as f:
+        for line in f:
+            line = line.rstrip('\n')
+            m = OUTPUT_RE.match(line)
+            if m:
+                kind = DRAM_SECTIONS.get(m.group(1))
+                pending = None
+                continue
+            if kind is None:
+                continue
+
+            m = INPUT_RE.match(line)
+            if m:
+                pending = None
+                if m.group(2) is None:
+                    pending = m.group(1)        # Long name, placement on the next line
+                    continue
+                name, size, source = m.group(1), m.group(3), m.group(4)
+            elif pending is not None and (m := PLACED_RE.match(line)):
+                name, size, source = pending, m.group(2), m.group(3)
+                pending = None
+            else:
+                continue
+
+            size = int(size, 16)
+            if size > 0:
+                comp, obj = component(source)
+                symbol = name.split('.', 2)[-1] if name.count('.') >= 2 else name
+                yield kind, comp, obj, symbol, size
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Static RAM per component')
+    parser.add_argument('map', help='linker map, e.g. build/automatic_animal_feeder.map')
+    parser.add_argument('--symbols', metavar='COMPONENT', help='list the largest symbols of one component')
+    parser.add_argument('--top', type=int, default=20, help='rows to print')
+    args = parser.parse_args()
+
+    try:
+        sections = list(parse(args.map))
+    except OSError as e:
+        print(f'ram_report: {e}', file=sys.stderr)
+        return 0                                # Never fail the build over the report
+
+    if args.symbols:
+        rows = sorted(((size, f'{obj}: {symbol} ({kind})')
+                       for kind, comp, obj, symbol, size in sections if comp == args.symbols), reverse=True)
+        for size, what in rows[:args.top]:
+            print(f'{size:8} {what}')
+        return 0
+
+    totals = collections.defaultdict(lambda: {'data': 0, 'bss': 0})
+    for kind, comp, _, _, size in sections:
+        totals[comp][kind] += size
+    rows = sorted(totals.items(), key=lambda item: item[1]['data'] + item[1]['bss'], reverse=True)
+
+    print(f'{"component":24} {"data":>8} {"bss":>8} {"total":>8}')
+    for comp, t in rows[:args.top]:
+        print(f'{comp:24} {t["data"]:8} {t["bss"]:8} {t["data"] + t["bss"]:8}')
+    rest = rows[args.top:]
+    if rest:
+        data = sum(t['data'] for _, t in rest)
+        bss = sum(t['bss'] for _, t in rest)
+        print(f'{f"({len(rest)} more)":24} {data:8} {bss:8} {data + bss:8}')
+    data = sum(t['data'] for t in totals.values())
+    bss = sum(t['bss'] for t in totals.values())
+    print(f'{"static DRAM":24} {data:8} {bss:8} {data + bss:8}')
+    return 0
+
+
+if __name__ == '__main__':
+    raise SystemExit(main())